@@ -49,12 +49,41 @@ ImageReader::ImageReader() {
     height = 641;
     totalsize = 3 * (size_t) width * (size_t) height * (size_t)sizeof (uint8_t);
 
+    fid = grp = -1;
+    live_index = live_jpeg = index_type = -1;
+    live_rows = live_next = 0;
 }
 
 /**
  * Destructor
  */
 ImageReader::~ImageReader() {
+    closeLive();
+    if (grp >= 0) {
+        H5Gclose(grp);
+    }
+    if (fid >= 0) {
+        H5Fclose(fid);
+    }
+}
+
+/**
+ * ImageReader::closeLive
+ *
+ * What tail opened, but not the file itself
+ */
+void ImageReader::closeLive() {
+    if (live_jpeg >= 0) {
+        H5Dclose(live_jpeg);
+    }
+    if (live_index >= 0) {
+        H5Dclose(live_index);
+    }
+    if (index_type >= 0) {
+        H5Tclose(index_type);
+    }
+    live_index = live_jpeg = index_type = -1;
+    live_rows = live_next = 0;
 }
 
 void ImageReader::read(string filename) {
@@ -105,6 +134,116 @@ Mat ImageReader::next() {
     }
 }
 
+/**
+ * ImageReader::tail
+ *
+ * Opens a chunked file for reading while it is written. A file that has been closed
+ * (or is not in the latest format) is opened the usual way.
+ */
+bool ImageReader::tail(string filename) {
+#if H5_VERSION_GE(1, 10, 0)
+    fid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT);
+    if (fid < 0) {
+        fid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    }
+#else
+    fid = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+#endif
+    if (fid < 0) {
+        return false;
+    }
+
+    // Rows of /index, matched by member name
+    struct Row { int64_t frame; uint64_t offset; uint64_t size; };
+    index_type = H5Tcreate(H5T_COMPOUND, sizeof (Row));
+    H5Tinsert(index_type, "frame", HOFFSET(Row, frame), H5T_NATIVE_INT64);
+    H5Tinsert(index_type, "offset", HOFFSET(Row, offset), H5T_NATIVE_UINT64);
+    H5Tinsert(index_type, "size", HOFFSET(Row, size), H5T_NATIVE_UINT64);
+
+    live_index = H5Dopen2(fid, "index", H5P_DEFAULT);
+    live_jpeg = H5Dopen2(fid, "jpeg", H5P_DEFAULT);
+    live_rows = live_next = 0;
+    if (live_index < 0 || live_jpeg < 0) {
+        closeLive();
+        H5Fclose(fid);
+        fid = -1;
+        return false;
+    }
+    refresh();
+    return true;
+}
+
+/**
+ * ImageReader::refresh
+ *
+ * The index first: the writer extends /jpeg before it adds the rows pointing into it
+ */
+hsize_t ImageReader::refresh() {
+    if (live_index < 0) {
+        return 0;
+    }
+#if H5_VERSION_GE(1, 10, 0)
+    H5Drefresh(live_index);
+    H5Drefresh(live_jpeg);
+#endif
+    hid_t space = H5Dget_space(live_index);
+    H5Sget_simple_extent_dims(space, &live_rows, NULL);
+    H5Sclose(space);
+    return live_rows - live_next;
+}
+
+void ImageReader::seek(hsize_t row) {
+    live_next = row;
+}
+
+bool ImageReader::nextJpeg(vector<uint8_t> &jpeg, int64_t &frame) {
+    if (live_next >= live_rows) {
+        return false;
+    }
+
+    struct Row { int64_t frame; uint64_t offset; uint64_t size; } row;
+    hsize_t one = 1;
+    hid_t space = H5Dget_space(live_index);
+    hid_t memory = H5Screate_simple(1, &one, NULL);
+    H5Sselect_hyperslab(space, H5S_SELECT_SET, &live_next, NULL, &one, NULL);
+    herr_t status = H5Dread(live_index, index_type, memory, space, H5P_DEFAULT, &row);
+    H5Sclose(memory);
+    H5Sclose(space);
+    if (status < 0 || row.size == 0) {
+        return false;
+    }
+
+    jpeg.resize(row.size);
+    hsize_t start = row.offset, count = row.size;
+    space = H5Dget_space(live_jpeg);
+    memory = H5Screate_simple(1, &count, NULL);
+    H5Sselect_hyperslab(space, H5S_SELECT_SET, &start, NULL, &count, NULL);
+    status = H5Dread(live_jpeg, H5T_NATIVE_UCHAR, memory, space, H5P_DEFAULT, &jpeg[0]);
+    H5Sclose(memory);
+    H5Sclose(space);
+    if (status < 0) {
+        return false;
+    }
+
+    frame = row.frame;
+    live_next++;
+    return true;
+}
+
+/**
+ * ImageReader::nextLive
+ *
+ * The next frame of a tailed file, decoded; empty if there is none yet
+ */
+Mat ImageReader::nextLive() {
+    vector<uint8_t> jpeg;
+    int64_t frame;
+    if (!nextJpeg(jpeg, frame)) {
+        return Mat();
+    }
+    return imdecode(jpeg, IMREAD_COLOR);
+}
+
 namespace AGDUtils {
 
     /**
@@ -212,4 +351,25 @@ namespace AGDUtils {
         }
         return (string) buffer;
     }
+
+    /**
+     * luminance
+     *
+     * Mean gray level of a BGR image (truncated to an integer, as it always has been)
+     */
+    float luminance(const Mat &input) {
+        Mat grayMat;
+        cvtColor(input, grayMat, CV_BGR2GRAY);
+
+        // Summation of intensity
+        int Totalintensity = 0;
+        for (int i = 0; i < grayMat.rows; ++i) {
+            for (int j = 0; j < grayMat.cols; ++j) {
+                Totalintensity += (int) grayMat.at<uchar>(i, j);
+            }
+        }
+
+        // Find avg lum of frame
+        return Totalintensity / (grayMat.rows * grayMat.cols);
+    }
 }
@@ -40,6 +40,7 @@ namespace AGDUtils {
     int64_t grabSeconds();
     int64_t grabMilliseconds();
     std::string pipe_to_string(const char *command);
+    float luminance(const cv::Mat &input);
 }
 
 class ImageReader {
@@ -52,6 +53,17 @@ public:
     void read(std::string filename);
     cv::Mat next();
 
+    // Chunked files (see FrameFile.h), also while they are being recorded: tail opens
+    // one as an SWMR reader, refresh picks up the frames flushed since (how many are
+    // waiting), nextJpeg and nextLive hand them out in order and return nothing once
+    // they are used up; seek moves to a row of /index (a work unit's first, see
+    // FrameNotifier.h)
+    bool tail(std::string filename);
+    hsize_t refresh();
+    void seek(hsize_t row);
+    bool nextJpeg(std::vector<uint8_t> &jpeg, int64_t &frame);
+    cv::Mat nextLive();
+
     // Attributes
     std::vector<std::string> elements;
     hsize_t numObjects;
@@ -63,6 +75,11 @@ private:
     size_t totalsize;
     char group_name[MAX_NAME];
     unsigned int idx;
+
+    // tail
+    hid_t live_index, live_jpeg, index_type;
+    hsize_t live_rows, live_next;
+    void closeLive();
 };
 
 #endif /* AGDUTILS_H */
@@ -6,6 +6,17 @@
 // AgriData
 #include "AgriDataCamera.h"
 #include "AGDUtils.h"
+#include "CameraFamily.h"
+#include "BandwidthPlanner.h"
+#include "BsonFields.h"
+#include "TransportTuning.h"
+#include "ThreadRoles.h"
+#include "AsyncLog.h"
+#include "Scheduler.h"
+#include "MemoryBudget.h"
+#include "MetadataJournal.h"
+#include "TaskRegistry.h"
+#include "StatusSeries.h"
 
 // Utilities
 #include "zmq.hpp"
@@ -24,9 +35,6 @@
 
 // Include files to use the PYLON API.
 #include <pylon/PylonIncludes.h>
-#include <pylon/gige/BaslerGigEInstantCamera.h>
-#include <pylon/gige/BaslerGigEInstantCameraArray.h>
-#include <pylon/gige/_BaslerGigECameraParams.h>
 
 // GenApi
 #include <GenApi/GenApi.h>
@@ -65,8 +73,6 @@
 typedef std::chrono::high_resolution_clock Clock;
 
 // Namespaces
-using namespace Basler_GigECameraParams;
-using namespace Basler_GigEStreamParams;
 using namespace Pylon;
 using namespace H5;
 using namespace std;
@@ -78,11 +84,36 @@ using json = nlohmann::json;
 /**
  * Constructor
  */
-AgriDataCamera::AgriDataCamera() :
+AgriDataCamera::AgriDataCamera(const string &mongodb_host) :
+frames_grabbed(0),
+frames_failed(0),
+frames_skipped(0),
+frames_slipped(0),
+frames_decimated(0),
+fps(0),
+bytes_written(0),
+documents_pending(0),
+documents_dropped(0),
+samples_skipped(0),
+helper_threads(0),
+stream_statistic_names(NULL),
+last_flight_dump(0),
+preview_due(false),
+luminance_due(false),
+flush_requested(false),
+MONGODB_HOST(mongodb_host),
 ctx_(1),
 conn{mongocxx::uri
     { MONGODB_HOST}}
 {
+    for (int i = 0; i < MAX_STREAM_STATISTICS; ++i) {
+        stream_statistics[i] = 0;
+    }
+
+    // Without configuration, only a frame taking over a second to reach the disk
+    flight_deadline_ns[STAGE_TOTAL] = 1000000000;
+
+    MemoryBudget::Acquire(POOL_METADATA, records.Bytes());
 }
 
 /**
@@ -125,12 +156,17 @@ void AgriDataCamera::Initialize() {
         Open();
     }
 
-    if (!IsGrabbing()) {
-        StartGrabbing();
+    // Resolve the family-specific nodes once; nothing after this probes node names
+    nodes.reset(CreateCameraNodes(GetDeviceInfo(), nodeMap));
+
+    // Configuration and transport settings can only be applied while not grabbing
+    if (IsGrabbing()) {
+        StopGrabbing();
     }
 
     // Print the model name of the
-    LOG(INFO) << "Initializing device " << GetDeviceInfo().GetModelName();
+    LOG(INFO) << "Initializing device " << GetDeviceInfo().GetModelName()
+            << " (" << nodes->FamilyName() << ")";
 
     try {
         string config = "/home/nvidia/CameraDeamon/config/"
@@ -143,25 +179,21 @@ void AgriDataCamera::Initialize() {
         LOG(ERROR) << "An exception occurred." << e.GetDescription();
     }
 
-    // Set Interpacket Delay
-    try {    // (GigE only)
-        srand(time(NULL));
-        CIntegerPtr intFeature(nodeMap.GetNode("GevSCPD"));
-        intFeature->SetValue((rand() % 12150) + 7150);
-    } catch (...) {
-        LOG(WARNING) << "Skipping GevSCPD parameter";
+    // Transport-specific settings (USB transfer size / GigE packet size). Grabbing
+    // starts in Run() (or Snap()), after the GigE bandwidth plan has been applied.
+    try {
+        nodes->Tune(*this);
+    } catch (const GenericException &e) {
+        LOG(WARNING) << "Transport tuning failed: " << e.GetDescription();
     }
+    has_bandwidth_plan = false;
 
     // Get Dimensions
     width = (int) CIntegerPtr(nodeMap.GetNode("Width"))->GetValue();
     height = (int) CIntegerPtr(nodeMap.GetNode("Height"))->GetValue();
 
     // Identifier
-    try { // USB
-        serialnumber = (string) CStringPtr(nodeMap.GetNode("DeviceSerialNumber"))->GetValue();
-    } catch (...) { // GigE
-        serialnumber = (string) CStringPtr(nodeMap.GetNode("DeviceID"))->GetValue();
-    }
+    serialnumber = nodes->SerialNumber();
     modelname = (string) CStringPtr(nodeMap.GetNode("DeviceModelName"))->GetValue();
 
     // Print camera device information.
@@ -170,17 +202,14 @@ void AgriDataCamera::Initialize() {
     LOG(INFO) << "Vendor : "
             << CStringPtr(nodeMap.GetNode("DeviceVendorName"))->GetValue();
     LOG(INFO) << "Model : "
-            << modelname;
+            << modelname << " (" << nodes->FamilyName() << ")";
     LOG(INFO) << "Firmware version : "
             << CStringPtr(nodeMap.GetNode("DeviceFirmwareVersion"))->GetValue();
     LOG(INFO) << "Serial Number : "
             << serialnumber;
     LOG(INFO) << "Frame Size : " << width << 'x' << height;
-    LOG(INFO) << "Max Buffer Size : " << GetStreamGrabberParams().Statistic_Total_Buffer_Count.GetValue();
-    LOG(INFO) << "Packet Size : " << GevSCPSPacketSize.GetValue();
-    LOG(INFO) << "Inter-packet Delay : " << GevSCPD.GetValue();
-    LOG(INFO) << "Packet Size : " << GevSCBWA.GetValue();
-    LOG(INFO) << "Max Throughput : " << GevSCDMT.GetValue();
+    LOG(INFO) << "Max Buffer Count : " << MaxNumBuffer.GetValue();
+    LOG(INFO) << "Chunk Mode : " << (nodes->ChunkModeActive() ? "On" : "Off");
 
     // Create Mat image templates
     cv_img = Mat(width, height, CV_8UC3);
@@ -200,19 +229,19 @@ void AgriDataCamera::Initialize() {
     isRecording = false;
     isPaused = false;
 
-    // Timer
-    tick = 0;
-
     // Streaming image compression
     compression_params.push_back(CV_IMWRITE_JPEG_QUALITY);
     compression_params.push_back(30);
     
-    // Obtain box info
+    // Obtain box info (a fresh database, e.g. for a soak test, has none)
     mongocxx::collection box = db["box"];
     bsoncxx::stdx::optional<bsoncxx::document::value> maybe_result = box.find_one(bsoncxx::builder::stream::document{}<< bsoncxx::builder::stream::finalize);
-    string resultstring = bsoncxx::to_json(*maybe_result);
-    auto thisbox = json::parse(resultstring);
-    clientid = thisbox["clientid"];
+    if (maybe_result) {
+        clientid = BsonFields::String(maybe_result->view(), "clientid", "unknown");
+    } else {
+        LOG(WARNING) << "No box document in the database, using clientid \"unknown\"";
+        clientid = "unknown";
+    }
 
     // HDF5
     current_hdf5_file = "";
@@ -225,12 +254,38 @@ void AgriDataCamera::Initialize() {
  * Main loop
  */
 void AgriDataCamera::Run() {
-    // Output parameters
-    save_prefix = "/data/output/" + clientid + "/" + scanid + "/"
-            + serialnumber + "/";
+    ScopedThreadRole role(ROLE_GRAB, serialnumber);
+
+    // Stop() waits for this, however Run() ends
+    {
+        lock_guard<mutex> lock(run_mutex);
+        running = true;
+    }
+    struct Finished {
+        AgriDataCamera *camera;
+
+        ~Finished() {
+            lock_guard<mutex> lock(camera->run_mutex);
+            camera->running = false;
+            camera->run_changed.notify_all();
+        }
+    } finished = {this};
+
+    // File indices of the records start over; the last recording's were all flushed
+    // before it ended
+    {
+        lock_guard<mutex> lock(record_files_mutex);
+        record_files.clear();
+        current_file = 0;
+    }
+
+    // Output parameters (the first frame opens the first file)
+    if (!layout.Begin(output_root, clientid, scanid, serialnumber)) {
+        LOG(ERROR) << "Cannot create " << layout.Directory();
+    }
+    save_prefix = layout.Directory();
+    current_hdf5_file = "";
     LOG(INFO) << save_prefix;
-    bool success = AGDUtils::mkdirp(save_prefix.c_str(),
-            S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
 
     // Set recording to true and start grabbing
     isRecording = true;
@@ -238,32 +293,94 @@ void AgriDataCamera::Run() {
         StartGrabbing();
     }
 
+    // Pylon's grab buffers and our converted / resized frames are held for the whole
+    // recording
+    CIntegerPtr payload(GetNodeMap().GetNode("PayloadSize"));
+    grab_bytes = IsReadable(payload) ? (size_t) (MaxNumBuffer.GetValue() * payload->GetValue()) : 0;
+    convert_bytes = (size_t) (width * height + TARGET_HEIGHT * TARGET_WIDTH) * 3;
+    MemoryBudget::Acquire(POOL_GRAB, grab_bytes);
+    MemoryBudget::Acquire(POOL_CONVERT, convert_bytes);
+
     // Save configuration
     INodeMap &nodeMap = GetNodeMap();
     string config = save_prefix + "config.txt";
     CFeaturePersistence::Save(config.c_str(), &nodeMap);
 
+    // Per-frame metadata comes from the chunks if the configuration turned them on.
+    // Chunk nodes from a previous recording refer to buffers that no longer exist.
+    nodes->ResetChunks();
+    chunk_mode = nodes->ChunkModeActive();
+
+    // Camera clock for the sensor-to-disk latency; the offset to the host clock is
+    // learned again for every recording
+    ns_per_tick = 1e9 / nodes->TimestampTickFrequency();
+    has_clock_offset = false;
+
+    // Frame accounting starts over with every recording
+    frames_grabbed = 0;
+    frames_failed = 0;
+    frames_skipped = 0;
+    frames_slipped = 0;
+    frames_decimated = 0;
+    quality.Reset();
+    has_block_id = false;
+
+    // Frame rate, stream statistics, the drop rate, previews, luminance and database
+    // flushes are all background jobs from here on
+    stream_statistic_names = nodes->StreamStatistics();
+    ScheduleJobs();
+
     // Initiate main loop with algorithm
     while (isRecording) {
         if (!isPaused) {
             // Wait for an image and then retrieve it. A timeout of 5000 ms is used.
+            // Dequeue time is mostly waiting for the camera; near zero means frames are
+            // queueing up behind HandleFrame.
+            int64_t dequeue_start = LatencyHistogram::Now();
             RetrieveResult(5000, ptrGrabResult, TimeoutHandling_ThrowException);
+            int64_t arrival = LatencyHistogram::Now();
+            latency.Record(STAGE_DEQUEUE, arrival - dequeue_start);
+
             try {
+                // Frames lost in transport or for want of a buffer never show up here,
+                // but they leave a gap in the block id
+                frames_grabbed++;
+                uint64_t block_id = ptrGrabResult->GetBlockID();
+                if (block_id != UINT64_MAX) {
+                    if (has_block_id && block_id > last_block_id + 1) {
+                        frames_skipped += block_id - last_block_id - 1;
+                        RecordDrop(arrival, (int64_t) last_block_id + 1, block_id - last_block_id - 1);
+                    }
+                    last_block_id = block_id;
+                    has_block_id = true;
+                }
+
                 // Image grabbed successfully?
-                if (ptrGrabResult->GrabSucceeded()) {
+                if (ptrGrabResult->GrabSucceeded() && !quality.Keep(ptrGrabResult->GetImageNumber())) {
+                    // Decimated: the pipeline is behind and this one is let go on purpose
+                    frames_decimated++;
+                    UpdateQuality(arrival, -1);
+
+                } else if (ptrGrabResult->GrabSucceeded()) {
                     // Create Frame Packet
                     FramePacket fp;
+                    fp.arrival = arrival;
+
+                    // Flight recorder entry, filled in as the frame goes through HandleFrame
+                    fp.event = FlightEvent();
+                    fp.event.type = EVENT_FRAME;
+                    fp.event.start = arrival;
+                    fp.event.frame = ptrGrabResult->GetImageNumber();
+                    fp.event.stage_ns[STAGE_DEQUEUE] = FlightRecorder::Clamp(arrival - dequeue_start);
 
                     // Computer time
                     fp.time_now = AGDUtils::grabMilliseconds();
                     last_timestamp = fp.time_now;
 
-                    // Exposure time
-                    try { // USB
-                        fp.exposure_time = (float) CFloatPtr(GetNodeMap().GetNode("ExposureTime"))->GetValue();
-                    } catch (...) { // GigE
-                        fp.exposure_time = (float) CFloatPtr(GetNodeMap().GetNode("ExposureTimeAbs"))->GetValue();
-                    }
+                    // Exposure time (exact from the chunks, otherwise the live value, which
+                    // auto-exposure may already have moved on from)
+                    fp.chunks.valid = chunk_mode && nodes->ReadChunks(ptrGrabResult, fp.chunks);
+                    fp.exposure_time = fp.chunks.valid ? fp.chunks.exposure_time : nodes->ExposureTime();
 
                     // Image
                     fp.img_ptr = ptrGrabResult;
@@ -272,12 +389,17 @@ void AgriDataCamera::Run() {
                     try {
                         HandleFrame(fp);
                     } catch (...) {
-                        LOG(WARNING) << "Frame slipped!";
+                        frames_slipped++;
+                        RecordDrop(arrival, fp.event.frame, 1);
+                        HOT_LOG(Warning, "[%s] Frame slipped!", serialnumber.c_str());
                     }
+                    UpdateQuality(arrival, LatencyHistogram::Now() - arrival);
 
                 } else {
-                    LOG(INFO) << "Error: " << ptrGrabResult->GetErrorCode() << " "
-                            << ptrGrabResult->GetErrorDescription();
+                    frames_failed++;
+                    RecordDrop(arrival, ptrGrabResult->GetImageNumber(), 1);
+                    HOT_LOG(Info, "[%s] Error: %u %s", serialnumber.c_str(), ptrGrabResult->GetErrorCode(),
+                            ptrGrabResult->GetErrorDescription().c_str());
                 }
             } catch (const GenericException &e) {
                 LOG(ERROR) << ptrGrabResult->GetErrorCode() + "\n"
@@ -285,6 +407,260 @@ void AgriDataCamera::Run() {
                         + e.GetDescription();
                 isRecording = false;
             }
+        } else {
+            // Grab threads may run SCHED_FIFO on cores of their own; a paused one must
+            // sleep, not spin
+            unique_lock<mutex> lock(run_mutex);
+            run_changed.wait_for(lock, chrono::milliseconds(100), [this]() {
+                return !isPaused || !isRecording;
+            });
+        }
+    }
+    CancelJobs();
+
+    // Records of the last frames, before the next recording's scan and files replace
+    // the ones they belong to
+    FlushDocuments();
+
+    MemoryBudget::Release(POOL_GRAB, grab_bytes);
+    MemoryBudget::Release(POOL_CONVERT, convert_bytes);
+    grab_bytes = 0;
+    convert_bytes = 0;
+    fps = 0;
+}
+
+/**
+ * ScheduleJobs
+ *
+ * The periodic work of a recording, on the shared scheduler's workers
+ */
+void AgriDataCamera::ScheduleJobs() {
+    status_time = LatencyHistogram::Now();
+    status_frames = 0;
+    status_drops = 0;
+    preview_due = false;
+    luminance_due = false;
+
+    jobs.push_back(Scheduler::Every(preview_period, "preview " + serialnumber, [this]() {
+        preview_due = true;
+    }));
+    jobs.push_back(Scheduler::Every(luminance_period, "luminance " + serialnumber, [this]() {
+        luminance_due = true;
+    }));
+    jobs.push_back(Scheduler::Every(flush_period, "flush " + serialnumber, [this]() {
+        FlushDocuments();
+    }));
+    jobs.push_back(Scheduler::Every(status_period, "status " + serialnumber, [this]() {
+        SampleStatus();
+    }));
+    jobs.push_back(Scheduler::Every(hdf5.FlushCheckMs(), "hdf5 " + serialnumber, [this]() {
+        hdf5.FlushDue();
+    }));
+}
+
+/**
+ * CancelJobs
+ *
+ * Waits for any of them still running; documents left over are Stop()'s to flush
+ */
+void AgriDataCamera::CancelJobs() {
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        Scheduler::Cancel(jobs[i]);
+    }
+    jobs.clear();
+}
+
+/**
+ * AppendFrame
+ *
+ * The frame document, from its record
+ */
+void AgriDataCamera::AppendFrame(bsoncxx::builder::basic::document &doc, const FrameRecord &record, const string &filename) {
+    using bsoncxx::builder::basic::kvp;
+
+    doc.append(kvp("serialnumber", serialnumber));
+    doc.append(kvp("scanid", scanid));
+
+    // Basler time and frame
+    doc.append(kvp("camera_time", to_string(record.camera_time)));
+    doc.append(kvp("timestamp", record.timestamp));
+    doc.append(kvp("frame_number", record.frame_number));
+
+    // Camera data
+    doc.append(kvp("exposure_time", record.exposure_time));
+    if (record.chunk_valid) {
+        doc.append(kvp("gain", record.gain));
+        doc.append(kvp("camera_frame_counter", record.camera_frame_counter));
+        doc.append(kvp("line_status", record.line_status));
+    }
+
+    // What the frame path was dropping to keep up
+    doc.append(kvp("quality_level", QualityController::Name((QualityLevel) record.quality_level)));
+    doc.append(kvp("jpeg_quality", (int) record.jpeg_quality));
+
+    doc.append(kvp("filename", filename));
+}
+
+/**
+ * RecordFile
+ *
+ * HDF5 file name of a FrameRecord
+ */
+string AgriDataCamera::RecordFile(uint32_t file) {
+    lock_guard<mutex> lock(record_files_mutex);
+    return file < record_files.size() ? record_files[file] : string();
+}
+
+/**
+ * ConfigureMetadata
+ *
+ * The "metadata" block of config/daemon.json. Call before recording starts.
+ */
+void AgriDataCamera::ConfigureMetadata(const json &config) {
+    MemoryBudget::Release(POOL_METADATA, records.Bytes());
+    records.Resize(config.value("records", records.Capacity()));
+    records_batch = max<size_t>(1, config.value("batch", records_batch));
+    MemoryBudget::Acquire(POOL_METADATA, records.Bytes());
+}
+
+/**
+ * PostFrameJob
+ *
+ * Hands a copy of frame to job on a scheduler worker, with the copy charged to the
+ * memory budget until the job is done. False if the budget or the queue refused it.
+ */
+bool AgriDataCamera::PostFrameJob(const Mat &frame, const function<void(Mat)> &job) {
+    size_t bytes = frame.total() * frame.elemSize();
+    if (!MemoryBudget::Acquire(POOL_JOBS, bytes)) {
+        return false;
+    }
+
+    Mat copy = frame.clone();
+    bool posted = Scheduler::Post([job, copy, bytes]() {
+        try {
+            job(copy);
+        } catch (...) {
+            MemoryBudget::Release(POOL_JOBS, bytes);
+            throw;
+        }
+        MemoryBudget::Release(POOL_JOBS, bytes);
+    });
+    if (!posted) {
+        MemoryBudget::Release(POOL_JOBS, bytes);
+    }
+    return posted;
+}
+
+/**
+ * ConfigureSchedule
+ *
+ * Periods from the "scheduler" block of config/daemon.json. Call before recording starts.
+ */
+void AgriDataCamera::ConfigureSchedule(const json &config) {
+    preview_period = config.value("preview_ms", preview_period);
+    luminance_period = config.value("luminance_ms", luminance_period);
+    flush_period = config.value("flush_ms", flush_period);
+    status_period = config.value("status_ms", status_period);
+}
+
+/**
+ * SampleStatus
+ *
+ * Frame rate since the last sample, stream grabber statistics, and a flight recorder
+ * dump if too many frames were lost in the meantime
+ */
+void AgriDataCamera::SampleStatus() {
+    int64_t now = LatencyHistogram::Now();
+    uint64_t grabbed = frames_grabbed;
+    if (now > status_time) {
+        fps = (grabbed - status_frames) * 1e9f / (now - status_time);
+    }
+    status_time = now;
+    status_frames = grabbed;
+
+    SampleStreamStatistics();
+
+    // Threshold is per second
+    uint64_t drops = frames_failed + frames_skipped + frames_slipped;
+    if ((drops - status_drops) * 1000 > flight_drop_threshold * status_period) {
+        TriggerFlightDump("drops");
+    }
+    status_drops = drops;
+}
+
+/**
+ * FlushDocuments
+ *
+ * Turns the frame records gathered since the last flush into documents and appends
+ * them to the scan's journal, which the replayer sends on to the database (see
+ * MetadataJournal.h). Without a journal they are sent in batches, on a connection of
+ * its own (mongocxx clients are not shared between threads).
+ */
+void AgriDataCamera::FlushDocuments() {
+    lock_guard<mutex> flushing(flush_mutex);
+    if (records.Size() == 0) {
+        return;
+    }
+
+    FlightEvent flush = FlightEvent();
+    flush.type = EVENT_FLUSH;
+    flush.start = LatencyHistogram::Now();
+    flush.frame = -1;
+
+    unique_ptr<mongocxx::client> _conn;
+
+    vector<bsoncxx::document::value> batch;
+    batch.reserve(records_batch);
+    uint32_t file = UINT32_MAX;
+    string filename;
+
+    while (records.Drain(records_batch, [&](const FrameRecord &record) {
+            if (record.file != file) {
+                file = record.file;
+                filename = RecordFile(file);
+            }
+            bsoncxx::builder::basic::document doc{};
+            AppendFrame(doc, record, filename);
+            flush.value++;
+            if (!MetadataJournal::Append(JOURNAL_FRAME, doc.view())) {
+                batch.push_back(doc.extract());
+            }
+        }) > 0) {
+        if (batch.empty()) {
+            continue;
+        }
+        HOT_LOG(Debug, "[%s] Sending %zu documents to Database", serialnumber.c_str(), batch.size());
+        try {
+            if (!_conn) {
+                _conn.reset(new mongocxx::client(mongocxx::uri{ MONGODB_HOST}));
+            }
+            (*_conn)["agdb"]["frame"].insert_many(batch);
+        } catch (const exception &e) {
+            HOT_LOG(Error, "[%s] Could not send documents: %s", serialnumber.c_str(), e.what());
+        }
+        batch.clear();
+    }
+    documents_pending = records.Size();
+
+    int64_t flush_ns = LatencyHistogram::Now() - flush.start;
+    mongo_flush.Record(flush_ns);
+    flush.stage_ns[0] = FlightRecorder::Clamp(flush_ns);
+    flight.Record(flush);
+}
+
+/**
+ * SampleStreamStatistics
+ *
+ * Copies the stream grabber statistics into atomics, from the status job, so that
+ * the metrics endpoint never touches the nodemap
+ */
+void AgriDataCamera::SampleStreamStatistics() {
+    INodeMap &streamMap = GetStreamGrabberNodeMap();
+    const char * const * names = stream_statistic_names;
+    for (int i = 0; i < MAX_STREAM_STATISTICS && names[i] != NULL; ++i) {
+        CIntegerPtr statistic(streamMap.GetNode(names[i]));
+        if (IsReadable(statistic)) {
+            stream_statistics[i] = statistic->GetValue();
         }
     }
 }
@@ -295,212 +671,373 @@ void AgriDataCamera::Run() {
  * Receive latest frame
  */
 void AgriDataCamera::HandleFrame(AgriDataCamera::FramePacket fp) {
+    FlightEvent &event = fp.event;
     double dif;
     struct timeval tp;
     long int start, end;
-    tick++;
 
-    // Docuemnt
-    auto doc = bsoncxx::builder::basic::document{};
-    doc.append(
-            bsoncxx::builder::basic::kvp("serialnumber", serialnumber));
-    doc.append(bsoncxx::builder::basic::kvp("scanid", scanid));
+    // Document (as a fixed record; the flush job turns it into BSON)
+    FrameRecord record = FrameRecord();
+    record.timestamp = fp.time_now;
 
     // Basler time and frame
-    ostringstream camera_time;
-    camera_time << fp.img_ptr->GetTimeStamp();
-    doc.append(bsoncxx::builder::basic::kvp("camera_time", (string) camera_time.str()));
-    doc.append(bsoncxx::builder::basic::kvp("timestamp", fp.time_now));
-    doc.append(
-            bsoncxx::builder::basic::kvp("frame_number",
-            fp.img_ptr->GetImageNumber()));
+    record.camera_time = fp.chunks.valid ? fp.chunks.timestamp : fp.img_ptr->GetTimeStamp();
+    record.frame_number = fp.img_ptr->GetImageNumber();
 
     // Add Camera data
-    doc.append(bsoncxx::builder::basic::kvp("exposure_time", fp.exposure_time));
+    record.exposure_time = fp.exposure_time;
+    record.chunk_valid = fp.chunks.valid;
+    if (fp.chunks.valid) {
+        record.gain = fp.chunks.gain;
+        record.camera_frame_counter = fp.chunks.frame_counter;
+        record.line_status = fp.chunks.line_status;
+    }
 
-    // Computer time and output directory
-    vector<string> hms = AGDUtils::split(AGDUtils::grabTime("%H:%M:%S"), ':');
-    string hdf5file = scanid + "_" + serialnumber + "_" + hms[0].c_str() + "_" + hms[1].c_str() + ".hdf5";
-    doc.append(bsoncxx::builder::basic::kvp("filename", hdf5file));
+    // What the frame path was dropping to keep up
+    record.quality_level = quality.Level();
+    record.jpeg_quality = quality.JpegQuality();
 
-    // Should we open a new file?
-    if (hdf5file.compare(current_hdf5_file) != 0) {
+    // Should we open a new file? (the layout knows when the current one is due)
+    if (layout.Due(fp.time_now)) {
+        FlightEvent rotation = FlightEvent();
+        rotation.type = EVENT_ROTATION;
+        rotation.start = LatencyHistogram::Now();
+        rotation.frame = event.frame;
 
         // Close the previous file (if it is a thing)
         if (current_hdf5_file.compare("") != 0) {
-            H5Fclose(hdf5_out);
+            hdf5.Close();
             AddTask(current_hdf5_file);
         }
-        
-        current_hdf5_file = hdf5file;
+
+        current_hdf5_file = layout.Rotate(fp.time_now);
+        {
+            lock_guard<mutex> lock(record_files_mutex);
+            record_files.push_back(current_hdf5_file);
+            current_file = record_files.size() - 1;
+        }
         LOG(INFO) << "HDF5 File: " << save_prefix + current_hdf5_file;
-        hdf5_out = H5Fcreate((save_prefix + current_hdf5_file).c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        if (!hdf5.Open(save_prefix + current_hdf5_file, FileTask(current_hdf5_file))) {
+            LOG(ERROR) << "Cannot create " << save_prefix + current_hdf5_file;
+        }
+
+        rotation.stage_ns[0] = FlightRecorder::Clamp(LatencyHistogram::Now() - rotation.start);
+        flight.Record(rotation);
     }
+    record.file = current_file;
 
 
     // Convert to BGR8Packed CPylonImage
+    int64_t lap = LatencyHistogram::Now();
     fc.Convert(image, fp.img_ptr);
+    event.stage_ns[STAGE_CONVERT] = FlightRecorder::Clamp(latency.Lap(STAGE_CONVERT, lap));
 
     // To OpenCV Mat
     last_img = Mat(fp.img_ptr->GetHeight(), fp.img_ptr->GetWidth(), CV_8UC3, (uint8_t *) image.GetBuffer());
 
     // Resize
     resize(last_img, small_last_img, Size(TARGET_HEIGHT, TARGET_WIDTH));
+    event.stage_ns[STAGE_RESIZE] = FlightRecorder::Clamp(latency.Lap(STAGE_RESIZE, lap));
 
     // Color
     cvtColor(small_last_img, small_last_img, CV_BGR2RGB);
+    event.stage_ns[STAGE_COLOR] = FlightRecorder::Clamp(latency.Lap(STAGE_COLOR, lap));
 
     // Rotate (Expensive, 11ms)
     // small_last_img = AgriDataCamera::Rotate(small_last_img);
 
     // Write JPEG
-    // imwrite(string("/data/output/image/") + hms[0].c_str() + "_" + hms[1].c_str() +  to_string(fp.img_ptr->GetImageNumber()).c_str() + ".jpg", small_last_img);
+    // imwrite(string("/data/output/image/") + to_string(fp.img_ptr->GetImageNumber()).c_str() + ".jpg", small_last_img);
 
-    // Encode to JPG Buffer
+    // Encode to JPG Buffer (charged at the size of the raw frame, which the JPEG will
+    // not exceed, until it is written)
+    size_t encode_bytes = small_last_img.total() * small_last_img.elemSize();
+    MemoryBudget::Acquire(POOL_ENCODE, encode_bytes);
     vector<uint8_t> outbuffer;
-    static const vector<int> ENCODE_PARAMS = {};
-    imencode(".jpg", small_last_img, outbuffer, ENCODE_PARAMS);
+    imencode(".jpg", small_last_img, outbuffer, quality.EncodeParams());
+    event.stage_ns[STAGE_ENCODE] = FlightRecorder::Clamp(latency.Lap(STAGE_ENCODE, lap));
 
-    // Create HDF5 Dataset
-    hsize_t buffersize = outbuffer.size();
-    try {
-        H5LTmake_dataset(hdf5_out, to_string(fp.img_ptr->GetImageNumber()).c_str(), 1, &buffersize, H5T_NATIVE_UCHAR, &outbuffer[0]);
-    } catch (...) {
-        LOG(INFO) << "Frame dropped (likely end of recording)";
-    }
-    // Write to streaming image
-    if (tick % T_LATEST == 0) {
-        thread t(&AgriDataCamera::writeLatestImage, this, last_img,
-                ref(compression_params));
-        t.detach();
-    }
-
-    // Check Luminance (and add to documents)
-    if (tick % T_LUMINANCE == 0) {
-        // We send to database first, then we can edit it later
-        auto ret = frames.insert_one(doc.view());
-        bsoncxx::oid oid = ret->inserted_id().get_oid().value;
-        thread t(&AgriDataCamera::Luminance, this, oid, small_last_img);
-        t.detach();
+    // Write to the HDF5 file (see FrameFile.h)
+    if (hdf5.Write(fp.img_ptr->GetImageNumber(), fp.time_now, &outbuffer[0], outbuffer.size())) {
+        bytes_written += outbuffer.size();
     } else {
-        // Add to documents
-        documents.push_back(doc.extract());
+        HOT_LOG(Info, "[%s] Frame dropped (likely end of recording)", serialnumber.c_str());
+    }
+    outbuffer = vector<uint8_t>();
+    MemoryBudget::Release(POOL_ENCODE, encode_bytes);
+    event.stage_ns[STAGE_WRITE] = FlightRecorder::Clamp(latency.Lap(STAGE_WRITE, lap));
+    event.stage_ns[STAGE_TOTAL] = FlightRecorder::Clamp(RecordSensorToDisk(fp, lap));
+
+    // Write to streaming image (the resized frame: last_img is overwritten by the next one)
+    if (preview_due.exchange(false) && quality.Preview()) {
+        PostFrameJob(small_last_img, [this](Mat preview) {
+            Mat bgr;
+            cvtColor(preview, bgr, CV_RGB2BGR);
+            writeLatestImage(bgr, compression_params);
+        });
     }
 
-    // Send documents to database
-    try {
-        if ((tick % T_MONGODB == 0) && (documents.size() > 0)) {
-            LOG(DEBUG) << "Sending " << documents.size() << " documents to Database";
-            frames.insert_many(documents);
-            documents.clear();
+    // Luminance samples go to the database on their own, with the luminance; the rest
+    // wait for the flush job
+    lap = LatencyHistogram::Now();
+    bool sampled = false;
+    if (luminance_due.exchange(false) && quality.Sample()) {
+        sampled = PostFrameJob(small_last_img, [this, record](Mat input) {
+            SampleLuminance(record, input);
+        });
+
+        // Refused: the frame keeps its document, without the luminance
+        if (!sampled) {
+            samples_skipped++;
+        }
+    }
+    if (!sampled) {
+        if (!records.Push(record)) {
+            documents_dropped++;
+            HOT_LOG(Warning, "[%s] Metadata ring full, frame %lld has no document", serialnumber.c_str(),
+                    (long long) record.frame_number);
+        }
+
+        // Half full: flush now rather than wait for the flush job
+        size_t pending = records.Size();
+        documents_pending = pending;
+        if (pending * 2 > records.Capacity() && !flush_requested.exchange(true)) {
+            Scheduler::Post([this]() {
+                flush_requested = false;
+                FlushDocuments();
+            });
+        }
+    }
+    event.stage_ns[STAGE_METADATA] = FlightRecorder::Clamp(latency.Lap(STAGE_METADATA, lap));
+    event.queue_depth = documents_pending;
+    flight.Record(event);
+
+    // Any stage over its deadline?
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+        if (flight_deadline_ns[s] > 0 && event.stage_ns[s] > flight_deadline_ns[s]) {
+            TriggerFlightDump(string("deadline_") + StageLatency::Name((LatencyStage) s));
+            break;
         }
-    } catch (...) {
-        LOG(DEBUG) << "Exception caught";
     }
 }
 
 /**
- * AddTask
+ * UpdateQuality
  *
- * Create a task entry in the database for an HDF5 file
+ * Feeds the quality controller after every frame; level changes go to the log and the
+ * flight recorder
  */
+void AgriDataCamera::UpdateQuality(int64_t now, int64_t busy) {
+    if (!quality.Update(now, busy, NumReadyBuffers.GetValue())) {
+        return;
+    }
 
-void AgriDataCamera::AddTask(string hdf5file) {
-    // New Mongo Connection
-    mongocxx::client _conn{mongocxx::uri{ "mongodb://localhost:27017"}};
-    mongocxx::database _db = _conn["agdb"];
-    mongocxx::collection _tasks = _db["tasks"];
-    mongocxx::collection _box = _db["box"];
-    int priority;
-
-    // Create the document (Stream Builder is not appropriate because the construction is broken up)
-    bsoncxx::builder::basic::document builder{};
-
-    // Every task gets these fields
-    builder.append(bsoncxx::builder::basic::kvp("clientid", clientid));
-    builder.append(bsoncxx::builder::basic::kvp("scanid", scanid));
-    builder.append(bsoncxx::builder::basic::kvp("hdf5filename", hdf5file));
-    builder.append(bsoncxx::builder::basic::kvp("cameraid", serialnumber));
-    builder.append(bsoncxx::builder::basic::kvp("session_name", session_name));
-    builder.append(bsoncxx::builder::basic::kvp("cluster_detection", 0));
-
-    // If calibration. . .
-    if (T_CALIBRATION-- > 0) {
-        priority = 0;
-    } else {
-        // Get highest priority and increment by one
-        auto order = bsoncxx::builder::stream::document{} << "priority" << -1 << bsoncxx::builder::stream::finalize;
-        auto opts = mongocxx::options::find{};
-        opts.sort(order.view());
-        bsoncxx::stdx::optional<bsoncxx::document::value> val = _tasks.find_one({}, opts);
-
-        if (val) {
-            priority = json::parse(bsoncxx::to_json(*val))["priority"];
-            ++priority;
-        } else {
-            // Special case (first task in the database)
-            priority = 1;
-        }
+    QualityLevel level = quality.Level();
+    HOT_LOG(Warning, "[%s] Quality level %s (load %.2f)", serialnumber.c_str(),
+            QualityController::Name(level), quality.Load());
 
-        // Non-calibration tasks also receive these fields
-        builder.append(bsoncxx::builder::basic::kvp("preprocess", 0));
-        builder.append(bsoncxx::builder::basic::kvp("trunk_detection", 0));
-        builder.append(bsoncxx::builder::basic::kvp("process", 0));
-        builder.append(bsoncxx::builder::basic::kvp("shape_analysis_per_archive", 0));
+    FlightEvent step = FlightEvent();
+    step.type = EVENT_QUALITY;
+    step.start = now;
+    step.frame = -1;
+    step.value = level;
+    flight.Record(step);
+}
 
-    }
+/**
+ * ConfigureOutput
+ *
+ * The "output" block of config/daemon.json. Call before recording starts.
+ */
+void AgriDataCamera::ConfigureOutput(const json &config) {
+    output_root = config.value("root", output_root);
+    layout.Configure(config);
+    hdf5.Configure(config);
+}
+
+/**
+ * ConfigureQuality
+ *
+ * The "quality" block of config/daemon.json. Call before recording starts.
+ */
+void AgriDataCamera::ConfigureQuality(const json &config) {
+    quality.Configure(config);
+}
+
+/**
+ * RecordDrop
+ *
+ * Frames that never made it through HandleFrame, for the flight recorder
+ */
+void AgriDataCamera::RecordDrop(int64_t when, int64_t frame, int64_t count) {
+    FlightEvent drop = FlightEvent();
+    drop.type = EVENT_DROP;
+    drop.start = when;
+    drop.frame = frame;
+    drop.value = count;
+    drop.queue_depth = records.Size();
+    flight.Record(drop);
+}
 
-    // Set the priority
-    builder.append(bsoncxx::builder::basic::kvp("priority", priority));
+/**
+ * ConfigureFlightRecorder
+ *
+ * The "flight_recorder" block of config/daemon.json. Call before recording starts.
+ */
+void AgriDataCamera::ConfigureFlightRecorder(const json &config) {
+    flight.Resize(config.value("events", 4096));
+    flight_drop_threshold = config.value("drop_threshold", 5);
+    flight_min_interval_ns = (int64_t) (config.value("min_interval_s", 60.0) * 1e9);
+
+    json deadlines = config.value("deadline_ms", json::object());
+    for (int s = 0; s < STAGE_COUNT; ++s) {
+        flight_deadline_ns[s] = (int64_t) (deadlines.value(StageLatency::Name((LatencyStage) s), 0.0) * 1e6);
+    }
+}
 
-    // Close and insert the document
-    bsoncxx::document::value document = builder.extract();
-    auto ret = _tasks.insert_one(document.view());
+/**
+ * TriggerFlightDump
+ *
+ * Automatic dumps (drops, deadlines) are limited to one per min_interval_s, so a
+ * camera that is struggling does not also fill the disk with dumps
+ */
+void AgriDataCamera::TriggerFlightDump(const string &reason) {
+    int64_t now = LatencyHistogram::Now();
+    int64_t last = last_flight_dump;
+    if (last != 0 && now - last < flight_min_interval_ns) {
+        return;
+    }
+    if (last_flight_dump.compare_exchange_strong(last, now)) {
+        LOG(WARNING) << "[" << serialnumber << "] Dumping flight recorder (" << reason << ")";
+        DumpFlightRecorder(reason);
+    }
 }
 
+/**
+ * DumpFlightRecorder
+ *
+ * Copies the ring and writes it out on a scheduler worker. Returns the file name, or
+ * an empty string if the memory budget or the scheduler refused the dump.
+ */
+string AgriDataCamera::DumpFlightRecorder(const string &reason) {
+    string directory = output_root + "flight/";
+    string filename = directory + "flight_" + serialnumber + "_"
+            + AGDUtils::grabTime("%Y-%m-%d_%H-%M-%S") + "_" + reason + ".bin";
+
+    size_t bytes = flight.Capacity() * sizeof (FlightEvent);
+    if (!MemoryBudget::Acquire(POOL_JOBS, bytes)) {
+        LOG(WARNING) << "[" << serialnumber << "] No memory for a flight recorder dump (" << reason << ")";
+        return "";
+    }
 
-float AgriDataCamera::_luminance(cv::Mat input) {
-    cv::Mat grayMat;
-    cv::cvtColor(input, grayMat, CV_BGR2GRAY);
-
-    // Summation of intensity
-    int Totalintensity = 0;
-    for (int i = 0; i < grayMat.rows; ++i) {
-        for (int j = 0; j < grayMat.cols; ++j) {
-            Totalintensity += (int) grayMat.at<uchar>(i, j);
+    vector<FlightEvent> events = flight.Snapshot();
+    string serial = serialnumber;
+    bool posted = Scheduler::Post([directory, filename, serial, reason, events, bytes]() {
+        AGDUtils::mkdirp(directory.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+        if (!FlightRecorder::Write(filename, serial, reason, events)) {
+            LOG(ERROR) << "Could not write " << filename;
         }
+        MemoryBudget::Release(POOL_JOBS, bytes);
+    });
+    if (!posted) {
+        MemoryBudget::Release(POOL_JOBS, bytes);
+        return "";
+    }
+    return filename;
+}
+
+/**
+ * RecordSensorToDisk
+ *
+ * Returns the time from the start of exposure to on_disk. The camera timestamps the
+ * start of exposure on its own clock. The offset to the host
+ * clock is taken as the smallest (arrival - exposure) seen so far, i.e. the fastest
+ * frame defines zero transport delay, and is allowed to creep up by CLOCK_SLACK_NS per
+ * frame to follow drift between the two clocks. A jump of more than a second means the
+ * camera clock was reset and the offset is learned again.
+ */
+int64_t AgriDataCamera::RecordSensorToDisk(const FramePacket &fp, int64_t on_disk) {
+    static const int64_t CLOCK_SLACK_NS = 5000;
+    static const int64_t CLOCK_RESET_NS = 1000000000;
+
+    int64_t ticks = fp.chunks.valid ? fp.chunks.timestamp : (int64_t) fp.img_ptr->GetTimeStamp();
+    int64_t exposure = (int64_t) (ticks * ns_per_tick);
+    int64_t offset = fp.arrival - exposure;
+
+    if (!has_clock_offset || offset > clock_offset + CLOCK_RESET_NS) {
+        clock_offset = offset;
+        has_clock_offset = true;
+    } else {
+        clock_offset = min(offset, clock_offset + CLOCK_SLACK_NS);
     }
 
-    // Find avg lum of frame
-    return Totalintensity / (grayMat.rows * grayMat.cols);
+    int64_t total = on_disk - (exposure + clock_offset);
+    latency.Record(STAGE_TOTAL, total);
+    return total;
 }
 
 /**
- * Luminance
+ * FileTask
  *
- * Add luminance to an existing db entry (i.e. during scanning) l
+ * The task of an HDF5 file of this recording (also written into the file, for
+ * OutputRecovery)
+ */
+TaskRecord AgriDataCamera::FileTask(const string &hdf5file) {
+    TaskRecord task;
+    task.clientid = clientid;
+    task.scanid = scanid;
+    task.hdf5filename = hdf5file;
+    task.cameraid = serialnumber;
+    task.session_name = session_name;
+    task.calibration = false;
+    return task;
+}
+
+/**
+ * AddTask
  *
+ * Hands the task entry for an HDF5 file to the TaskRegistry, which inserts it in the
+ * background
  */
-void AgriDataCamera::Luminance(bsoncxx::oid id, cv::Mat input) {
-    // As per http://mongodb.github.io/mongo-cxx-driver/mongocxx-v3/thread-safety/
-    // "don't even bother sharing clients. Just give each thread its own"
-    mongocxx::client _conn{mongocxx::uri
-        { MONGODB_HOST}};
-    mongocxx::database _db = _conn["agdb"];
-    mongocxx::collection _frames = _db["frame"];
 
-    float avgLum = _luminance(input);
+void AgriDataCamera::AddTask(string hdf5file) {
+    TaskRecord task = FileTask(hdf5file);
+
+    // Calibration tasks get priority 0
+    task.calibration = T_CALIBRATION-- > 0;
 
-    // Update database entry
+    TaskRegistry::Add(task);
+}
+
+
+float AgriDataCamera::_luminance(cv::Mat input) {
+    return AGDUtils::luminance(input);
+}
+
+/**
+ * SampleLuminance
+ *
+ * Frame document of a luminance sample: computes the luminance and journals (or
+ * inserts) the document with it, on a scheduler worker
+ */
+void AgriDataCamera::SampleLuminance(FrameRecord record, cv::Mat input) {
+    helper_threads++;
+    bsoncxx::builder::basic::document doc{};
+    AppendFrame(doc, record, RecordFile(record.file));
+    doc.append(bsoncxx::builder::basic::kvp("luminance", _luminance(input)));
+
+    if (MetadataJournal::Append(JOURNAL_FRAME, doc.view())) {
+        helper_threads--;
+        return;
+    }
     try {
-        _frames.update_one(bsoncxx::builder::stream::document{}
-        << "_id" << id << bsoncxx::builder::stream::finalize,
-                bsoncxx::builder::stream::document{}
-        << "$set" << bsoncxx::builder::stream::open_document <<
-                "luminance" << avgLum << bsoncxx::builder::stream::close_document << bsoncxx::builder::stream::finalize);
+        mongocxx::client _conn{mongocxx::uri{ MONGODB_HOST}};
+        mongocxx::collection _frames = _conn["agdb"]["frame"];
+        _frames.insert_one(doc.view());
     } catch (exception const &exc) {
         LOG(DEBUG) << "Exception caught " << exc.what() << "\n";
     }
+    helper_threads--;
 }
 
 /**
@@ -539,9 +1076,9 @@ void AgriDataCamera::Snap() {
                 CV_8UC3, (uint8_t *) image.GetBuffer());
 
         snap_img.copyTo(last_img);
-        thread t(&AgriDataCamera::writeLatestImage, this, last_img,
-                ref(compression_params));
-        t.detach();
+        PostFrameJob(last_img, [this](Mat img) {
+            writeLatestImage(img, compression_params);
+        });
     }
 }
 
@@ -549,12 +1086,15 @@ void AgriDataCamera::Snap() {
  * writeLatestImage
  *
  * If we would like the occasional streaming image to be produced, it can be done here.
- * This is intended to run in a separate thread so as not to block. Compression_params
+ * This is intended to run on a scheduler worker so as not to block. Compression_params
  * is an OpenCV construct to define the level of compression.
  */
 void AgriDataCamera::writeLatestImage(Mat img, vector<int> compression_params) {
+    helper_threads++;
+
+    // 30% of the full frame, whatever size img is
     Mat thumb;
-    resize(img, thumb, Size(), 0.3, 0.3);
+    resize(img, thumb, Size(width * 0.3, height * 0.3));
 
     // Thumbnail
     imwrite(
@@ -566,105 +1106,223 @@ void AgriDataCamera::writeLatestImage(Mat img, vector<int> compression_params) {
             "/home/nvidia/EmbeddedServer/images/" + serialnumber + '_'
             + "streaming.jpg", img, compression_params);
     */
+    helper_threads--;
 
 }
 
+/**
+ * Pause
+ *
+ * Stops or resumes writing frames; Run() waits while paused
+ */
+void AgriDataCamera::Pause(bool paused) {
+    lock_guard<mutex> lock(run_mutex);
+    isPaused = paused;
+    run_changed.notify_all();
+}
+
 /**
  * Stop
  *
- * Upon receiving a stop message, set the isRecording flag
+ * Upon receiving a stop message, set the isRecording flag and wait for Run() to
+ * finish its last frame
  */
 int AgriDataCamera::Stop() {
 
     LOG(INFO) << "Recording Stopped";
     isRecording = false;
+    {
+        unique_lock<mutex> lock(run_mutex);
+        run_changed.notify_all();
+        run_changed.wait(lock, [this]() {
+            return !running;
+        });
+    }
 
     LOG(INFO) << "Dumping documents";
-    frames.insert_many(documents);
-    documents.clear();
-
-    AddTask(current_hdf5_file);
+    FlushDocuments();
 
     LOG(INFO) << "Closing active HDF5 file";
-    H5Fclose(hdf5_out);
+    hdf5.Close();
+
+    if (!current_hdf5_file.empty()) {
+        AddTask(current_hdf5_file);
+    }
 
     LOG(INFO) << "*** Done ***";
     return 0;
 }
 
+/**
+ * GetMetrics
+ *
+ * Live per-stage latency (p50 / p99 / max). Cheap enough to poll; unlike GetStatus it
+ * touches neither the camera nor the database.
+ */
+json AgriDataCamera::GetMetrics() {
+    json metrics;
+    metrics["Serial Number"] = serialnumber;
+    metrics["Recording"] = isRecording.load();
+    metrics["Latency"] = latency.Summary();
+    metrics["Frames"] = {
+        {"grabbed", frames_grabbed.load()},
+        {"failed", frames_failed.load()},
+        {"skipped", frames_skipped.load()},
+        {"slipped", frames_slipped.load()},
+        {"decimated", frames_decimated.load()}
+    };
+    metrics["Quality"] = QualityController::Name(quality.Level());
+    return metrics;
+}
+
+/**
+ * BandwidthDemand
+ *
+ * What this camera needs from its network interface. Only GigE cameras share a link
+ * (USB cameras return false).
+ */
+bool AgriDataCamera::BandwidthDemand(StreamDemand &demand) {
+    if (GetDeviceInfo().GetDeviceClass() != BaslerGigEDeviceClass) {
+        return false;
+    }
+
+    INodeMap &nodeMap = GetNodeMap();
+    String_t interface;
+    GetDeviceInfo().GetPropertyValue("Interface", interface);
+
+    demand.serialnumber = serialnumber;
+    demand.interface = interface.c_str();
+    demand.payload_size = CIntegerPtr(nodeMap.GetNode("PayloadSize"))->GetValue();
+    demand.fps = nodes->ResultingFrameRate();
+    demand.max_packet_size = CIntegerPtr(nodeMap.GetNode("GevSCPSPacketSize"))->GetValue();
+    demand.tick_frequency = nodes->TimestampTickFrequency();
+    return true;
+}
+
+/**
+ * ApplyBandwidthPlan
+ *
+ * Must be called before grabbing starts (the packet size is locked while grabbing)
+ */
+void AgriDataCamera::ApplyBandwidthPlan(const StreamPlan &plan) {
+    INodeMap &nodeMap = GetNodeMap();
+
+    LOG(INFO) << "[" << serialnumber << "] Bandwidth plan on " << plan.interface
+            << ": " << plan.required_mbps << " Mbps required, "
+            << plan.predicted_mbps << " Mbps allotted";
+    if (plan.oversubscribed) {
+        LOG(WARNING) << "[" << serialnumber << "] Interface " << plan.interface
+                << " is oversubscribed, expect a lower frame rate";
+    }
+
+    SetInteger(nodeMap, "GevSCPSPacketSize", plan.packet_size);
+    SetInteger(nodeMap, "GevSCPD", plan.inter_packet_delay);
+    SetInteger(nodeMap, "GevSCFTD", plan.frame_transmission_delay);
+
+    bandwidth_plan = plan;
+    has_bandwidth_plan = true;
+}
+
 /**
  * GetStatus
  *
  * Respond to the heartbeat the data about the camera
  */
 json AgriDataCamera::GetStatus() {
-    json status;
-    INodeMap &nodeMap = GetNodeMap();
-
-    status["Serial Number"] = serialnumber;
-    status["Model Name"] = modelname;
-    status["Recording"] = isRecording;
+    StatusSample sample;
+    sample.time = AGDUtils::grabMilliseconds();
+    sample.serialnumber = serialnumber;
+    sample.modelname = modelname;
+    sample.recording = isRecording;
 
     // Something funny here, occasionally the ptrGrabResult is not available
     // even though the camera is grabbing?
     if (isRecording) {
-        status["Timestamp"] = last_timestamp;
-        status["scanid"] = scanid;
+        sample.timestamp = last_timestamp;
+        sample.scanid = scanid;
     } else {
-        status["Timestamp"] = 0;
-        status["scanid"] = "Not Recording";
+        sample.timestamp = 0;
+        sample.scanid = "Not Recording";
     }
 
     // Here is the main divergence between GigE and USB Cameras; the nodemap is not standard
-    try { // USB
-        status["Current Gain"] = (float) CFloatPtr(nodeMap.GetNode("Gain"))->GetValue();
-        status["Exposure Time"] = (float) CFloatPtr(nodeMap.GetNode("ExposureTime"))->GetValue();
-        status["Resulting Frame Rate"] = (float) CFloatPtr(nodeMap.GetNode("ResultingFrameRate"))->GetValue();
-        status["Temperature"] = (float) CFloatPtr(nodeMap.GetNode("DeviceTemperature"))->GetValue();
-        status["Target Brightness"] = (int) CFloatPtr(nodeMap.GetNode("AutoTargetBrightness"))->GetValue();
-    } catch (...) { // GigE
-        status["Current Gain"] = (int) CIntegerPtr(nodeMap.GetNode("GainRaw"))->GetValue(); // Gotcha!
-        status["Exposure Time"] = (float) CFloatPtr(nodeMap.GetNode("ExposureTimeAbs"))->GetValue();
-        status["Resulting Frame Rate"] = (float) CFloatPtr(nodeMap.GetNode("ResultingFrameRateAbs"))->GetValue();
-        status["Temperature"] = (float) CFloatPtr(nodeMap.GetNode("TemperatureAbs"))->GetValue();
-        status["Target Brightness"] = (int) CIntegerPtr(nodeMap.GetNode("AutoTargetValue"))->GetValue();
-    }
-
-    bsoncxx::document::value document = bsoncxx::builder::stream::document{}  << "Serial Number" << (string) status["Serial Number"].get<string>()
-            << "Model Name" << (string) status["Model Name"].get<string>()
-            << "Recording" << (bool) status["Recording"].get<bool>()
-            << "Timestamp" << (int64_t) status["Timestamp"].get<int64_t>()
-            << "scanid" << (string) status["scanid"].get<string>()
-            << "Exposure Time" << (int) status["Exposure Time"].get<int>()
-            << "Resulting Frame Rate" << (int) status["Resulting Frame Rate"].get<int>()
-            << "Current Gain" << (int) status["Current Gain"].get<int>()
-            << "Temperature" << (int) status["Temperature"].get<int>()
-            << "Target Brightness" << (int) status["Target Brightness"].get<int>()
-            << bsoncxx::builder::stream::finalize;
-
-    // Insert into the DB
-    auto ret = frames.insert_one(document.view());
-
-    // Lazily add luminance (bit of delay here, but checking luminance is done via DB by clients that want it)
+    // (see CameraFamily.h)
+    float gain = nodes->Gain();
+    float exposure_time = nodes->ExposureTime();
+    float fps = nodes->ResultingFrameRate();
+    float temperature = nodes->Temperature();
+
+    // The document stores whole numbers (see StatusSeries::ToDocument)
+    sample.gain = (int) gain;
+    sample.exposure_time = (int) exposure_time;
+    sample.fps = (int) fps;
+    sample.temperature = (int) temperature;
+    sample.target_brightness = (int) nodes->TargetBrightness();
+    sample.has_luminance = false;
+    sample.luminance = 0;
+
+    json status;
+    status["Serial Number"] = sample.serialnumber;
+    status["Model Name"] = sample.modelname;
+    status["Recording"] = sample.recording;
+    status["Timestamp"] = sample.timestamp;
+    status["scanid"] = sample.scanid;
+    status["Current Gain"] = gain;
+    status["Exposure Time"] = exposure_time;
+    status["Resulting Frame Rate"] = fps;
+    status["Temperature"] = temperature;
+    status["Target Brightness"] = sample.target_brightness;
+
+    // Into agdb.status, in the next batch (see StatusSeries.h). When not recording, with
+    // the luminance of a fresh image (clients that want it read it from the database).
+    bool posted = false;
     if (!isRecording) {
-        // Grab an image for luminance calculation (this will set last_image
-        // . . . so the call to Luminance doesn't need it as an argument
+        // Grab an image for luminance calculation (this will set last_img)
         AgriDataCamera::Snap();
 
-        // Add the luminance value
-        bsoncxx::oid oid = ret->inserted_id().get_oid().value;
-        thread t(&AgriDataCamera::Luminance, this, oid, last_img);
-        t.detach();
+        posted = PostFrameJob(last_img, [this, sample](Mat input) mutable {
+            helper_threads++;
+            sample.luminance = _luminance(input);
+            sample.has_luminance = true;
+            StatusSeries::Add(sample);
+            helper_threads--;
+        });
+    }
+    if (!posted) {
+        StatusSeries::Add(sample);
     }
 
-    // Extra bits
-    LOG(DEBUG) << "[" << serialnumber << "] Failed Buffer Count: " << GetStreamGrabberParams().Statistic_Failed_Buffer_Count();
-    LOG(DEBUG) << "[" << serialnumber << "] Socket Buffer Size: " << GetStreamGrabberParams().SocketBufferSize();
-    LOG(DEBUG) << "[" << serialnumber << "] Buffer Underrun Count: " << GetStreamGrabberParams().Statistic_Buffer_Underrun_Count();
-    LOG(DEBUG) << "[" << serialnumber << "] Failed Buffer Count: " << GetStreamGrabberParams().Statistic_Failed_Buffer_Count();
-    LOG(DEBUG) << "[" << serialnumber << "] Failed Packet Count: " << GetStreamGrabberParams().Statistic_Failed_Packet_Count();
-    LOG(DEBUG) << "[" << serialnumber << "] Total Buffer Count: " << GetStreamGrabberParams().Statistic_Total_Buffer_Count(); 
+    // Bandwidth plan vs. what the camera is actually sending
+    INodeMap &streamMap = GetStreamGrabberNodeMap();
+    if (has_bandwidth_plan) {
+        CIntegerPtr throughput(GetNodeMap().GetNode("GevSCDCT"));   // bytes per second
+        CIntegerPtr resends(streamMap.GetNode("Statistic_Resend_Packet_Count"));
 
+        status["Predicted Throughput"] = bandwidth_plan.predicted_mbps;
+        status["Observed Throughput"] = IsReadable(throughput) ? throughput->GetValue() * 8 / 1e6 : 0;
+        status["Resend Packets"] = IsReadable(resends) ? resends->GetValue() : 0;
+
+        LOG(DEBUG) << "[" << serialnumber << "] Throughput (Mbps): "
+                << status["Observed Throughput"] << " observed, "
+                << bandwidth_plan.predicted_mbps << " predicted";
+    }
+
+    // Where the time goes in HandleFrame, and what was lost
+    status["Latency"] = latency.Summary();
+    status["Frames Grabbed"] = frames_grabbed.load();
+    status["Frames Dropped"] = frames_failed + frames_skipped + frames_slipped;
+    status["Frames Decimated"] = frames_decimated.load();
+    status["Documents Dropped"] = documents_dropped.load();
+    status["Samples Skipped"] = samples_skipped.load();
+    status["Quality Level"] = QualityController::Name(quality.Level());
+
+    // Extra bits (the stream grabber statistics differ per transport)
+    for (const char * const * name = nodes->StreamStatistics(); *name != NULL; ++name) {
+        CIntegerPtr statistic(streamMap.GetNode(*name));
+        if (IsReadable(statistic)) {
+            LOG(DEBUG) << "[" << serialnumber << "] " << *name << ": " << statistic->GetValue();
+        }
+    }
 
     return status;
 }
@@ -7,14 +7,15 @@
 #define AGRIDATACAMERA_H
 
 // Standard
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
+#include <memory>
+#include <mutex>
 
 // Pylon
 #include <pylon/PylonIncludes.h>
 #include <pylon/InstantCamera.h>
-#include <pylon/gige/BaslerGigEInstantCamera.h>
-#include <pylon/gige/BaslerGigEInstantCameraArray.h>
-#include <pylon/gige/_BaslerGigECameraParams.h>
 
 // GenApi
 #include <GenApi/GenApi.h>
@@ -26,6 +27,18 @@
 // HDF5
 #include "H5Cpp.h"
 
+// AgriData
+#include "CameraFamily.h"
+#include "BandwidthPlanner.h"
+#include "LatencyHistogram.h"
+#include "FlightRecorder.h"
+#include "Scheduler.h"
+#include "QualityController.h"
+#include "MemoryBudget.h"
+#include "FrameRecords.h"
+#include "OutputLayout.h"
+#include "FrameFile.h"
+
 // Utilities
 #include "json.hpp"
 #include "zmq.hpp"
@@ -38,35 +51,105 @@
 #include <mongocxx/instance.hpp>
 
 
-class AgriDataCamera : public Pylon::CBaslerGigEInstantCamera
+class AgriDataCamera : public Pylon::CInstantCamera
 {
 public:
-    AgriDataCamera();
+    explicit AgriDataCamera(const std::string &mongodb_host = "mongodb://localhost:27017");
 
     void Initialize();
     void Run();
+    void Pause(bool paused);
     int Stop();
     void Snap();
     float _luminance(cv::Mat);
     nlohmann::json GetStatus();
+    nlohmann::json GetMetrics();
+    void ConfigureFlightRecorder(const nlohmann::json &config);
+    void ConfigureSchedule(const nlohmann::json &config);
+    void ConfigureQuality(const nlohmann::json &config);
+    void ConfigureMetadata(const nlohmann::json &config);
+    void ConfigureOutput(const nlohmann::json &config);
+    std::string DumpFlightRecorder(const std::string &reason);
+    bool BandwidthDemand(StreamDemand &demand);
+    void ApplyBandwidthPlan(const StreamPlan &plan);
 
     virtual ~AgriDataCamera();
 
     std::string scanid;
     std::string session_name;
-    bool isPaused;
-    bool isRecording;
+    std::atomic<bool> isPaused;         // set with Pause()
+    std::atomic<bool> isRecording;      // read by the metrics and status threads
     bool calibration;
     std::string serialnumber;
     std::string modelname;
 
+    // Recordings go to <output_root>/<clientid>/<scanid>/<serialnumber>/ (by default,
+    // see OutputLayout.h); "root" under "output" in config/daemon.json
+    std::string output_root = "/data/output/";
+
+    // Frame accounting for the current recording (read from other threads)
+    std::atomic<uint64_t> frames_grabbed;   // delivered to Run()
+    std::atomic<uint64_t> frames_failed;    // GrabSucceeded() was false
+    std::atomic<uint64_t> frames_skipped;   // gaps in the block id: lost before reaching us
+    std::atomic<uint64_t> frames_slipped;   // HandleFrame threw
+    std::atomic<uint64_t> frames_decimated; // not written on purpose (see QualityController.h)
+
+    // Live metrics, written by the recording threads and read by the MetricsServer
+    // without taking any lock
+    static const int MAX_STREAM_STATISTICS = 8;
+    std::atomic<float> fps;                         // over the last second
+    std::atomic<uint64_t> bytes_written;            // HDF5 payload
+    std::atomic<uint64_t> documents_pending;        // frame documents not yet in the database
+    std::atomic<uint64_t> documents_dropped;        // metadata ring full
+    std::atomic<uint64_t> samples_skipped;          // luminance samples the job pool refused
+    std::atomic<int> helper_threads;                // luminance / preview jobs in flight
+    std::atomic<const char * const *> stream_statistic_names;
+    std::atomic<int64_t> stream_statistics[MAX_STREAM_STATISTICS];
+
+    const StageLatency &Latency() const { return latency; }
+    const LatencyHistogram &MongoFlushLatency() const { return mongo_flush; }
+    QualityLevel Quality() const { return quality.Level(); }
+
 private:
     struct FramePacket {
         int64_t time_now;
+        int64_t arrival;            // host monotonic ns, when RetrieveResult returned
+        FlightEvent event;
         float exposure_time;
+        FrameChunks chunks;
         Pylon::CGrabResultPtr img_ptr;
     };
 
+    // Family-specific node handles (resolved once in Initialize)
+    std::unique_ptr<CameraNodes> nodes;
+    bool chunk_mode;
+
+    // GigE bandwidth plan (see BandwidthPlanner.h)
+    StreamPlan bandwidth_plan;
+    bool has_bandwidth_plan = false;
+
+    // Per-stage latency of the frame path, and the camera -> host clock offset used
+    // for the sensor-to-disk total
+    StageLatency latency;
+    LatencyHistogram mongo_flush;
+    double ns_per_tick = 1;
+    int64_t clock_offset = 0;
+    bool has_clock_offset = false;
+
+    // Degrades the frame path when it falls behind (see QualityController.h)
+    QualityController quality;
+
+    // Flight recorder (see FlightRecorder.h) and what makes it dump by itself
+    FlightRecorder flight;
+    uint64_t flight_drop_threshold = 5;             // drops in one second
+    int64_t flight_deadline_ns[STAGE_COUNT] = {};   // 0 = no deadline
+    int64_t flight_min_interval_ns = 60000000000LL;
+    std::atomic<int64_t> last_flight_dump;
+
+    // Last block id seen by Run(), for frames_skipped
+    uint64_t last_block_id = 0;
+    bool has_block_id = false;
+
     // Dimensions (change these to ALL CAPS?)
     int64_t width;
     int64_t height;
@@ -90,19 +173,29 @@ private:
     Pylon::CImageFormatConverter fc;
     Pylon::CImagePersistenceOptions persistenceOptions;
 
-    // Output base
+    // Output base (layout.Directory() of the current recording) and file names
     std::string save_prefix;
+    OutputLayout layout;
 
     // Image compression
     std::vector<int> compression_params;
 
-    // Timers
-    const int T_LATEST = 20;            // Every second
-    const int T_MONGODB = 60*20;        // Every minute
-    const int T_LUMINANCE = 10;         // Every half second
-    const int T_SAMPLE = 10;		// Every half second
+    // Background work while recording, on wall-clock periods in ms (see Scheduler.h).
+    // Preview and luminance need a frame: the timer raises the flag and the next
+    // frame hands a copy to a worker.
+    int64_t preview_period = 1000;
+    int64_t luminance_period = 500;
+    int64_t flush_period = 60000;
+    int64_t status_period = 1000;
+    std::vector<Scheduler::JobId> jobs;
+    std::atomic<bool> preview_due;
+    std::atomic<bool> luminance_due;
     int T_CALIBRATION = 0;              // First five minutes are calibration
-    int tick;                           // Running counter
+
+    // Previous status sample, for fps and the drop rate
+    int64_t status_time;
+    uint64_t status_frames;
+    uint64_t status_drops;
 
     // Output Parameters
     uint8_t max_filesize = 3;
@@ -110,15 +203,34 @@ private:
     std::string output_dir;
 
     // HDF5
-    hid_t hdf5_out, dataSetId, dataSpaceId, memSpaceId, vlDataTypeId, dataTypeId, pListId;
+    FrameFile hdf5;
+    hid_t dataSetId, dataSpaceId, memSpaceId, vlDataTypeId, dataTypeId, pListId;
     std::string current_hdf5_file;
 
     // MongoDB
-    std::string MONGODB_HOST = "mongodb://localhost:27017";
+    std::string MONGODB_HOST;
     mongocxx::client conn;
     mongocxx::database db;
     mongocxx::collection frames;
-    std::vector<bsoncxx::v_noabi::document::value> documents;
+
+    // Frame metadata waiting for the flush job (see FrameRecords.h)
+    FrameRecordRing records;
+    size_t records_batch = 1000;            // documents per insert_many
+    std::vector<std::string> record_files;  // HDF5 file names, by FrameRecord::file
+    uint32_t current_file = 0;
+    std::mutex record_files_mutex;
+    std::mutex flush_mutex;                 // one flush at a time
+    std::atomic<bool> flush_requested;      // by the frame path, when the ring fills up
+
+    // Whether Run() is still going, for Stop() to wait on; Run() also waits here
+    // while paused
+    std::mutex run_mutex;
+    std::condition_variable run_changed;
+    bool running = false;
+
+    // Charged to the memory budget for the length of a recording
+    size_t grab_bytes = 0;
+    size_t convert_bytes = 0;
 
     // Timestamp (should go in status block)
     int64_t last_timestamp;
@@ -131,10 +243,23 @@ private:
     std::string clientid;
 
     // Methods
-    void Luminance(bsoncxx::oid, cv::Mat);
+    void SampleLuminance(FrameRecord, cv::Mat);
+    void AppendFrame(bsoncxx::builder::basic::document &doc, const FrameRecord &record, const std::string &filename);
+    std::string RecordFile(uint32_t file);
+    void ScheduleJobs();
+    void CancelJobs();
+    void FlushDocuments();
+    bool PostFrameJob(const cv::Mat &frame, const std::function<void(cv::Mat)> &job);
+    void SampleStatus();
     void writeHeaders();
     void HandleFrame(AgriDataCamera::FramePacket);
+    int64_t RecordSensorToDisk(const FramePacket &fp, int64_t on_disk);
+    void RecordDrop(int64_t when, int64_t frame, int64_t count);
+    void TriggerFlightDump(const std::string &reason);
+    void UpdateQuality(int64_t now, int64_t busy);
+    void SampleStreamStatistics();
     void writeLatestImage(cv::Mat, std::vector<int>);
+    TaskRecord FileTask(const std::string &hdf5file);
     void AddTask(std::string);
 };
 
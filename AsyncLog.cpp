@@ -0,0 +1,277 @@
+/*
+ * File:   AsyncLog.cpp
+ * Author: agridata
+ */
+
+#include "AsyncLog.h"
+
+// AgriData
+#include "ThreadRoles.h"
+
+// Standard
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdarg.h>
+#include <stdio.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+    const size_t RING_SIZE = 256;           // records per thread
+    const size_t MESSAGE_SIZE = 240;
+    const int64_t WINDOW_NS = 1000000000;   // rate limit window
+    const uint32_t PER_WINDOW = 1;          // messages per statement per window
+    const size_t MAX_SITES = 64;            // statements with a rate limit of their own
+    const int DRAIN_MS = 100;
+
+    struct Record {
+        AsyncLog::Site * site;
+        char message[MESSAGE_SIZE];
+    };
+
+    // A statement's rate limit in one thread
+    struct Limit {
+        Limit() : window_start(0), in_window(0), suppressed(0), last_report(0) {}
+
+        // Owning thread only
+        int64_t window_start;
+        uint32_t in_window;
+
+        atomic<uint64_t> suppressed;
+
+        // Writer-only
+        string last_message;
+        int64_t last_report;
+    };
+
+    /**
+     * Ring
+     *
+     * Single producer (the owning thread), single consumer (the writer). head and
+     * tail only ever grow; the slot is the index modulo RING_SIZE.
+     */
+    struct Ring {
+        Ring() : head(0), tail(0), closed(false) {}
+
+        Record records[RING_SIZE];
+        atomic<size_t> head;
+        atomic<size_t> tail;
+        atomic<bool> closed;    // owning thread has exited
+
+        // By Site::index; statements past MAX_SITES share the last one
+        Limit limits[MAX_SITES];
+    };
+
+    // Registry (the hot path only takes this once per thread and once per statement)
+    mutex registry_mutex;
+    vector<shared_ptr<Ring> > rings;
+    vector<AsyncLog::Site *> sites;
+
+    // Writer
+    atomic<bool> running(false);
+    thread writer;
+    mutex wake_mutex;
+    condition_variable wake;
+    atomic<uint64_t> dropped(0);
+
+    // The calling thread's ring, marked closed when the thread exits so the writer can
+    // let go of it once it is drained
+    struct ThreadRing {
+        ~ThreadRing() {
+            if (ring) ring->closed = true;
+        }
+        shared_ptr<Ring> ring;
+    };
+    thread_local ThreadRing thread_ring;
+
+    // Coarse is plenty for a one second window and is a vDSO read
+    int64_t Now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    Ring &LocalRing() {
+        if (!thread_ring.ring) {
+            thread_ring.ring = make_shared<Ring>();
+            lock_guard<mutex> lock(registry_mutex);
+            rings.push_back(thread_ring.ring);
+        }
+        return *thread_ring.ring;
+    }
+
+    void Emit(el::Level level, const char * message) {
+        switch (level) {
+            case el::Level::Error: LOG(ERROR) << message; break;
+            case el::Level::Warning: LOG(WARNING) << message; break;
+            case el::Level::Debug: LOG(DEBUG) << message; break;
+            default: LOG(INFO) << message; break;
+        }
+    }
+
+    Limit &LimitOf(Ring &ring, const AsyncLog::Site &site) {
+        return ring.limits[min(site.index, MAX_SITES - 1)];
+    }
+
+    /**
+     * Drain
+     *
+     * Writes out every queued record, then one line per statement and thread that had
+     * messages suppressed (at most once per window, or right away when stopping or
+     * when the thread has exited)
+     */
+    void Drain(bool final) {
+        vector<shared_ptr<Ring> > snapshot;
+        vector<AsyncLog::Site *> statements;
+        {
+            lock_guard<mutex> lock(registry_mutex);
+            snapshot = rings;
+            statements = sites;
+        }
+
+        int64_t now = Now();
+        vector<Ring *> finished;
+        for (size_t r = 0; r < snapshot.size(); ++r) {
+            Ring &ring = *snapshot[r];
+            bool closed = ring.closed.load(memory_order_acquire);
+            size_t tail = ring.tail.load(memory_order_relaxed);
+            size_t head = ring.head.load(memory_order_acquire);
+            for (; tail != head; ++tail) {
+                Record &record = ring.records[tail % RING_SIZE];
+                LimitOf(ring, *record.site).last_message = record.message;
+                Emit(record.site->level, record.message);
+            }
+            ring.tail.store(tail, memory_order_release);
+
+            for (size_t s = 0; s < statements.size() && s < MAX_SITES; ++s) {
+                Limit &limit = ring.limits[s];
+                if (limit.suppressed == 0 || (!final && !closed && now - limit.last_report < WINDOW_NS)) {
+                    continue;
+                }
+
+                double seconds = limit.last_report ? (now - limit.last_report) / 1e9 : 1;
+                uint64_t count = limit.suppressed.exchange(0);
+                char message[MESSAGE_SIZE + 64];
+                snprintf(message, sizeof (message), "%s ×%llu in last %.0fs",
+                        limit.last_message.c_str(), (unsigned long long) count, seconds < 1 ? 1 : seconds);
+                Emit(statements[s]->level, message);
+                limit.last_report = now;
+            }
+
+            if (closed) {
+                finished.push_back(&ring);
+            }
+        }
+
+        lock_guard<mutex> lock(registry_mutex);
+        for (size_t r = 0; r < rings.size();) {
+            if (find(finished.begin(), finished.end(), rings[r].get()) != finished.end()) {
+                rings.erase(rings.begin() + r);
+            } else {
+                ++r;
+            }
+        }
+    }
+
+    void Run() {
+        ScopedThreadRole role(ROLE_WRITE);
+        while (running) {
+            {
+                unique_lock<mutex> lock(wake_mutex);
+                wake.wait_for(lock, chrono::milliseconds(DRAIN_MS));
+            }
+            Drain(false);
+        }
+        Drain(true);
+    }
+}
+
+namespace AsyncLog {
+
+    Site::Site(el::Level level) :
+    level(level),
+    index(0) {
+        lock_guard<mutex> lock(registry_mutex);
+        index = sites.size();
+        sites.push_back(this);
+    }
+
+    /**
+     * Start
+     *
+     * Starts the writer thread
+     */
+    void Start() {
+        if (running.exchange(true)) {
+            return;
+        }
+        writer = thread(Run);
+    }
+
+    /**
+     * Stop
+     *
+     * Drains everything still queued and stops the writer
+     */
+    void Stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    /**
+     * Write
+     *
+     * The rate limit is checked before anything is formatted, so a suppressed message
+     * costs a clock read and an atomic increment
+     */
+    void Write(Site &site, const char * format, ...) {
+        Ring &ring = LocalRing();
+        Limit &limit = LimitOf(ring, site);
+        int64_t now = Now();
+        if (now - limit.window_start >= WINDOW_NS) {
+            limit.window_start = now;
+            limit.in_window = 0;
+        }
+        if (limit.in_window++ >= PER_WINDOW) {
+            limit.suppressed.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+
+        va_list args;
+        va_start(args, format);
+
+        if (!running) {
+            char message[MESSAGE_SIZE];
+            vsnprintf(message, sizeof (message), format, args);
+            va_end(args);
+            Emit(site.level, message);
+            return;
+        }
+
+        size_t head = ring.head.load(memory_order_relaxed);
+        if (head - ring.tail.load(memory_order_acquire) >= RING_SIZE) {
+            va_end(args);
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+
+        Record &record = ring.records[head % RING_SIZE];
+        record.site = &site;
+        vsnprintf(record.message, MESSAGE_SIZE, format, args);
+        va_end(args);
+        ring.head.store(head + 1, memory_order_release);
+    }
+
+    uint64_t Dropped() {
+        return dropped.load(memory_order_relaxed);
+    }
+}
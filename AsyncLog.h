@@ -0,0 +1,60 @@
+/*
+ * File:   AsyncLog.h
+ * Author: agridata
+ *
+ * Logging for the frame path. LOG(...) takes easylogging's global lock (we build
+ * with ELPP_THREAD_SAFE) and writes to the file and stdout before returning, which a
+ * grab thread cannot afford. HOT_LOG formats into a slot of a ring owned by the
+ * calling thread and returns; a background writer drains the rings into easylogging.
+ *
+ * Each HOT_LOG statement is also rate-limited in each thread (so one camera's grab
+ * thread cannot silence another's): the first message from a statement in any one
+ * second goes through, the rest are counted and reported by the writer as
+ * "Frame slipped! x143 in last 1s".
+ *
+ *   HOT_LOG(Warning, "Frame slipped!");
+ *   HOT_LOG(Info, "Error: %u %s", code, description);
+ *
+ * Before Start() (and after Stop()) HOT_LOG writes synchronously.
+ */
+
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+// Standard
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+// Logging
+#include "easylogging++.h"
+
+namespace AsyncLog {
+
+    /**
+     * Site
+     *
+     * One per HOT_LOG statement (a function-local static), registered with the writer
+     * on first use. Its rate limit is kept by each thread's ring, under index.
+     */
+    struct Site {
+        explicit Site(el::Level level);
+
+        el::Level level;
+        size_t index;
+    };
+
+    void Start();
+    void Stop();
+    void Write(Site &site, const char * format, ...) __attribute__((format(printf, 2, 3)));
+
+    // Records lost because a thread's ring was full
+    uint64_t Dropped();
+}
+
+#define HOT_LOG(LEVEL, ...) do { \
+        static AsyncLog::Site hot_log_site_(el::Level::LEVEL); \
+        AsyncLog::Write(hot_log_site_, __VA_ARGS__); \
+    } while (0)
+
+#endif /* ASYNCLOG_H */
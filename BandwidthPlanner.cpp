@@ -0,0 +1,94 @@
+/*
+ * File:   BandwidthPlanner.cpp
+ * Author: agridata
+ */
+
+#include "BandwidthPlanner.h"
+
+#include <algorithm>
+#include <map>
+#include <cmath>
+#include <stdint.h>
+
+using namespace std;
+
+const int64_t BandwidthPlanner::ETHERNET_OVERHEAD;
+const int64_t BandwidthPlanner::PACKET_HEADERS;
+
+/**
+ * Constructor
+ *
+ * link_mbps is the line rate of each interface, budget the fraction of it we are
+ * willing to fill with image data
+ */
+BandwidthPlanner::BandwidthPlanner(double link_mbps, double budget) :
+link_mbps(link_mbps),
+budget(budget) {
+}
+
+/**
+ * Plan
+ *
+ * Returns one plan per demand, in the same order
+ */
+vector<StreamPlan> BandwidthPlanner::Plan(const vector<StreamDemand> &demands) const {
+    vector<StreamPlan> plans(demands.size());
+    map<string, vector<size_t> > interfaces;
+
+    // Wire bandwidth needed by each camera at its largest packet size
+    for (size_t i = 0; i < demands.size(); ++i) {
+        const StreamDemand &d = demands[i];
+        StreamPlan &p = plans[i];
+
+        p.serialnumber = d.serialnumber;
+        p.interface = d.interface;
+        p.packet_size = d.max_packet_size;
+
+        int64_t packets = (d.payload_size + (p.packet_size - PACKET_HEADERS) - 1)
+                / (p.packet_size - PACKET_HEADERS);
+        p.required_mbps = d.fps * packets * (p.packet_size + ETHERNET_OVERHEAD) * 8 / 1e6;
+
+        interfaces[d.interface].push_back(i);
+    }
+
+    // Share each interface's budget in proportion to demand
+    for (map<string, vector<size_t> >::const_iterator it = interfaces.begin(); it != interfaces.end(); ++it) {
+        const vector<size_t> &members = it->second;
+        double available = link_mbps * budget;
+        double required = 0;
+        for (size_t k = 0; k < members.size(); ++k) {
+            required += plans[members[k]].required_mbps;
+        }
+
+        double scale = (required > 0) ? available / required : 1;
+        double burst_offset = 0;    // seconds
+
+        for (size_t k = 0; k < members.size(); ++k) {
+            const StreamDemand &d = demands[members[k]];
+            StreamPlan &p = plans[members[k]];
+
+            // A camera never sends faster than it needs to, whatever its share
+            p.predicted_mbps = min(p.required_mbps, p.required_mbps * scale);
+            p.oversubscribed = (required > available);
+
+            // Time between packet starts at our share, less the time the packet itself
+            // takes on the wire, is the gap we have to leave (none for a camera that
+            // sends nothing, at 0 fps)
+            double packet_bits = (p.packet_size + ETHERNET_OVERHEAD) * 8.;
+            double wire_time = packet_bits / (link_mbps * 1e6);
+            p.inter_packet_delay = 0;
+            if (p.predicted_mbps > 0) {
+                double spacing = packet_bits / (p.predicted_mbps * 1e6);
+                double ticks = floor((spacing - wire_time) * d.tick_frequency);
+                p.inter_packet_delay = (int64_t) max(0., min(ticks, (double) INT32_MAX));   // GevSCPD is 32 bits
+            }
+
+            // Stagger frame starts by the line-rate burst of the cameras before us
+            p.frame_transmission_delay = (int64_t) floor(burst_offset * d.tick_frequency);
+            double frame_packets = ceil((double) d.payload_size / (p.packet_size - PACKET_HEADERS));
+            burst_offset += frame_packets * wire_time;
+        }
+    }
+
+    return plans;
+}
@@ -0,0 +1,68 @@
+/*
+ * File:   BandwidthPlanner.h
+ * Author: agridata
+ *
+ * Plans packet size, inter-packet delay (GevSCPD) and frame transmission delay
+ * (GevSCFTD) for every GigE camera sharing a network interface. Each interface has a
+ * bandwidth budget (a fraction of the link); each camera is given a share of it in
+ * proportion to what it needs (frame size x frame rate), and the inter-packet delay
+ * stretches its packets out to exactly that share. Cameras on the same interface are
+ * also staggered by the time the cameras before them take to send a frame at line
+ * rate, so that simultaneous frame starts do not collide at the switch.
+ */
+
+#ifndef BANDWIDTHPLANNER_H
+#define BANDWIDTHPLANNER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * StreamDemand
+ *
+ * What one camera needs to send
+ */
+struct StreamDemand {
+    std::string serialnumber;
+    std::string interface;          // host NIC the camera is reached through
+    int64_t payload_size;           // bytes per frame (PayloadSize)
+    double fps;                     // frames per second (ResultingFrameRateAbs)
+    int64_t max_packet_size;        // largest usable GevSCPSPacketSize
+    int64_t tick_frequency;         // GevTimestampTickFrequency (ticks per second)
+};
+
+/**
+ * StreamPlan
+ *
+ * The settings for one camera, and the throughput they are expected to produce
+ */
+struct StreamPlan {
+    std::string serialnumber;
+    std::string interface;
+    int64_t packet_size;                // bytes, GevSCPSPacketSize
+    int64_t inter_packet_delay;         // ticks, GevSCPD
+    int64_t frame_transmission_delay;   // ticks, GevSCFTD
+    double required_mbps;               // what the camera needs on the wire
+    double predicted_mbps;              // what it is allowed to send at
+    bool oversubscribed;                // the interface cannot carry every camera at full rate
+};
+
+class BandwidthPlanner {
+public:
+    explicit BandwidthPlanner(double link_mbps = 1000., double budget = 0.9);
+
+    std::vector<StreamPlan> Plan(const std::vector<StreamDemand> &demands) const;
+
+    // Wire overhead per GVSP packet: Ethernet header + FCS (18), preamble and
+    // inter-frame gap (20); IP (20), UDP (8) and GVSP (8) headers come out of the
+    // packet size itself
+    static const int64_t ETHERNET_OVERHEAD = 38;
+    static const int64_t PACKET_HEADERS = 36;
+
+private:
+    double link_mbps;
+    double budget;
+};
+
+#endif /* BANDWIDTHPLANNER_H */
@@ -0,0 +1,93 @@
+/*
+ * File:   BsonFields.h
+ * Author: agridata
+ *
+ * Typed reads of fields straight out of a bsoncxx::document::view, instead of
+ * to_json and json::parse of the whole document. Each takes a fallback for a field
+ * that is missing or of another type; numbers are read whether the server stored
+ * them as int32, int64 or double (the shell writes doubles).
+ *
+ *   clientid = BsonFields::String(box->view(), "clientid", "unknown");
+ *   int64_t priority = BsonFields::Int64(task->view(), "priority");
+ */
+
+#ifndef BSONFIELDS_H
+#define BSONFIELDS_H
+
+// Standard
+#include <string>
+#include <stdint.h>
+
+// MongoDB
+#include <bsoncxx/document/element.hpp>
+#include <bsoncxx/document/view.hpp>
+#include <bsoncxx/types.hpp>
+
+namespace BsonFields {
+
+    // False (and value untouched) unless the element is a number
+    inline bool Number(const bsoncxx::document::element &element, double &value) {
+        if (!element) {
+            return false;
+        }
+        switch (element.type()) {
+            case bsoncxx::type::k_int32:
+                value = element.get_int32().value;
+                return true;
+            case bsoncxx::type::k_int64:
+                value = element.get_int64().value;
+                return true;
+            case bsoncxx::type::k_double:
+                value = element.get_double().value;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    inline int64_t Int64(const bsoncxx::document::element &element, int64_t fallback = 0) {
+        if (element && element.type() == bsoncxx::type::k_int64) {
+            return element.get_int64().value;
+        }
+        double value;
+        return Number(element, value) ? (int64_t) value : fallback;
+    }
+
+    inline int64_t Int64(bsoncxx::document::view doc, bsoncxx::stdx::string_view key, int64_t fallback = 0) {
+        return Int64(doc[key], fallback);
+    }
+
+    inline double Double(bsoncxx::document::view doc, bsoncxx::stdx::string_view key, double fallback = 0) {
+        double value;
+        return Number(doc[key], value) ? value : fallback;
+    }
+
+    inline bool Bool(bsoncxx::document::view doc, bsoncxx::stdx::string_view key, bool fallback = false) {
+        bsoncxx::document::element element = doc[key];
+        return element && element.type() == bsoncxx::type::k_bool ? element.get_bool().value : fallback;
+    }
+
+    inline std::string String(bsoncxx::document::view doc, bsoncxx::stdx::string_view key,
+            const std::string &fallback = std::string()) {
+        bsoncxx::document::element element = doc[key];
+        if (!element || element.type() != bsoncxx::type::k_utf8) {
+            return fallback;
+        }
+        bsoncxx::stdx::string_view value = element.get_utf8().value;
+        return std::string(value.data(), value.size());
+    }
+
+    // ms since 1970
+    inline int64_t DateMs(bsoncxx::document::view doc, bsoncxx::stdx::string_view key, int64_t fallback = 0) {
+        bsoncxx::document::element element = doc[key];
+        return element && element.type() == bsoncxx::type::k_date ? element.get_date().value.count() : fallback;
+    }
+
+    // Empty if missing or not a document
+    inline bsoncxx::document::view Document(bsoncxx::document::view doc, bsoncxx::stdx::string_view key) {
+        bsoncxx::document::element element = doc[key];
+        return element && element.type() == bsoncxx::type::k_document ? element.get_document().value : bsoncxx::document::view();
+    }
+}
+
+#endif /* BSONFIELDS_H */
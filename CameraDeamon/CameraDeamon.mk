@@ -59,7 +59,7 @@ AS       := /usr/bin/aarch64-linux-gnu-as
 ##
 ## User defined environment variables
 ##
-Objects0=$(IntermediateDirectory)/CameraDeamon_main.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_AgriDataCamera.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_AGDUtils.cpp$(ObjectSuffix) $(IntermediateDirectory)/lib_easylogging++.cc$(ObjectSuffix)
+Objects0=$(IntermediateDirectory)/CameraDeamon_main.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_AgriDataCamera.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_AGDUtils.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_CameraFamily.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_TransportTuning.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_BandwidthPlanner.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_ThreadRoles.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_MetricsServer.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_AsyncLog.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_FlightRecorder.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_Scheduler.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_QualityController.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_MemoryBudget.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_TaskRegistry.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_DatabaseIndexes.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_StatusSeries.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_MetadataJournal.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_OutputLayout.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_FrameFile.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_OutputRecovery.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_FrameNotifier.cpp$(ObjectSuffix) $(IntermediateDirectory)/CameraDeamon_TaskBroker.cpp$(ObjectSuffix) $(IntermediateDirectory)/lib_easylogging++.cc$(ObjectSuffix)
 
 
 
@@ -114,6 +114,158 @@ $(IntermediateDirectory)/CameraDeamon_AGDUtils.cpp$(DependSuffix): ../AGDUtils.c
 $(IntermediateDirectory)/CameraDeamon_AGDUtils.cpp$(PreprocessSuffix): ../AGDUtils.cpp
 	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_AGDUtils.cpp$(PreprocessSuffix) "../AGDUtils.cpp"
 
+$(IntermediateDirectory)/CameraDeamon_CameraFamily.cpp$(ObjectSuffix): ../CameraFamily.cpp $(IntermediateDirectory)/CameraDeamon_CameraFamily.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/CameraFamily.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_CameraFamily.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_CameraFamily.cpp$(DependSuffix): ../CameraFamily.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_CameraFamily.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_CameraFamily.cpp$(DependSuffix) -MM "../CameraFamily.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_CameraFamily.cpp$(PreprocessSuffix): ../CameraFamily.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_CameraFamily.cpp$(PreprocessSuffix) "../CameraFamily.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_TransportTuning.cpp$(ObjectSuffix): ../TransportTuning.cpp $(IntermediateDirectory)/CameraDeamon_TransportTuning.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/TransportTuning.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_TransportTuning.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_TransportTuning.cpp$(DependSuffix): ../TransportTuning.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_TransportTuning.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_TransportTuning.cpp$(DependSuffix) -MM "../TransportTuning.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_TransportTuning.cpp$(PreprocessSuffix): ../TransportTuning.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_TransportTuning.cpp$(PreprocessSuffix) "../TransportTuning.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_BandwidthPlanner.cpp$(ObjectSuffix): ../BandwidthPlanner.cpp $(IntermediateDirectory)/CameraDeamon_BandwidthPlanner.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/BandwidthPlanner.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_BandwidthPlanner.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_BandwidthPlanner.cpp$(DependSuffix): ../BandwidthPlanner.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_BandwidthPlanner.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_BandwidthPlanner.cpp$(DependSuffix) -MM "../BandwidthPlanner.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_BandwidthPlanner.cpp$(PreprocessSuffix): ../BandwidthPlanner.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_BandwidthPlanner.cpp$(PreprocessSuffix) "../BandwidthPlanner.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_ThreadRoles.cpp$(ObjectSuffix): ../ThreadRoles.cpp $(IntermediateDirectory)/CameraDeamon_ThreadRoles.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/ThreadRoles.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_ThreadRoles.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_ThreadRoles.cpp$(DependSuffix): ../ThreadRoles.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_ThreadRoles.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_ThreadRoles.cpp$(DependSuffix) -MM "../ThreadRoles.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_ThreadRoles.cpp$(PreprocessSuffix): ../ThreadRoles.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_ThreadRoles.cpp$(PreprocessSuffix) "../ThreadRoles.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_MetricsServer.cpp$(ObjectSuffix): ../MetricsServer.cpp $(IntermediateDirectory)/CameraDeamon_MetricsServer.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/MetricsServer.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_MetricsServer.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_MetricsServer.cpp$(DependSuffix): ../MetricsServer.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_MetricsServer.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_MetricsServer.cpp$(DependSuffix) -MM "../MetricsServer.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_MetricsServer.cpp$(PreprocessSuffix): ../MetricsServer.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_MetricsServer.cpp$(PreprocessSuffix) "../MetricsServer.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_AsyncLog.cpp$(ObjectSuffix): ../AsyncLog.cpp $(IntermediateDirectory)/CameraDeamon_AsyncLog.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/AsyncLog.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_AsyncLog.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_AsyncLog.cpp$(DependSuffix): ../AsyncLog.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_AsyncLog.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_AsyncLog.cpp$(DependSuffix) -MM "../AsyncLog.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_AsyncLog.cpp$(PreprocessSuffix): ../AsyncLog.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_AsyncLog.cpp$(PreprocessSuffix) "../AsyncLog.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_FlightRecorder.cpp$(ObjectSuffix): ../FlightRecorder.cpp $(IntermediateDirectory)/CameraDeamon_FlightRecorder.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/FlightRecorder.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_FlightRecorder.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_FlightRecorder.cpp$(DependSuffix): ../FlightRecorder.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_FlightRecorder.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_FlightRecorder.cpp$(DependSuffix) -MM "../FlightRecorder.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_FlightRecorder.cpp$(PreprocessSuffix): ../FlightRecorder.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_FlightRecorder.cpp$(PreprocessSuffix) "../FlightRecorder.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_Scheduler.cpp$(ObjectSuffix): ../Scheduler.cpp $(IntermediateDirectory)/CameraDeamon_Scheduler.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/Scheduler.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_Scheduler.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_Scheduler.cpp$(DependSuffix): ../Scheduler.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_Scheduler.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_Scheduler.cpp$(DependSuffix) -MM "../Scheduler.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_Scheduler.cpp$(PreprocessSuffix): ../Scheduler.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_Scheduler.cpp$(PreprocessSuffix) "../Scheduler.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_QualityController.cpp$(ObjectSuffix): ../QualityController.cpp $(IntermediateDirectory)/CameraDeamon_QualityController.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/QualityController.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_QualityController.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_QualityController.cpp$(DependSuffix): ../QualityController.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_QualityController.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_QualityController.cpp$(DependSuffix) -MM "../QualityController.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_QualityController.cpp$(PreprocessSuffix): ../QualityController.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_QualityController.cpp$(PreprocessSuffix) "../QualityController.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_MemoryBudget.cpp$(ObjectSuffix): ../MemoryBudget.cpp $(IntermediateDirectory)/CameraDeamon_MemoryBudget.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/MemoryBudget.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_MemoryBudget.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_MemoryBudget.cpp$(DependSuffix): ../MemoryBudget.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_MemoryBudget.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_MemoryBudget.cpp$(DependSuffix) -MM "../MemoryBudget.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_MemoryBudget.cpp$(PreprocessSuffix): ../MemoryBudget.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_MemoryBudget.cpp$(PreprocessSuffix) "../MemoryBudget.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_TaskRegistry.cpp$(ObjectSuffix): ../TaskRegistry.cpp $(IntermediateDirectory)/CameraDeamon_TaskRegistry.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/TaskRegistry.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_TaskRegistry.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_TaskRegistry.cpp$(DependSuffix): ../TaskRegistry.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_TaskRegistry.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_TaskRegistry.cpp$(DependSuffix) -MM "../TaskRegistry.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_TaskRegistry.cpp$(PreprocessSuffix): ../TaskRegistry.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_TaskRegistry.cpp$(PreprocessSuffix) "../TaskRegistry.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_DatabaseIndexes.cpp$(ObjectSuffix): ../DatabaseIndexes.cpp $(IntermediateDirectory)/CameraDeamon_DatabaseIndexes.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/DatabaseIndexes.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_DatabaseIndexes.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_DatabaseIndexes.cpp$(DependSuffix): ../DatabaseIndexes.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_DatabaseIndexes.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_DatabaseIndexes.cpp$(DependSuffix) -MM "../DatabaseIndexes.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_DatabaseIndexes.cpp$(PreprocessSuffix): ../DatabaseIndexes.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_DatabaseIndexes.cpp$(PreprocessSuffix) "../DatabaseIndexes.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_StatusSeries.cpp$(ObjectSuffix): ../StatusSeries.cpp $(IntermediateDirectory)/CameraDeamon_StatusSeries.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/StatusSeries.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_StatusSeries.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_StatusSeries.cpp$(DependSuffix): ../StatusSeries.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_StatusSeries.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_StatusSeries.cpp$(DependSuffix) -MM "../StatusSeries.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_StatusSeries.cpp$(PreprocessSuffix): ../StatusSeries.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_StatusSeries.cpp$(PreprocessSuffix) "../StatusSeries.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_MetadataJournal.cpp$(ObjectSuffix): ../MetadataJournal.cpp $(IntermediateDirectory)/CameraDeamon_MetadataJournal.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/MetadataJournal.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_MetadataJournal.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_MetadataJournal.cpp$(DependSuffix): ../MetadataJournal.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_MetadataJournal.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_MetadataJournal.cpp$(DependSuffix) -MM "../MetadataJournal.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_MetadataJournal.cpp$(PreprocessSuffix): ../MetadataJournal.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_MetadataJournal.cpp$(PreprocessSuffix) "../MetadataJournal.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_OutputLayout.cpp$(ObjectSuffix): ../OutputLayout.cpp $(IntermediateDirectory)/CameraDeamon_OutputLayout.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/OutputLayout.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_OutputLayout.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_OutputLayout.cpp$(DependSuffix): ../OutputLayout.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_OutputLayout.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_OutputLayout.cpp$(DependSuffix) -MM "../OutputLayout.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_OutputLayout.cpp$(PreprocessSuffix): ../OutputLayout.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_OutputLayout.cpp$(PreprocessSuffix) "../OutputLayout.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_FrameFile.cpp$(ObjectSuffix): ../FrameFile.cpp $(IntermediateDirectory)/CameraDeamon_FrameFile.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/FrameFile.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_FrameFile.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_FrameFile.cpp$(DependSuffix): ../FrameFile.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_FrameFile.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_FrameFile.cpp$(DependSuffix) -MM "../FrameFile.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_FrameFile.cpp$(PreprocessSuffix): ../FrameFile.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_FrameFile.cpp$(PreprocessSuffix) "../FrameFile.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_OutputRecovery.cpp$(ObjectSuffix): ../OutputRecovery.cpp $(IntermediateDirectory)/CameraDeamon_OutputRecovery.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/OutputRecovery.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_OutputRecovery.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_OutputRecovery.cpp$(DependSuffix): ../OutputRecovery.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_OutputRecovery.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_OutputRecovery.cpp$(DependSuffix) -MM "../OutputRecovery.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_OutputRecovery.cpp$(PreprocessSuffix): ../OutputRecovery.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_OutputRecovery.cpp$(PreprocessSuffix) "../OutputRecovery.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_FrameNotifier.cpp$(ObjectSuffix): ../FrameNotifier.cpp $(IntermediateDirectory)/CameraDeamon_FrameNotifier.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/FrameNotifier.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_FrameNotifier.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_FrameNotifier.cpp$(DependSuffix): ../FrameNotifier.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_FrameNotifier.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_FrameNotifier.cpp$(DependSuffix) -MM "../FrameNotifier.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_FrameNotifier.cpp$(PreprocessSuffix): ../FrameNotifier.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_FrameNotifier.cpp$(PreprocessSuffix) "../FrameNotifier.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_TaskBroker.cpp$(ObjectSuffix): ../TaskBroker.cpp $(IntermediateDirectory)/CameraDeamon_TaskBroker.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/TaskBroker.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/CameraDeamon_TaskBroker.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/CameraDeamon_TaskBroker.cpp$(DependSuffix): ../TaskBroker.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/CameraDeamon_TaskBroker.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/CameraDeamon_TaskBroker.cpp$(DependSuffix) -MM "../TaskBroker.cpp"
+
+$(IntermediateDirectory)/CameraDeamon_TaskBroker.cpp$(PreprocessSuffix): ../TaskBroker.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/CameraDeamon_TaskBroker.cpp$(PreprocessSuffix) "../TaskBroker.cpp"
+
 $(IntermediateDirectory)/lib_easylogging++.cc$(ObjectSuffix): ../lib/easylogging++.cc $(IntermediateDirectory)/lib_easylogging++.cc$(DependSuffix)
 	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/nvidia/CameraDeamon/lib/easylogging++.cc" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/lib_easylogging++.cc$(ObjectSuffix) $(IncludePath)
 $(IntermediateDirectory)/lib_easylogging++.cc$(DependSuffix): ../lib/easylogging++.cc
@@ -0,0 +1,37 @@
+/*
+ * File:   CameraFamily.cpp
+ * Author: agridata
+ */
+
+#include "CameraFamily.h"
+
+// Pylon
+#include <pylon/PylonIncludes.h>
+
+// GenApi
+#include <GenApi/GenApi.h>
+
+using namespace Pylon;
+using namespace GenApi;
+
+/**
+ * CreateCameraNodes
+ *
+ * This is the only place the family is probed. Ownership passes to the caller.
+ */
+CameraNodes * CreateCameraNodes(const CDeviceInfo &info, INodeMap &nodeMap) {
+    String_t deviceClass = info.GetDeviceClass();
+
+    if (deviceClass == BaslerUsbDeviceClass) {
+        return new FamilyNodes<UsbFamily>(nodeMap);
+    }
+    if (deviceClass == BaslerGigEDeviceClass) {
+        return new FamilyNodes<GigEFamily>(nodeMap);
+    }
+
+    // Unknown transport, look for the USB (SFNC 2.0) exposure node
+    if (IsAvailable(nodeMap.GetNode(UsbFamily::ExposureTime()))) {
+        return new FamilyNodes<UsbFamily>(nodeMap);
+    }
+    return new FamilyNodes<GigEFamily>(nodeMap);
+}
@@ -0,0 +1,286 @@
+/*
+ * File:   CameraFamily.h
+ * Author: agridata
+ *
+ * The nodemap is not standard between USB and GigE cameras: the same quantity lives
+ * under a different name and, sometimes, a different type (GainRaw is an integer,
+ * Gain is a float). Rather than trying one name and catching the exception for the
+ * other every time a value is needed, the family is decided once when the camera is
+ * opened and the node handles are resolved up front.
+ */
+
+#ifndef CAMERAFAMILY_H
+#define CAMERAFAMILY_H
+
+// Standard
+#include <string>
+#include <stdint.h>
+
+// Pylon
+#include <pylon/PylonIncludes.h>
+
+// GenApi
+#include <GenApi/GenApi.h>
+
+// AgriData
+#include "TransportTuning.h"
+
+/**
+ * UsbFamily
+ *
+ * Node names and types for USB3 Vision cameras (acA1920-155uc, acA1300-200uc)
+ */
+struct UsbFamily {
+    typedef GenApi::CFloatPtr GainNode;
+    typedef GenApi::CFloatPtr TargetNode;
+
+    static const char * Name() { return "USB"; }
+
+    typedef UsbTransport Transport;
+    static const char * const * StreamStatistics() { return UsbStreamStatistics(); }
+
+    static const char * SerialNumber() { return "DeviceSerialNumber"; }
+    static const char * ExposureTime() { return "ExposureTime"; }
+    static const char * Gain() { return "Gain"; }
+    static const char * ResultingFrameRate() { return "ResultingFrameRate"; }
+    static const char * Temperature() { return "DeviceTemperature"; }
+    static const char * TargetBrightness() { return "AutoTargetBrightness"; }
+
+    // USB3 Vision timestamps are always in nanoseconds
+    static int64_t TickFrequency(GenApi::INodeMap &) { return 1000000000; }
+
+    // Chunk data (see ChunkModeActive in the .pfs)
+    typedef GenApi::CFloatPtr ChunkGainNode;
+    static const char * ChunkTimestamp() { return "ChunkTimestamp"; }
+    static const char * ChunkExposureTime() { return "ChunkExposureTime"; }
+    static const char * ChunkGain() { return "ChunkGain"; }
+    static const char * ChunkFrameCounter() { return "ChunkCounterValue"; }
+    static const char * ChunkLineStatus() { return "ChunkLineStatusAll"; }
+};
+
+/**
+ * GigEFamily
+ *
+ * Node names and types for GigE Vision cameras (acA1920-40gc)
+ */
+struct GigEFamily {
+    typedef GenApi::CIntegerPtr GainNode;       // Gotcha!
+    typedef GenApi::CIntegerPtr TargetNode;
+
+    static const char * Name() { return "GigE"; }
+
+    typedef GigETransport Transport;
+    static const char * const * StreamStatistics() { return GigEStreamStatistics(); }
+
+    static const char * SerialNumber() { return "DeviceID"; }
+    static const char * ExposureTime() { return "ExposureTimeAbs"; }
+    static const char * Gain() { return "GainRaw"; }
+    static const char * ResultingFrameRate() { return "ResultingFrameRateAbs"; }
+    static const char * Temperature() { return "TemperatureAbs"; }
+    static const char * TargetBrightness() { return "AutoTargetValue"; }
+
+    // GigE timestamps count ticks of a camera-specific clock (125 MHz on the ace)
+    static int64_t TickFrequency(GenApi::INodeMap &nodeMap) {
+        GenApi::CIntegerPtr node(nodeMap.GetNode("GevTimestampTickFrequency"));
+        return GenApi::IsReadable(node) ? node->GetValue() : 125000000;
+    }
+
+    // Chunk data (see ChunkModeActive in the .pfs)
+    typedef GenApi::CIntegerPtr ChunkGainNode;
+    static const char * ChunkTimestamp() { return "ChunkTimestamp"; }
+    static const char * ChunkExposureTime() { return "ChunkExposureTime"; }
+    static const char * ChunkGain() { return "ChunkGainAll"; }
+    static const char * ChunkFrameCounter() { return "ChunkFramecounter"; }
+    static const char * ChunkLineStatus() { return "ChunkLineStatusAll"; }
+};
+
+/**
+ * FrameChunks
+ *
+ * Per-frame metadata carried in the buffer itself. These are the values the frame was
+ * actually taken with, as opposed to whatever the nodemap says by the time we ask.
+ */
+struct FrameChunks {
+    bool valid;
+    int64_t timestamp;
+    float exposure_time;
+    float gain;
+    int64_t frame_counter;
+    int64_t line_status;
+};
+
+/**
+ * CameraNodes
+ *
+ * Family-independent view of the nodes read during recording and for status. The one
+ * virtual call replaces the string lookup and the try/catch.
+ */
+class CameraNodes {
+public:
+    virtual ~CameraNodes() {}
+
+    virtual const char * FamilyName() const = 0;
+    virtual void Tune(Pylon::CInstantCamera &camera) = 0;
+    virtual const char * const * StreamStatistics() const = 0;
+
+    virtual std::string SerialNumber() = 0;
+    virtual float ExposureTime() = 0;
+    virtual float Gain() = 0;
+    virtual float ResultingFrameRate() = 0;
+    virtual float Temperature() = 0;
+    virtual float TargetBrightness() = 0;
+    virtual int64_t TimestampTickFrequency() = 0;
+
+    // Chunk data
+    virtual bool ChunkModeActive() = 0;
+    virtual bool ReadChunks(const Pylon::CGrabResultPtr &result, FrameChunks &chunks) = 0;
+    virtual void ResetChunks() = 0;
+};
+
+/**
+ * FamilyNodes
+ *
+ * Resolves the nodes of one family against a nodemap. The handles stay valid for as
+ * long as the camera stays open, so build this after Open() and throw it away on
+ * Close(). Unreadable nodes read as 0 instead of throwing.
+ */
+template <class Family>
+class FamilyNodes : public CameraNodes {
+public:
+    explicit FamilyNodes(GenApi::INodeMap &nodeMap) :
+    serial_number(nodeMap.GetNode(Family::SerialNumber())),
+    exposure_time(nodeMap.GetNode(Family::ExposureTime())),
+    gain(nodeMap.GetNode(Family::Gain())),
+    resulting_frame_rate(nodeMap.GetNode(Family::ResultingFrameRate())),
+    temperature(nodeMap.GetNode(Family::Temperature())),
+    target_brightness(nodeMap.GetNode(Family::TargetBrightness())),
+    chunk_mode_active(nodeMap.GetNode("ChunkModeActive")),
+    tick_frequency(Family::TickFrequency(nodeMap)) {
+        ResetChunks();
+    }
+
+    const char * FamilyName() const { return Family::Name(); }
+
+    void Tune(Pylon::CInstantCamera &camera) {
+        TuneTransport(camera, typename Family::Transport());
+    }
+
+    const char * const * StreamStatistics() const { return Family::StreamStatistics(); }
+
+    std::string SerialNumber() {
+        return GenApi::IsReadable(serial_number) ?
+                std::string(serial_number->GetValue().c_str()) : std::string();
+    }
+
+    float ExposureTime() { return Read(exposure_time); }
+    float Gain() { return Read(gain); }
+    float ResultingFrameRate() { return Read(resulting_frame_rate); }
+    float Temperature() { return Read(temperature); }
+    float TargetBrightness() { return Read(target_brightness); }
+    int64_t TimestampTickFrequency() { return tick_frequency; }
+
+    bool ChunkModeActive() {
+        return GenApi::IsReadable(chunk_mode_active) && chunk_mode_active->GetValue();
+    }
+
+    /**
+     * ReadChunks
+     *
+     * The chunk nodemap belongs to the buffer, and buffers are recycled for as long as
+     * the camera is grabbing, so the chunk nodes are resolved the first time a buffer is
+     * seen and then looked up by nodemap address.
+     */
+    bool ReadChunks(const Pylon::CGrabResultPtr &result, FrameChunks &chunks) {
+        chunks.valid = result->IsChunkDataAvailable();
+        if (!chunks.valid) {
+            return false;
+        }
+
+        ChunkNodes &cn = Chunks(result->GetChunkDataNodeMap());
+        chunks.timestamp = ReadInteger(cn.timestamp);
+        chunks.exposure_time = Read(cn.exposure_time);
+        chunks.gain = Read(cn.gain);
+        chunks.frame_counter = ReadInteger(cn.frame_counter);
+        chunks.line_status = ReadInteger(cn.line_status);
+        return true;
+    }
+
+    /**
+     * ResetChunks
+     *
+     * Must be called whenever grabbing (re)starts, since the buffers (and their chunk
+     * nodemaps) from the last session are gone
+     */
+    void ResetChunks() {
+        for (size_t i = 0; i < MAX_CHUNK_BUFFERS; ++i) {
+            chunk_nodes[i] = ChunkNodes();
+        }
+        chunk_next = 0;
+    }
+
+private:
+    static const size_t MAX_CHUNK_BUFFERS = 64;
+
+    struct ChunkNodes {
+        ChunkNodes() : nodeMap(NULL) {}
+        GenApi::INodeMap * nodeMap;
+        GenApi::CIntegerPtr timestamp;
+        GenApi::CFloatPtr exposure_time;
+        typename Family::ChunkGainNode gain;
+        GenApi::CIntegerPtr frame_counter;
+        GenApi::CIntegerPtr line_status;
+    };
+
+    ChunkNodes &Chunks(GenApi::INodeMap &nodeMap) {
+        for (size_t i = 0; i < MAX_CHUNK_BUFFERS; ++i) {
+            if (chunk_nodes[i].nodeMap == &nodeMap) {
+                return chunk_nodes[i];
+            }
+        }
+
+        // First time we see this buffer (overwrites the oldest entry if full)
+        ChunkNodes &cn = chunk_nodes[chunk_next];
+        chunk_next = (chunk_next + 1) % MAX_CHUNK_BUFFERS;
+        cn.nodeMap = &nodeMap;
+        cn.timestamp = nodeMap.GetNode(Family::ChunkTimestamp());
+        cn.exposure_time = nodeMap.GetNode(Family::ChunkExposureTime());
+        cn.gain = nodeMap.GetNode(Family::ChunkGain());
+        cn.frame_counter = nodeMap.GetNode(Family::ChunkFrameCounter());
+        cn.line_status = nodeMap.GetNode(Family::ChunkLineStatus());
+        return cn;
+    }
+
+    static int64_t ReadInteger(GenApi::CIntegerPtr &node) {
+        return GenApi::IsReadable(node) ? node->GetValue() : 0;
+    }
+
+    static float Read(GenApi::CFloatPtr &node) {
+        return GenApi::IsReadable(node) ? (float) node->GetValue() : 0;
+    }
+
+    static float Read(GenApi::CIntegerPtr &node) {
+        return GenApi::IsReadable(node) ? (float) node->GetValue() : 0;
+    }
+
+    GenApi::CStringPtr serial_number;
+    GenApi::CFloatPtr exposure_time;
+    typename Family::GainNode gain;
+    GenApi::CFloatPtr resulting_frame_rate;
+    GenApi::CFloatPtr temperature;
+    typename Family::TargetNode target_brightness;
+    GenApi::CBooleanPtr chunk_mode_active;
+    int64_t tick_frequency;
+
+    ChunkNodes chunk_nodes[MAX_CHUNK_BUFFERS];
+    size_t chunk_next;
+};
+
+/**
+ * CreateCameraNodes
+ *
+ * Chooses the family from the device class (falling back to probing the nodemap
+ * once for anything unrecognized, e.g. the camera emulator)
+ */
+CameraNodes * CreateCameraNodes(const Pylon::CDeviceInfo &info, GenApi::INodeMap &nodeMap);
+
+#endif /* CAMERAFAMILY_H */
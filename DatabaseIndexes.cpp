@@ -0,0 +1,212 @@
+/*
+ * File:   DatabaseIndexes.cpp
+ * Author: agridata
+ */
+
+#include "DatabaseIndexes.h"
+
+// AgriData
+#include "BsonFields.h"
+
+// Standard
+#include <chrono>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// MongoDB
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/json.hpp>
+#include <bsoncxx/types.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/exception/exception.hpp>
+#include <mongocxx/options/index.hpp>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+    struct IndexSpec {
+        const char * collection;
+        const char * name;
+        vector<pair<string, int> > keys;
+        bool ttl;
+        json query;                 // what the index is for: filter, sort
+    };
+
+    // Status samples are kept this long (see StatusSeries.h)
+    int64_t status_ttl_s = 24 * 3600;
+
+    vector<IndexSpec> Required() {
+        return {
+            {"frame", "scanid_serialnumber_frame_number",
+                {{"scanid", 1}, {"serialnumber", 1}, {"frame_number", 1}}, false,
+                {{"filter", {{"scanid", ""}, {"serialnumber", ""}}}, {"sort", {{"frame_number", 1}}}}},
+            {"tasks", "priority",
+                {{"priority", -1}}, false,
+                {{"filter", json::object()}, {"sort", {{"priority", -1}}}}},
+            {"tasks", "scanid_cameraid_hdf5filename",
+                {{"scanid", 1}, {"cameraid", 1}, {"hdf5filename", 1}}, false,
+                {{"filter", {{"scanid", ""}, {"cameraid", ""}, {"hdf5filename", ""}}}}},
+            {"scan", "scanid",
+                {{"scanid", 1}}, false,
+                {{"filter", {{"scanid", ""}}}}},
+            {"status", "time_ttl",
+                {{"time", 1}}, true,
+                {{"filter", {{"time", {{"$lt", {{"$date", 0}}}}}}}}},
+            {"status_minute", "serialnumber_minute",
+                {{"serialnumber", 1}, {"minute", 1}}, false,
+                {{"filter", {{"serialnumber", ""}}}, {"sort", {{"minute", 1}}}}}
+        };
+    }
+
+    mutex report_mutex;
+    json last_report = json::array();
+
+    // Same fields, same order, same directions
+    bool SameKeys(bsoncxx::document::view key, const IndexSpec &spec) {
+        size_t i = 0;
+        for (const bsoncxx::document::element &field : key) {
+            double direction;
+            if (i >= spec.keys.size() || string(field.key()) != spec.keys[i].first
+                    || !BsonFields::Number(field, direction) || direction != spec.keys[i].second) {
+                return false;
+            }
+            ++i;
+        }
+        return i == spec.keys.size();
+    }
+
+    // Stages of the winning plan, outermost first, e.g. "LIMIT < SORT < COLLSCAN"
+    string Plan(bsoncxx::document::view stage) {
+        string plan = BsonFields::String(stage, "stage", "?");
+        bsoncxx::document::view input = BsonFields::Document(stage, "inputStage");
+        if (!input.empty()) {
+            plan += " < " + Plan(input);
+        }
+        return plan;
+    }
+
+    /**
+     * Cost
+     *
+     * How the index's query runs now, from explain with execution statistics
+     */
+    void Cost(mongocxx::database &db, const IndexSpec &spec, json &entry) {
+        json find = {
+            {"find", spec.collection},
+            {"filter", spec.query["filter"]},
+            {"limit", 1}
+        };
+        if (spec.query.count("sort")) {
+            find["sort"] = spec.query["sort"];
+        }
+        json command = {
+            {"explain", find},
+            {"verbosity", "executionStats"}
+        };
+
+        bsoncxx::document::value explained = db.run_command(bsoncxx::from_json(command.dump()));
+        entry["plan"] = Plan(BsonFields::Document(BsonFields::Document(explained.view(), "queryPlanner"), "winningPlan"));
+        bsoncxx::document::view stats = BsonFields::Document(explained.view(), "executionStats");
+        entry["docs_examined"] = BsonFields::Int64(stats, "totalDocsExamined");
+        entry["millis"] = BsonFields::Int64(stats, "executionTimeMillis");
+    }
+
+    json Check(mongocxx::database &db, const IndexSpec &spec, bool create) {
+        json entry = {
+            {"collection", spec.collection},
+            {"index", spec.name}
+        };
+
+        mongocxx::collection collection = db[spec.collection];
+        try {
+            for (const bsoncxx::document::view &index : collection.list_indexes()) {
+                bsoncxx::document::view key = BsonFields::Document(index, "key");
+                if (!key.empty() && SameKeys(key, spec)) {
+                    entry["state"] = "present";
+                    if (spec.ttl && BsonFields::Int64(index, "expireAfterSeconds", -1) != status_ttl_s) {
+                        LOG(WARNING) << "Index " << spec.collection << "." << spec.name
+                                << " does not expire documents after " << status_ttl_s << " s";
+                        entry["state"] = "present, other TTL";
+                    }
+                    return entry;
+                }
+            }
+        } catch (const mongocxx::exception &) {
+            // The collection does not exist yet
+        }
+
+        Cost(db, spec, entry);
+        LOG(WARNING) << "Missing index " << spec.collection << "." << spec.name << ": "
+                << entry["plan"].get<string>() << ", " << entry["docs_examined"] << " documents examined in "
+                << entry["millis"] << " ms";
+        entry["state"] = "missing";
+
+        if (create) {
+            bsoncxx::builder::basic::document keys{};
+            for (size_t i = 0; i < spec.keys.size(); ++i) {
+                keys.append(bsoncxx::builder::basic::kvp(spec.keys[i].first, spec.keys[i].second));
+            }
+            mongocxx::options::index options{};
+            options.name(spec.name);
+            if (spec.ttl) {
+                options.expire_after(chrono::seconds(status_ttl_s));
+            }
+            collection.create_index(keys.extract(), options);
+            LOG(INFO) << "Created index " << spec.collection << "." << spec.name;
+            entry["state"] = "created";
+        }
+        return entry;
+    }
+}
+
+namespace DatabaseIndexes {
+
+    json Provision(const string &mongodb_host, const json &config) {
+        bool create = config.value("create", true);
+        status_ttl_s = (int64_t) (config.value("status_ttl_h", status_ttl_s / 3600.0) * 3600);
+
+        json report = json::array();
+        try {
+            mongocxx::client conn{mongocxx::uri{mongodb_host}};
+            mongocxx::database db = conn["agdb"];
+
+            vector<IndexSpec> required = Required();
+            for (size_t i = 0; i < required.size(); ++i) {
+                try {
+                    report.push_back(Check(db, required[i], create));
+                } catch (const exception &e) {
+                    LOG(ERROR) << "Could not check index " << required[i].collection << "."
+                            << required[i].name << ": " << e.what();
+                    report.push_back({
+                        {"collection", required[i].collection},
+                        {"index", required[i].name},
+                        {"state", "error"},
+                        {"error", e.what()}
+                    });
+                }
+            }
+        } catch (const exception &e) {
+            LOG(ERROR) << "Could not check indexes: " << e.what();
+            report.push_back({
+                {"state", "error"},
+                {"error", e.what()}
+            });
+        }
+
+        lock_guard<mutex> lock(report_mutex);
+        last_report = report;
+        return report;
+    }
+
+    json Report() {
+        lock_guard<mutex> lock(report_mutex);
+        return last_report;
+    }
+}
@@ -0,0 +1,39 @@
+/*
+ * File:   DatabaseIndexes.h
+ * Author: agridata
+ *
+ * The indexes the daemon's writes and lookups rely on, declared in one place and
+ * checked at startup:
+ *
+ *   frame          scanid + serialnumber + frame_number  (a scan's frames, per camera, in order)
+ *   tasks          priority                              (highest priority, see TaskRegistry.h)
+ *   tasks          scanid + cameraid + hdf5filename      (task upserts)
+ *   scan           scanid                                (closing a scan on "stop")
+ *   status         time, TTL                             (status samples expire, see StatusSeries.h)
+ *   status_minute  serialnumber + minute                 (status rollups)
+ *
+ * An index that is missing is logged with what its query costs without it (the plan
+ * and documents examined, from explain), then created unless "create" is false under
+ * "indexes" in config/daemon.json. The outcome is in the status reply.
+ */
+
+#ifndef DATABASEINDEXES_H
+#define DATABASEINDEXES_H
+
+// Standard
+#include <string>
+
+// Utilities
+#include "json.hpp"
+
+namespace DatabaseIndexes {
+
+    // The "indexes" block of config/daemon.json. Never throws; an unreachable
+    // database is reported.
+    nlohmann::json Provision(const std::string &mongodb_host, const nlohmann::json &config);
+
+    // What the last Provision found
+    nlohmann::json Report();
+}
+
+#endif /* DATABASEINDEXES_H */
@@ -0,0 +1,85 @@
+/*
+ * File:   FlightRecorder.cpp
+ * Author: agridata
+ */
+
+#include "FlightRecorder.h"
+
+// Standard
+#include <chrono>
+#include <fstream>
+#include <string.h>
+
+using namespace std;
+
+/**
+ * Constructor
+ */
+FlightRecorder::FlightRecorder(size_t capacity) :
+events(capacity > 0 ? capacity : 1),
+head(0) {
+}
+
+void FlightRecorder::Resize(size_t capacity) {
+    events.assign(capacity > 0 ? capacity : 1, FlightEvent());
+    head = 0;
+}
+
+/**
+ * Snapshot
+ */
+vector<FlightEvent> FlightRecorder::Snapshot() const {
+    uint64_t h = head.load(memory_order_acquire);
+    uint64_t n = min<uint64_t>(h, events.size());
+
+    vector<FlightEvent> snapshot;
+    snapshot.reserve(n);
+    for (uint64_t i = h - n; i < h; ++i) {
+        snapshot.push_back(events[i % events.size()]);
+    }
+    return snapshot;
+}
+
+/**
+ * Write
+ */
+bool FlightRecorder::Write(const string &filename, const string &serialnumber,
+        const string &reason, const vector<FlightEvent> &events) {
+    FlightHeader header;
+    memset(&header, 0, sizeof (header));
+    strncpy(header.magic, "AGDFLT1", sizeof (header.magic));
+    header.event_size = sizeof (FlightEvent);
+    header.stage_count = STAGE_COUNT;
+    header.count = events.size();
+    header.wall_ms = chrono::duration_cast<chrono::milliseconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+    header.monotonic_ns = LatencyHistogram::Now();
+    strncpy(header.serialnumber, serialnumber.c_str(), sizeof (header.serialnumber) - 1);
+    strncpy(header.reason, reason.c_str(), sizeof (header.reason) - 1);
+
+    ofstream out(filename.c_str(), ios::binary);
+    out.write((const char *) &header, sizeof (header));
+    if (!events.empty()) {
+        out.write((const char *) &events[0], events.size() * sizeof (FlightEvent));
+    }
+    return out.good();
+}
+
+/**
+ * Read
+ */
+bool FlightRecorder::Read(const string &filename, FlightHeader &header, vector<FlightEvent> &events) {
+    ifstream in(filename.c_str(), ios::binary);
+    if (!in.read((char *) &header, sizeof (header))
+            || strncmp(header.magic, "AGDFLT1", sizeof (header.magic)) != 0
+            || header.event_size != sizeof (FlightEvent)
+            || header.stage_count != STAGE_COUNT) {
+        return false;
+    }
+
+    events.resize(header.count);
+    if (header.count > 0) {
+        in.read((char *) &events[0], header.count * sizeof (FlightEvent));
+    }
+    return (bool) in;
+}
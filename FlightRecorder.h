@@ -0,0 +1,101 @@
+/*
+ * File:   FlightRecorder.h
+ * Author: agridata
+ *
+ * A fixed-size ring of the last few thousand timing events of one camera: every frame
+ * (arrival, time per stage, documents pending), every HDF5 file rotation, database
+ * flush and dropped frame. Recording an event is a 64 byte copy into the ring. When
+ * something goes wrong (a burst of drops, a stage over its deadline, or the operator
+ * asks) the ring is written to a compact binary file, which src/flighttrace.cpp turns
+ * into a Chrome trace (chrome://tracing, Perfetto) to see what led up to it.
+ */
+
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+// Standard
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// AgriData
+#include "LatencyHistogram.h"
+
+enum FlightEventType {
+    EVENT_FRAME,            // one frame through HandleFrame
+    EVENT_ROTATION,         // new HDF5 file; stage_ns[0] is the time to close and create
+    EVENT_FLUSH,            // frame documents to the database; value is the count
+    EVENT_DROP,             // frame lost; value is the number of frames
+    EVENT_QUALITY           // quality level changed; value is the new QualityLevel
+};
+
+/**
+ * FlightEvent
+ *
+ * Fixed layout, written to disk as is
+ */
+struct FlightEvent {
+    int64_t start;                      // host monotonic ns
+    int64_t frame;                      // image number, -1 if none
+    int64_t value;
+    uint32_t type;                      // FlightEventType
+    uint32_t queue_depth;               // frame documents pending
+    uint32_t stage_ns[STAGE_COUNT];     // per stage (see LatencyStage), clamped to ~4 s
+};
+
+/**
+ * FlightHeader
+ *
+ * Start of a dump file, followed by `count` events, oldest first
+ */
+struct FlightHeader {
+    char magic[8];                      // "AGDFLT1"
+    uint32_t event_size;
+    uint32_t stage_count;
+    uint64_t count;
+    int64_t wall_ms;                    // when dumped, ms since 1970
+    int64_t monotonic_ns;               // when dumped, same clock as the events
+    char serialnumber[32];
+    char reason[32];
+};
+
+class FlightRecorder {
+public:
+    explicit FlightRecorder(size_t capacity = 4096);
+
+    /**
+     * Record
+     *
+     * From the grab thread, and the scheduler workers for database flushes; each
+     * writer claims its slot with one atomic add
+     */
+    void Record(const FlightEvent &event) {
+        uint64_t h = head.fetch_add(1, std::memory_order_acq_rel);
+        events[h % events.size()] = event;
+    }
+
+    static uint32_t Clamp(int64_t ns) {
+        return ns < 0 ? 0 : (ns > UINT32_MAX ? UINT32_MAX : (uint32_t) ns);
+    }
+
+    // Only while nothing is recording
+    void Resize(size_t capacity);
+
+    size_t Capacity() const {
+        return events.size();
+    }
+
+    // Oldest first. An event being overwritten while copying may be torn.
+    std::vector<FlightEvent> Snapshot() const;
+
+    static bool Write(const std::string &filename, const std::string &serialnumber,
+            const std::string &reason, const std::vector<FlightEvent> &events);
+    static bool Read(const std::string &filename, FlightHeader &header, std::vector<FlightEvent> &events);
+
+private:
+    std::vector<FlightEvent> events;
+    std::atomic<uint64_t> head;
+};
+
+#endif /* FLIGHTRECORDER_H */
@@ -0,0 +1,672 @@
+/*
+ * File:   FrameFile.cpp
+ * Author: agridata
+ */
+
+#include "FrameFile.h"
+
+// AgriData
+#include "AGDUtils.h"
+#include "FrameNotifier.h"
+#include "LatencyHistogram.h"
+#include "Scheduler.h"
+
+// Standard
+#include <algorithm>
+#include <stddef.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// HDF5
+#include "hdf5_hl.h"
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+    const char * FORMAT_NAMES[] = {"datasets", "chunked"};
+
+    // Rows of /index per chunk
+    const hsize_t INDEX_CHUNK = 1024;
+
+    // Chunk cache for reading /jpeg back in Check
+    const size_t CHECK_CACHE_BYTES = 4 << 20;
+
+    // Bytes of /jpeg copied at a time by Rewrite
+    const hsize_t COPY_BYTES = 8 << 20;
+
+    // HDF5 prints its error stack on every failure; files that do not open are
+    // expected in Check and Repair
+    struct QuietErrors {
+        H5E_auto2_t func;
+        void *data;
+
+        QuietErrors() {
+            H5Eget_auto2(H5E_DEFAULT, &func, &data);
+            H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+        }
+
+        ~QuietErrors() {
+            H5Eset_auto2(H5E_DEFAULT, func, data);
+        }
+    };
+
+    hid_t IndexType() {
+        hid_t type = H5Tcreate(H5T_COMPOUND, sizeof (FrameIndexEntry));
+        H5Tinsert(type, "frame", HOFFSET(FrameIndexEntry, frame), H5T_NATIVE_INT64);
+        H5Tinsert(type, "offset", HOFFSET(FrameIndexEntry, offset), H5T_NATIVE_UINT64);
+        H5Tinsert(type, "size", HOFFSET(FrameIndexEntry, size), H5T_NATIVE_UINT64);
+        return type;
+    }
+
+    // An empty dataset of rows of type that grows without bound
+    hid_t CreateExtensible(hid_t file, const char *name, hid_t type, hsize_t chunk) {
+        hsize_t zero = 0, unlimited = H5S_UNLIMITED;
+        hid_t space = H5Screate_simple(1, &zero, &unlimited);
+        hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+        H5Pset_chunk(dcpl, 1, &chunk);
+        hid_t dataset = H5Dcreate2(file, name, type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+        H5Pclose(dcpl);
+        H5Sclose(space);
+        return dataset;
+    }
+
+    hsize_t Extent(hid_t dataset) {
+        hsize_t extent = 0;
+        hid_t space = H5Dget_space(dataset);
+        H5Sget_simple_extent_dims(space, &extent, NULL);
+        H5Sclose(space);
+        return extent;
+    }
+
+    // count rows at start, from or to buffer
+    bool Rows(hid_t dataset, hid_t type, hsize_t start, hsize_t count, void *buffer, bool write) {
+        hid_t space = H5Dget_space(dataset);
+        hid_t memory = H5Screate_simple(1, &count, NULL);
+        bool ok = H5Sselect_hyperslab(space, H5S_SELECT_SET, &start, NULL, &count, NULL) >= 0
+                && (write ? H5Dwrite(dataset, type, memory, space, H5P_DEFAULT, buffer)
+                : H5Dread(dataset, type, memory, space, H5P_DEFAULT, buffer)) >= 0;
+        H5Sclose(memory);
+        H5Sclose(space);
+        return ok;
+    }
+
+    void SetString(hid_t file, const char *name, const string &value) {
+        H5LTset_attribute_string(file, "/", name, value.c_str());
+    }
+
+    void SetInt(hid_t file, const char *name, int value) {
+        H5LTset_attribute_int(file, "/", name, &value, 1);
+    }
+
+    string GetString(hid_t file, const char *name) {
+        hsize_t dims = 0;
+        H5T_class_t type_class;
+        size_t size = 0;
+        if (H5Aexists_by_name(file, "/", name, H5P_DEFAULT) <= 0
+                || H5LTget_attribute_info(file, "/", name, &dims, &type_class, &size) < 0
+                || type_class != H5T_STRING) {
+            return string();
+        }
+        vector<char> value(size + 1, '\0');
+        if (H5LTget_attribute_string(file, "/", name, &value[0]) < 0) {
+            return string();
+        }
+        return string(&value[0]);
+    }
+
+    int GetInt(hid_t file, const char *name, int fallback) {
+        int value = fallback;
+        if (H5Aexists_by_name(file, "/", name, H5P_DEFAULT) <= 0
+                || H5LTget_attribute_int(file, "/", name, &value) < 0) {
+            return fallback;
+        }
+        return value;
+    }
+
+    // A descriptor FlushLocked duplicated; the file itself may be closed by now
+    void SyncAndClose(int fd) {
+        if (fd >= 0) {
+            fdatasync(fd);
+            close(fd);
+        }
+    }
+
+    // Whether the bytes of a row look like a whole JPEG (SOI first, EOI last)
+    bool WholeJpeg(hid_t jpeg, const FrameIndexEntry &entry) {
+        uint8_t first[2], last[2];
+        return Rows(jpeg, H5T_NATIVE_UCHAR, entry.offset, 2, first, false)
+                && Rows(jpeg, H5T_NATIVE_UCHAR, entry.offset + entry.size - 2, 2, last, false)
+                && first[0] == 0xFF && first[1] == 0xD8 && last[0] == 0xFF && last[1] == 0xD9;
+    }
+}
+
+/**
+ * Constructor
+ *
+ * Defaults: the format files have always had, flushed and synced every 100 frames or
+ * second, whichever comes first; 1 MB chunks for chunked files, written in SWMR mode
+ */
+FrameFile::FrameFile() :
+format(FORMAT_DATASETS),
+flush_frames(100),
+flush_ns(1000000000),
+chunk_bytes(1 << 20),
+sync(true),
+swmr(true),
+open_format(FORMAT_DATASETS),
+open_swmr(false),
+file(-1),
+jpeg(-1),
+index(-1),
+index_type(-1),
+frames(0),
+bytes(0),
+indexed(0),
+unflushed(0),
+flush_posted(false),
+last_flush(0),
+last_frame(-1),
+last_indexed(-1),
+announced(0),
+unannounced_frame(-1),
+unannounced_time(0) {
+}
+
+FrameFile::~FrameFile() {
+    Close();
+}
+
+void FrameFile::Configure(const json &config) {
+    string name = config.value("format", string(Name(format)));
+    if (name == FORMAT_NAMES[FORMAT_DATASETS]) {
+        format = FORMAT_DATASETS;
+    } else if (name == FORMAT_NAMES[FORMAT_CHUNKED]) {
+        format = FORMAT_CHUNKED;
+    } else {
+        LOG(WARNING) << "Unknown HDF5 format \"" << name << "\", keeping " << Name(format);
+    }
+    flush_frames = max<uint64_t>(1, config.value("flush_frames", flush_frames));
+    flush_ns = (int64_t) (config.value("flush_ms", flush_ns / 1e6) * 1e6);
+    chunk_bytes = max<hsize_t>(4096, config.value("chunk_kb", chunk_bytes / 1024) * 1024);
+    sync = config.value("sync", sync);
+    swmr = config.value("swmr", swmr);
+#if !H5_VERSION_GE(1, 10, 0)
+    if (swmr && format == FORMAT_CHUNKED) {
+        LOG(WARNING) << "HDF5 " << H5_VERS_INFO << " has no SWMR mode, chunked files are written without it";
+    }
+#endif
+}
+
+bool FrameFile::Open(const string &path, const TaskRecord &task) {
+    lock_guard<std::mutex> lock(mutex);
+    CloseLocked();
+
+    open_format = format;
+    this->path = path;
+    this->task = task;
+    frames = 0;
+    bytes = 0;
+    indexed = 0;
+    unflushed = 0;
+    flush_posted = false;
+    last_flush = LatencyHistogram::Now();
+    last_frame = -1;
+    last_indexed = -1;
+    announced = 0;
+    unannounced_frame = -1;
+    unannounced_time = 0;
+    pending.clear();
+
+    // SWMR needs the latest file format
+#if H5_VERSION_GE(1, 10, 0)
+    open_swmr = swmr && open_format == FORMAT_CHUNKED;
+#else
+    open_swmr = false;
+#endif
+    hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+    if (open_swmr) {
+        H5Pset_libver_bounds(fapl, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+    }
+    file = H5Fcreate(path.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, fapl);
+    H5Pclose(fapl);
+    if (file < 0) {
+        return false;
+    }
+
+    SetString(file, "format", Name(open_format));
+    SetString(file, "clientid", task.clientid);
+    SetString(file, "scanid", task.scanid);
+    SetString(file, "cameraid", task.cameraid);
+    SetString(file, "session_name", task.session_name);
+    SetString(file, "hdf5filename", task.hdf5filename);
+    SetInt(file, "complete", 0);
+    SetInt(file, "swmr", open_swmr ? 1 : 0);
+
+    if (open_format == FORMAT_CHUNKED) {
+        index_type = IndexType();
+        jpeg = CreateExtensible(file, "jpeg", H5T_NATIVE_UCHAR, chunk_bytes);
+        index = CreateExtensible(file, "index", index_type, INDEX_CHUNK);
+        if (jpeg < 0 || index < 0) {
+            CloseLocked();
+            return false;
+        }
+    }
+
+    // Everything is in place; from here on only the datasets grow
+#if H5_VERSION_GE(1, 10, 0)
+    if (open_swmr && H5Fstart_swmr_write(file) < 0) {
+        open_swmr = false;
+    }
+#endif
+    return true;
+}
+
+bool FrameFile::Write(int64_t frame_number, int64_t captured, const uint8_t *data, size_t size) {
+    unique_lock<std::mutex> lock(mutex);
+    if (file < 0) {
+        return false;
+    }
+
+    bool ok;
+    if (open_format == FORMAT_DATASETS) {
+        hsize_t n = size;
+        ok = H5LTmake_dataset(file, to_string(frame_number).c_str(), 1, &n, H5T_NATIVE_UCHAR, data) >= 0;
+    } else {
+        hsize_t extent = bytes + size;
+        ok = H5Dset_extent(jpeg, &extent) >= 0
+                && Rows(jpeg, H5T_NATIVE_UCHAR, bytes, size, const_cast<uint8_t *> (data), true);
+        if (ok) {
+            FrameIndexEntry entry = {frame_number, bytes, size};
+            pending.push_back(entry);
+            bytes = extent;
+        }
+    }
+
+    if (ok) {
+        frames++;
+        last_frame = frame_number;
+        if (unannounced_frame < 0) {
+            unannounced_frame = frame_number;
+            unannounced_time = captured;
+        }
+    }
+    unflushed++;
+    if (flush_posted || !FlushWantedLocked()) {
+        return ok;
+    }
+
+    // Post runs the job right here once the scheduler is stopped, so not under the lock
+    flush_posted = true;
+    lock.unlock();
+    if (!Scheduler::Post([this]() { Flush(); })) {
+        lock.lock();
+        flush_posted = false;
+    }
+    return ok;
+}
+
+void FrameFile::Flush() {
+    int fd;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        flush_posted = false;
+        fd = FlushLocked();
+    }
+    SyncAndClose(fd);
+}
+
+void FrameFile::FlushDue() {
+    int fd = -1;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (unflushed > 0 && LatencyHistogram::Now() - last_flush >= flush_ns) {
+            fd = FlushLocked();
+        }
+    }
+    SyncAndClose(fd);
+}
+
+/**
+ * FlushCheckMs
+ *
+ * A quarter of flush_ms, so a due flush is at most that late
+ */
+int64_t FrameFile::FlushCheckMs() const {
+    return max<int64_t>(10, flush_ns / 4000000);
+}
+
+bool FrameFile::FlushWantedLocked() {
+    return unflushed >= flush_frames || LatencyHistogram::Now() - last_flush >= flush_ns;
+}
+
+/**
+ * FlushLocked
+ *
+ * Hands HDF5's buffers to the kernel. The fdatasync is left to the caller, after it
+ * lets go of the lock, so that the next Write does not wait for the disk: returns a
+ * duplicate of the file's descriptor to sync (and close), or -1.
+ */
+int FrameFile::FlushLocked() {
+    if (file < 0) {
+        return -1;
+    }
+
+    // Rows for the frames written since the last flush (kept for the next one if
+    // this fails)
+    bool more = false;
+    if (open_format == FORMAT_CHUNKED && !pending.empty()) {
+        hsize_t extent = indexed + pending.size();
+        if (H5Dset_extent(index, &extent) >= 0
+                && Rows(index, index_type, indexed, pending.size(), &pending[0], true)) {
+            indexed = extent;
+            last_indexed = pending.back().frame;
+            pending.clear();
+            more = true;
+        }
+    }
+
+    H5Fflush(file, H5F_SCOPE_LOCAL);
+    int fd = -1;
+    if (sync) {
+        void *handle = NULL;
+        if (H5Fget_vfd_handle(file, H5P_DEFAULT, &handle) >= 0 && handle != NULL) {
+            fd = dup(*(int *) handle);
+        }
+    }
+    unflushed = 0;
+    last_flush = LatencyHistogram::Now();
+
+    // Readers can only open SWMR files while they are written
+    if (open_swmr && more) {
+        Notify(false);
+    }
+    return fd;
+}
+
+void FrameFile::Close() {
+    lock_guard<std::mutex> lock(mutex);
+    CloseLocked();
+}
+
+void FrameFile::CloseLocked() {
+    if (file < 0) {
+        return;
+    }
+
+    // Close runs on the grab thread when the file rotates; a worker syncs it
+    int fd = FlushLocked();
+    if (fd >= 0 && !Scheduler::Post([fd]() { SyncAndClose(fd); })) {
+        SyncAndClose(fd);
+    }
+    if (!open_swmr) {
+        SetInt(file, "complete", 1);
+    }
+
+    if (jpeg >= 0) {
+        H5Dclose(jpeg);
+    }
+    if (index >= 0) {
+        H5Dclose(index);
+    }
+    if (index_type >= 0) {
+        H5Tclose(index_type);
+    }
+    H5Fclose(file);
+    file = jpeg = index = index_type = -1;
+
+    Notify(true);
+}
+
+void FrameFile::Notify(bool closed) {
+    FileProgress progress;
+    progress.file = path;
+    progress.hdf5filename = task.hdf5filename;
+    progress.scanid = task.scanid;
+    progress.cameraid = task.cameraid;
+    progress.frames = open_format == FORMAT_CHUNKED ? indexed : frames;
+    progress.last_frame = open_format == FORMAT_CHUNKED ? last_indexed : last_frame;
+    progress.from = announced;
+    progress.first_frame = unannounced_frame;
+    progress.captured = unannounced_time;
+    progress.committed = AGDUtils::grabMilliseconds();
+    progress.closed = closed;
+    FrameNotifier::Available(progress);
+
+    announced = progress.frames;
+    unannounced_frame = -1;
+}
+
+/**
+ * ReadTask
+ *
+ * For OutputRecovery, which has to tell every file's task apart before it checks any
+ */
+bool FrameFile::ReadTask(const string &path, TaskRecord &task) {
+    QuietErrors quiet;
+    hid_t file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+#if H5_VERSION_GE(1, 10, 0)
+    if (file < 0) {
+        file = H5Fopen(path.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT);
+    }
+#endif
+    if (file < 0) {
+        return false;
+    }
+    task.clientid = GetString(file, "clientid");
+    task.scanid = GetString(file, "scanid");
+    task.cameraid = GetString(file, "cameraid");
+    task.session_name = GetString(file, "session_name");
+    task.hdf5filename = GetString(file, "hdf5filename");
+    task.calibration = false;
+    H5Fclose(file);
+    return !task.hdf5filename.empty();
+}
+
+/**
+ * Check
+ *
+ * Opens path read-only and counts the frames that can be read back. A chunked file
+ * that was not closed has its index checked row by row: each row must start where
+ * the last one ended, lie within /jpeg and hold a whole JPEG. The first row that
+ * does not is where the file stopped being consistent.
+ */
+FrameFileCheck FrameFile::Check(const string &path) {
+    FrameFileCheck check = FrameFileCheck();
+    check.format = FORMAT_DATASETS;
+    check.task.calibration = false;
+
+    QuietErrors quiet;
+    hid_t file = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+#if H5_VERSION_GE(1, 10, 0)
+    // Still marked as being written in SWMR mode: only SWMR readers get in
+    if (file < 0) {
+        file = H5Fopen(path.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT);
+        check.swmr = file >= 0;
+    }
+#endif
+    if (file < 0) {
+        return check;
+    }
+    check.opened = true;
+    check.complete = GetInt(file, "complete", 0) == 1 || (GetInt(file, "swmr", 0) == 1 && !check.swmr);
+    check.task.clientid = GetString(file, "clientid");
+    check.task.scanid = GetString(file, "scanid");
+    check.task.cameraid = GetString(file, "cameraid");
+    check.task.session_name = GetString(file, "session_name");
+    check.task.hdf5filename = GetString(file, "hdf5filename");
+    check.has_task = !check.task.hdf5filename.empty();
+
+    if (H5Lexists(file, "index", H5P_DEFAULT) > 0 && H5Lexists(file, "jpeg", H5P_DEFAULT) > 0) {
+        check.format = FORMAT_CHUNKED;
+
+        hid_t dapl = H5Pcreate(H5P_DATASET_ACCESS);
+        H5Pset_chunk_cache(dapl, H5D_CHUNK_CACHE_NSLOTS_DEFAULT, CHECK_CACHE_BYTES, 1.0);
+        hid_t index = H5Dopen2(file, "index", H5P_DEFAULT);
+        hid_t jpeg = H5Dopen2(file, "jpeg", dapl);
+        H5Pclose(dapl);
+
+        hid_t type = IndexType();
+        check.indexed = index >= 0 ? Extent(index) : 0;
+        hsize_t jpeg_bytes = jpeg >= 0 ? Extent(jpeg) : 0;
+        vector<FrameIndexEntry> entries(check.indexed);
+        if (check.indexed == 0 || !Rows(index, type, 0, check.indexed, &entries[0], false)) {
+            entries.clear();
+        }
+
+        uint64_t end = 0;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const FrameIndexEntry &entry = entries[i];
+            if (entry.offset != end || entry.size < 4 || entry.offset + entry.size > jpeg_bytes
+                    || (!check.complete && !WholeJpeg(jpeg, entry))) {
+                break;
+            }
+            end += entry.size;
+            check.frames++;
+        }
+        check.bytes = end;
+
+        H5Tclose(type);
+        if (jpeg >= 0) {
+            H5Dclose(jpeg);
+        }
+        if (index >= 0) {
+            H5Dclose(index);
+        }
+    } else {
+        // Every link in the root group is a frame
+        H5G_info_t info;
+        check.frames = H5Gget_info(file, &info) >= 0 ? info.nlinks : 0;
+        check.indexed = check.frames;
+    }
+
+    H5Fclose(file);
+    return check;
+}
+
+bool FrameFile::Repair(const string &path, const FrameFileCheck &check) {
+    if (!check.opened) {
+        return false;
+    }
+
+    QuietErrors quiet;
+    hid_t file = check.swmr ? -1 : H5Fopen(path.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+    if (file < 0) {
+        return check.format == FORMAT_CHUNKED && Rewrite(path, check);
+    }
+
+    bool ok = true;
+    if (check.format == FORMAT_CHUNKED) {
+        hid_t index = H5Dopen2(file, "index", H5P_DEFAULT);
+        hid_t jpeg = H5Dopen2(file, "jpeg", H5P_DEFAULT);
+        hsize_t rows = check.frames, jpeg_bytes = check.bytes;
+        ok = index >= 0 && jpeg >= 0 && H5Dset_extent(index, &rows) >= 0 && H5Dset_extent(jpeg, &jpeg_bytes) >= 0;
+        if (jpeg >= 0) {
+            H5Dclose(jpeg);
+        }
+        if (index >= 0) {
+            H5Dclose(index);
+        }
+    }
+    if (ok) {
+        SetInt(file, "complete", 1);
+        SetInt(file, "recovered", 1);
+    }
+    return H5Fclose(file) >= 0 && ok;
+}
+
+/**
+ * Rewrite
+ *
+ * Copies the frames Check found into <path>.recovering, a plain (not SWMR) file with
+ * the same attributes, complete, and renames it over path
+ */
+bool FrameFile::Rewrite(const string &path, const FrameFileCheck &check) {
+#if H5_VERSION_GE(1, 10, 0)
+    hid_t source = H5Fopen(path.c_str(), H5F_ACC_RDONLY | H5F_ACC_SWMR_READ, H5P_DEFAULT);
+#else
+    hid_t source = H5Fopen(path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+#endif
+    if (source < 0) {
+        return false;
+    }
+    string temporary = path + ".recovering";
+    hid_t target = H5Fcreate(temporary.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (target < 0) {
+        H5Fclose(source);
+        return false;
+    }
+
+    SetString(target, "format", Name(FORMAT_CHUNKED));
+    SetString(target, "clientid", check.task.clientid);
+    SetString(target, "scanid", check.task.scanid);
+    SetString(target, "cameraid", check.task.cameraid);
+    SetString(target, "session_name", check.task.session_name);
+    SetString(target, "hdf5filename", check.task.hdf5filename);
+    SetInt(target, "complete", 1);
+    SetInt(target, "swmr", 0);
+    SetInt(target, "recovered", 1);
+
+    hid_t type = IndexType();
+    hid_t source_jpeg = H5Dopen2(source, "jpeg", H5P_DEFAULT);
+    hid_t source_index = H5Dopen2(source, "index", H5P_DEFAULT);
+    hid_t jpeg = -1, index = -1;
+    bool ok = source_jpeg >= 0 && source_index >= 0;
+    if (ok) {
+        hsize_t chunk = 1 << 20;
+        hid_t dcpl = H5Dget_create_plist(source_jpeg);
+        H5Pget_chunk(dcpl, 1, &chunk);
+        H5Pclose(dcpl);
+        jpeg = CreateExtensible(target, "jpeg", H5T_NATIVE_UCHAR, chunk);
+        index = CreateExtensible(target, "index", type, INDEX_CHUNK);
+        ok = jpeg >= 0 && index >= 0;
+    }
+
+    // The index rows, then the bytes they point to, a block at a time
+    if (ok && check.frames > 0) {
+        vector<FrameIndexEntry> entries(check.frames);
+        hsize_t rows = check.frames;
+        ok = Rows(source_index, type, 0, rows, &entries[0], false)
+                && H5Dset_extent(index, &rows) >= 0
+                && Rows(index, type, 0, rows, &entries[0], true);
+    }
+    if (ok && check.bytes > 0) {
+        hsize_t total = check.bytes;
+        ok = H5Dset_extent(jpeg, &total) >= 0;
+        vector<uint8_t> block(min<hsize_t>(COPY_BYTES, total));
+        for (hsize_t offset = 0; ok && offset < total; offset += block.size()) {
+            hsize_t count = min<hsize_t>(block.size(), total - offset);
+            ok = Rows(source_jpeg, H5T_NATIVE_UCHAR, offset, count, &block[0], false)
+                    && Rows(jpeg, H5T_NATIVE_UCHAR, offset, count, &block[0], true);
+        }
+    }
+
+    if (jpeg >= 0) {
+        H5Dclose(jpeg);
+    }
+    if (index >= 0) {
+        H5Dclose(index);
+    }
+    if (source_jpeg >= 0) {
+        H5Dclose(source_jpeg);
+    }
+    if (source_index >= 0) {
+        H5Dclose(source_index);
+    }
+    H5Tclose(type);
+    H5Fclose(source);
+    ok = H5Fclose(target) >= 0 && ok;
+
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+const char * FrameFile::Name(FrameFormat format) {
+    return FORMAT_NAMES[format];
+}
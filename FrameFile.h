@@ -0,0 +1,163 @@
+/*
+ * File:   FrameFile.h
+ * Author: agridata
+ *
+ * One HDF5 file of a recording: the encoded frames of a camera until the next
+ * rotation (see OutputLayout.h). Two formats, "format" under "output" in
+ * config/daemon.json:
+ *
+ *   datasets  one dataset per frame, named by frame number (as always)
+ *   chunked   /jpeg, every frame's bytes back to back in one extensible dataset, and
+ *             /index, one {frame, offset, size} row per frame
+ *
+ * The root group carries the file's task (clientid, scanid, cameraid, session_name,
+ * hdf5filename) and "complete", set to 1 by Close. Every flush_frames frames, or
+ * flush_ms after the last flush, the file is flushed (and fdatasync'ed if "sync");
+ * chunked files write their index rows only then, after the frames they point to.
+ * Write only asks for the flush, which a scheduler worker does (see Scheduler.h);
+ * the fdatasync runs after the worker has let go of the file, so the grab thread
+ * waits at most for HDF5 to hand its buffers to the kernel, never for the disk.
+ * Close leaves its fdatasync to a worker too. FlushDue, from a periodic job, does
+ * the flushes that are due by time, also when no more frames come (a paused camera).
+ *
+ * With "swmr" (HDF5 1.10 and later), chunked files are written in the latest file
+ * format in single-writer / multiple-reader mode: other processes can open them with
+ * H5F_ACC_SWMR_READ while they are recorded (see ImageReader::tail) and read every
+ * frame /index has a row for. After each flush the writer announces how many that
+ * is (see FrameNotifier.h). Attributes cannot change in SWMR mode, so these files
+ * keep "complete" at 0 and "swmr" at 1; that they were closed shows in that they
+ * open without H5F_ACC_SWMR_READ.
+ *
+ * A file left open by a crash or a power cut is found at the next start by
+ * OutputRecovery: Check says how much of it is consistent, Repair cuts a chunked
+ * file's index back to that and marks the file complete.
+ */
+
+#ifndef FRAMEFILE_H
+#define FRAMEFILE_H
+
+// Standard
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// AgriData
+#include "TaskRegistry.h"
+
+// Utilities
+#include "json.hpp"
+
+// HDF5
+#include "hdf5.h"
+
+enum FrameFormat {
+    FORMAT_DATASETS,
+    FORMAT_CHUNKED
+};
+
+// A row of /index
+struct FrameIndexEntry {
+    int64_t frame;
+    uint64_t offset;            // into /jpeg
+    uint64_t size;
+};
+
+// What Check found
+struct FrameFileCheck {
+    bool opened;                // false: not an HDF5 file any more
+    bool complete;              // closed by Close (or repaired)
+    bool has_task;              // the task attributes are there (files from before
+                                // they were written have none)
+    FrameFormat format;
+    bool swmr;                  // still marked as being written in SWMR mode
+    uint64_t frames;            // that can be read back
+    uint64_t bytes;             // of /jpeg they take up (chunked)
+    uint64_t indexed;           // rows in /index (chunked)
+    TaskRecord task;
+};
+
+class FrameFile {
+public:
+    FrameFile();
+    ~FrameFile();
+
+    // The "output" block of config/daemon.json; applies to the next Open
+    void Configure(const nlohmann::json &config);
+
+    // Creates (truncates) path; task is written to its attributes
+    bool Open(const std::string &path, const TaskRecord &task);
+
+    // False if no file is open or HDF5 failed; the frame is lost either way. captured
+    // is when the frame was grabbed (ms since 1970), for work units.
+    bool Write(int64_t frame_number, int64_t captured, const uint8_t *data, size_t size);
+
+    void Flush();
+
+    // Flushes if there are frames flush_ms old; for a periodic job
+    void FlushDue();
+
+    // How often FlushDue should run
+    int64_t FlushCheckMs() const;
+
+    // Flushes and marks the file complete; nothing if none is open
+    void Close();
+
+    uint64_t Frames() const {
+        return frames;
+    }
+
+    static FrameFileCheck Check(const std::string &path);
+
+    // Only the task attributes, without looking at the frames. False if the file
+    // does not open or has none.
+    static bool ReadTask(const std::string &path, TaskRecord &task);
+
+    // Cuts /index to the frames Check found and sets "complete". A file still marked
+    // as being written in SWMR mode cannot be opened for writing; its frames are
+    // copied into a new file that replaces it.
+    static bool Repair(const std::string &path, const FrameFileCheck &check);
+
+    static const char * Name(FrameFormat format);
+
+private:
+    // Configuration
+    FrameFormat format;
+    uint64_t flush_frames;
+    int64_t flush_ns;
+    hsize_t chunk_bytes;
+    bool sync;
+    bool swmr;
+
+    // The open file (guarded by mutex: Stop closes it on the control thread)
+    std::mutex mutex;
+    FrameFormat open_format;
+    bool open_swmr;
+    std::string path;
+    TaskRecord task;
+    hid_t file;
+    hid_t jpeg;
+    hid_t index;
+    hid_t index_type;
+    uint64_t frames;
+    uint64_t bytes;             // in /jpeg
+    uint64_t indexed;           // rows in /index
+    uint64_t unflushed;         // frames since the last flush
+    bool flush_posted;          // a flush is waiting for a worker
+    int64_t last_flush;         // LatencyHistogram::Now()
+    int64_t last_frame;         // frame number of the last frame written
+    int64_t last_indexed;       // and of the last one in /index
+    uint64_t announced;         // frames reported to FrameNotifier
+    int64_t unannounced_frame;  // number and capture time of the first frame since
+    int64_t unannounced_time;
+    std::vector<FrameIndexEntry> pending;   // rows waiting for the flush
+
+    bool FlushWantedLocked();
+    int FlushLocked();
+    void CloseLocked();
+    void Notify(bool closed);
+
+    static bool Rewrite(const std::string &path, const FrameFileCheck &check);
+};
+
+#endif /* FRAMEFILE_H */
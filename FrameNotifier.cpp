@@ -0,0 +1,272 @@
+/*
+ * File:   FrameNotifier.cpp
+ * Author: agridata
+ */
+
+#include "FrameNotifier.h"
+
+// AgriData
+#include "AGDUtils.h"
+#include "ThreadRoles.h"
+
+// Standard
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// Messaging
+#include "zmq.hpp"
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+    atomic<bool> running(false);
+    thread publisher;
+    string endpoint;
+    string units_endpoint;
+    size_t max_waiting = 1024;
+
+    // The latest report of each file not handled yet, by path
+    mutex pending_mutex;
+    condition_variable wake;
+    map<string, FileProgress> pending;
+
+    // Units that could not be sent yet, by path (publisher thread only)
+    map<string, FileProgress> waiting;
+
+    atomic<uint64_t> sent(0);
+    atomic<uint64_t> replaced(0);
+    atomic<uint64_t> failed(0);
+    atomic<uint64_t> units_sent(0);
+    atomic<uint64_t> units_deferred(0);
+    atomic<uint64_t> units_dropped(0);
+    atomic<uint64_t> units_waiting(0);
+
+    // later follows earlier for the same file: the range starts where earlier's did
+    void Merge(FileProgress &earlier, const FileProgress &later) {
+        uint64_t from = earlier.from;
+        int64_t first_frame = earlier.first_frame;
+        int64_t captured = earlier.captured;
+        earlier = later;
+        if (first_frame >= 0) {
+            earlier.from = from;
+            earlier.first_frame = first_frame;
+            earlier.captured = captured;
+        }
+    }
+
+    string Notice(const FileProgress &progress) {
+        json notice = {
+            {"file", progress.file},
+            {"hdf5filename", progress.hdf5filename},
+            {"scanid", progress.scanid},
+            {"cameraid", progress.cameraid},
+            {"frames", progress.frames},
+            {"last_frame", progress.last_frame},
+            {"closed", progress.closed},
+            {"time", AGDUtils::grabMilliseconds()}
+        };
+        return "frames " + notice.dump();
+    }
+
+    string Unit(const FileProgress &progress) {
+        json unit = {
+            {"file", progress.file},
+            {"hdf5filename", progress.hdf5filename},
+            {"scanid", progress.scanid},
+            {"cameraid", progress.cameraid},
+            {"rows", {progress.from, progress.frames}},
+            {"first_frame", progress.first_frame},
+            {"last_frame", progress.last_frame},
+            {"captured", progress.captured},
+            {"committed", progress.committed},
+            {"sent", AGDUtils::grabMilliseconds()},
+            {"closed", progress.closed}
+        };
+        return unit.dump();
+    }
+
+    // False if the peers are all full (or there are none)
+    bool SendUnit(zmq::socket_t *socket, const FileProgress &progress) {
+        string message = Unit(progress);
+        try {
+            return socket->send(message.data(), message.size(), ZMQ_DONTWAIT);
+        } catch (const zmq::error_t &e) {
+            return false;
+        }
+    }
+
+    void Publish(zmq::socket_t *notices, zmq::socket_t *units) {
+        ScopedThreadRole role(ROLE_CONTROL);
+
+        while (true) {
+            map<string, FileProgress> batch;
+            {
+                unique_lock<mutex> lock(pending_mutex);
+                wake.wait_for(lock, chrono::milliseconds(100), []() {
+                    return !pending.empty() || !running;
+                });
+                batch.swap(pending);
+            }
+
+            for (map<string, FileProgress>::const_iterator it = batch.begin(); it != batch.end(); ++it) {
+                if (notices != NULL) {
+                    string message = Notice(it->second);
+                    try {
+                        notices->send(message.data(), message.size());
+                        sent++;
+                    } catch (const zmq::error_t &e) {
+                        failed++;
+                    }
+                }
+                if (units != NULL) {
+                    map<string, FileProgress>::iterator slot = waiting.find(it->first);
+                    if (slot == waiting.end()) {
+                        waiting.insert(*it);
+                    } else {
+                        Merge(slot->second, it->second);
+                    }
+                }
+            }
+
+            // Units, oldest file first; what does not go out now waits for the next turn
+            if (units != NULL) {
+                for (map<string, FileProgress>::iterator it = waiting.begin(); it != waiting.end();) {
+                    if (it->second.frames <= it->second.from && !it->second.closed) {
+                        it = waiting.erase(it);
+                    } else if (SendUnit(units, it->second)) {
+                        units_sent++;
+                        it = waiting.erase(it);
+                    } else {
+                        units_deferred++;
+                        ++it;
+                    }
+                }
+                while (waiting.size() > max_waiting) {
+                    waiting.erase(waiting.begin());
+                    units_dropped++;
+                }
+                units_waiting = waiting.size();
+            }
+
+            if (!running) {
+                lock_guard<mutex> lock(pending_mutex);
+                if (pending.empty()) {
+                    break;
+                }
+            }
+        }
+
+        if (notices != NULL) {
+            notices->close();
+            delete notices;
+        }
+        if (units != NULL) {
+            units->close();
+            delete units;
+        }
+    }
+
+    // One context for the process, alive until exit
+    zmq::context_t &Context() {
+        static zmq::context_t context(1);
+        return context;
+    }
+
+    zmq::socket_t * Bind(int type, const string &where, int hwm) {
+        zmq::socket_t *socket = new zmq::socket_t(Context(), type);
+        try {
+            int linger = 0;
+            socket->setsockopt(ZMQ_LINGER, &linger, sizeof (linger));
+            socket->setsockopt(ZMQ_SNDHWM, &hwm, sizeof (hwm));
+            socket->bind(where.c_str());
+        } catch (const zmq::error_t &e) {
+            LOG(ERROR) << "Frame notices: cannot bind " << where << ": " << e.what();
+            delete socket;
+            return NULL;
+        }
+        return socket;
+    }
+}
+
+namespace FrameNotifier {
+
+    bool Start(const json &config) {
+        if (running) {
+            return false;
+        }
+
+        zmq::socket_t *notices = NULL;
+        if (config.value("enabled", true)) {
+            endpoint = config.value("endpoint", string("tcp://*:4997"));
+            notices = Bind(ZMQ_PUB, endpoint, 1000);
+        }
+
+        zmq::socket_t *units = NULL;
+        json units_config = config.value("units", json::object());
+        if (units_config.value("enabled", false)) {
+            units_endpoint = units_config.value("endpoint", string("tcp://127.0.0.1:4994"));
+            max_waiting = max<size_t>(1, units_config.value("max_waiting", max_waiting));
+            units = Bind(ZMQ_PUSH, units_endpoint, units_config.value("hwm", 1000));
+        }
+
+        if (notices == NULL && units == NULL) {
+            return false;
+        }
+        running = true;
+        publisher = thread(Publish, notices, units);
+        LOG(INFO) << "Frame notices on " << (notices != NULL ? endpoint : "-")
+                << ", work units on " << (units != NULL ? units_endpoint : "-");
+        return true;
+    }
+
+    void Stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        wake.notify_one();
+        publisher.join();
+    }
+
+    void Available(const FileProgress &progress) {
+        if (!running.load(memory_order_relaxed)) {
+            return;
+        }
+        {
+            lock_guard<mutex> lock(pending_mutex);
+            map<string, FileProgress>::iterator slot = pending.find(progress.file);
+            if (slot == pending.end()) {
+                pending.insert(make_pair(progress.file, progress));
+            } else {
+                Merge(slot->second, progress);
+                replaced++;
+            }
+        }
+        wake.notify_one();
+    }
+
+    json Report() {
+        return {
+            {"enabled", running.load()},
+            {"endpoint", endpoint},
+            {"sent", sent.load()},
+            {"replaced", replaced.load()},
+            {"failed", failed.load()},
+            {"units", {
+                {"endpoint", units_endpoint},
+                {"sent", units_sent.load()},
+                {"deferred", units_deferred.load()},
+                {"dropped", units_dropped.load()},
+                {"waiting", units_waiting.load()}
+            }}
+        };
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * File:   FrameNotifier.h
+ * Author: agridata
+ *
+ * "Frames available" notices for processes on the box that read HDF5 files while
+ * they are being recorded (chunked files written in SWMR mode, see FrameFile.h).
+ * After every flush the writer reports how many frames of its file can be read; a
+ * publisher thread sends them on a ZMQ PUB socket ("endpoint" under "notify" in
+ * config/daemon.json, port 4997 by default), one message per file and flush:
+ *
+ *   frames {"file": "/data/output/.../x.hdf5", "hdf5filename": "x.hdf5",
+ *           "scanid": ..., "cameraid": ..., "frames": 1200, "last_frame": 1234,
+ *           "closed": false, "time": <ms since 1970>}
+ *
+ * frames is the number of rows of /index that are in the file. Every file also gets
+ * a notice with "closed": true when it is closed, whatever its format. Notices are
+ * never queued behind a slow subscriber: a file's newer notice replaces one that has
+ * not been sent yet.
+ *
+ * Work units ("units" under "notify", off by default) are the same reports as work
+ * for a processor: the frames committed since the last unit of the file, sent on a
+ * ZMQ PUSH socket (port 4994 on localhost by default) so each goes to one of the
+ * processors connected to it:
+ *
+ *   {"file": ..., "hdf5filename": ..., "scanid": ..., "cameraid": ...,
+ *    "rows": [from, to], "first_frame": 1100, "last_frame": 1234,
+ *    "captured": <ms>, "committed": <ms>, "sent": <ms>, "closed": false}
+ *
+ * rows are rows of /index (frames of the file, in order), captured is when the first
+ * of them was grabbed and committed when the flush that made them readable was done.
+ * A unit that cannot be sent (no processor connected, or all of them behind) is kept
+ * and merged with the file's next one, so no frame is left out unless more than
+ * "max_waiting" files (1024) are kept at once; every file ends with a unit that has
+ * "closed": true. The file's task is registered as before (see TaskRegistry.h), so
+ * processors that poll agdb.tasks still see every file.
+ */
+
+#ifndef FRAMENOTIFIER_H
+#define FRAMENOTIFIER_H
+
+// Standard
+#include <string>
+#include <stdint.h>
+
+// Utilities
+#include "json.hpp"
+
+struct FileProgress {
+    std::string file;               // full path
+    std::string hdf5filename;       // as in its task
+    std::string scanid;
+    std::string cameraid;
+    uint64_t frames;
+    int64_t last_frame;             // frame number of the last of them, -1 if none
+    uint64_t from;                  // frames already reported
+    int64_t first_frame;            // number and grab time (ms) of frame from, -1 and 0
+    int64_t captured;               // if there is none
+    int64_t committed;              // when they were flushed (ms)
+    bool closed;
+};
+
+namespace FrameNotifier {
+
+    // The "notify" block of config/daemon.json; binds the sockets
+    bool Start(const nlohmann::json &config);
+
+    // Sends what is left
+    void Stop();
+
+    // From the writer; never blocks, does nothing unless started
+    void Available(const FileProgress &progress);
+
+    // Sent, replaced before they were sent, and the endpoints
+    nlohmann::json Report();
+}
+
+#endif /* FRAMENOTIFIER_H */
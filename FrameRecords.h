@@ -0,0 +1,109 @@
+/*
+ * File:   FrameRecords.h
+ * Author: agridata
+ *
+ * Per-frame metadata as a fixed-layout record in a ring allocated once per camera.
+ * The grab thread fills in a FrameRecord on the stack and copies it into the ring;
+ * the flush job drains the ring and only then builds the BSON documents, so the frame
+ * path does no heap allocation for metadata. Strings that are the same for many
+ * frames (the HDF5 file name) are kept in a table and referred to by index.
+ */
+
+#ifndef FRAMERECORDS_H
+#define FRAMERECORDS_H
+
+// Standard
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * FrameRecord
+ *
+ * What goes into a frame document, apart from the camera's serial number and scan id
+ */
+struct FrameRecord {
+    int64_t timestamp;              // host, ms since 1970
+    int64_t camera_time;            // camera timestamp, ticks
+    int64_t frame_number;
+    int64_t camera_frame_counter;   // chunk_valid only
+    int64_t line_status;            // chunk_valid only
+    float exposure_time;
+    float gain;                     // chunk_valid only
+    uint32_t file;                  // index into the camera's HDF5 file names
+    uint8_t chunk_valid;
+    uint8_t quality_level;          // QualityLevel
+    uint8_t jpeg_quality;
+    uint8_t reserved;
+};
+
+/**
+ * FrameRecordRing
+ *
+ * One producer (the grab thread). Consumers must not overlap; the camera serializes
+ * its flushes.
+ */
+class FrameRecordRing {
+public:
+    explicit FrameRecordRing(size_t capacity = 16384) :
+    records(capacity > 0 ? capacity : 1),
+    head(0),
+    tail(0) {
+    }
+
+    // Only while nothing is recording
+    void Resize(size_t capacity) {
+        records.assign(capacity > 0 ? capacity : 1, FrameRecord());
+        head = 0;
+        tail = 0;
+    }
+
+    // False if the ring is full
+    bool Push(const FrameRecord &record) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= records.size()) {
+            return false;
+        }
+        records[h % records.size()] = record;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Drain
+     *
+     * Calls f on at most max records, oldest first, then gives their slots back.
+     * Returns how many.
+     */
+    template <class F>
+    size_t Drain(size_t max, F f) {
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        uint64_t h = head.load(std::memory_order_acquire);
+        uint64_t end = h - t > max ? t + max : h;
+        for (uint64_t i = t; i < end; ++i) {
+            f(records[i % records.size()]);
+        }
+        tail.store(end, std::memory_order_release);
+        return end - t;
+    }
+
+    size_t Size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const {
+        return records.size();
+    }
+
+    size_t Bytes() const {
+        return records.size() * sizeof (FrameRecord);
+    }
+
+private:
+    std::vector<FrameRecord> records;
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+};
+
+#endif /* FRAMERECORDS_H */
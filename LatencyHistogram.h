@@ -0,0 +1,189 @@
+/*
+ * File:   LatencyHistogram.h
+ * Author: agridata
+ *
+ * Lock-free, fixed-size latency histograms for the frame path. Buckets are
+ * log-linear (HDR style): 16 linear sub-buckets per power of two, so any recorded
+ * value is known to within ~6%, from nanoseconds to minutes, in 976 counters (about
+ * 7.6 KB; 61 KB for a camera's eight stages).
+ * Recording is a bucket computation and a relaxed atomic increment; readers (status,
+ * metrics) never block the writer.
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+#include "json.hpp"
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() {
+        Reset();
+    }
+
+    /**
+     * Record
+     *
+     * Safe to call from any thread
+     */
+    void Record(int64_t ns) {
+        if (ns < 0) ns = 0;
+        counts[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+
+        int64_t seen = max_ns.load(std::memory_order_relaxed);
+        while (ns > seen && !max_ns.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * Percentile
+     *
+     * p in [0, 1]. Returns the midpoint of the bucket holding the p-th sample.
+     */
+    int64_t Percentile(double p) const {
+        uint64_t n = Count();
+        if (n == 0) return 0;
+
+        uint64_t rank = (uint64_t) (p * (n - 1)) + 1;
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; ++b) {
+            seen += counts[b].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                int64_t mid = Lower(b) + (Lower(b + 1) - Lower(b)) / 2;
+                return mid < Max() ? mid : Max();
+            }
+        }
+        return Max();
+    }
+
+    int64_t Max() const {
+        return max_ns.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    void Reset() {
+        for (int b = 0; b < BUCKETS; ++b) {
+            counts[b].store(0, std::memory_order_relaxed);
+        }
+        max_ns.store(0, std::memory_order_relaxed);
+        total.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * Summary
+     *
+     * p50 / p99 / max in microseconds
+     */
+    nlohmann::json Summary() const {
+        return {
+            {"count", Count()},
+            {"p50_us", Percentile(0.50) / 1000.},
+            {"p99_us", Percentile(0.99) / 1000.},
+            {"max_us", Max() / 1000.}
+        };
+    }
+
+    // Monotonic clock used for every sample
+    static int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    static int Bucket(int64_t ns) {
+        uint64_t v = (uint64_t) ns;
+        if (v < (uint64_t) SUB_BUCKETS) return (int) v;
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + (int) ((v >> shift) - SUB_BUCKETS);
+    }
+
+    static int64_t Lower(int bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        int group = bucket / SUB_BUCKETS;
+        int sub = bucket % SUB_BUCKETS;
+        return (int64_t) (SUB_BUCKETS + sub) << (group - 1);
+    }
+
+    std::atomic<uint64_t> counts[BUCKETS];
+    std::atomic<int64_t> max_ns;
+    std::atomic<uint64_t> total;
+};
+
+/**
+ * Stages of HandleFrame, in order. TOTAL is sensor (exposure start, from the camera
+ * timestamp) to the frame being on disk.
+ */
+enum LatencyStage {
+    STAGE_DEQUEUE,
+    STAGE_CONVERT,
+    STAGE_RESIZE,
+    STAGE_COLOR,
+    STAGE_ENCODE,
+    STAGE_WRITE,
+    STAGE_METADATA,
+    STAGE_TOTAL,
+    STAGE_COUNT
+};
+
+/**
+ * StageLatency
+ *
+ * One histogram per stage, for one camera
+ */
+class StageLatency {
+public:
+    void Record(LatencyStage stage, int64_t ns) {
+        stages[stage].Record(ns);
+    }
+
+    /**
+     * Lap
+     *
+     * Records the time since *since against stage and moves *since to now, so that
+     * consecutive stages can be timed with one clock read each. Returns the time.
+     */
+    int64_t Lap(LatencyStage stage, int64_t &since) {
+        int64_t now = LatencyHistogram::Now();
+        int64_t elapsed = now - since;
+        stages[stage].Record(elapsed);
+        since = now;
+        return elapsed;
+    }
+
+    const LatencyHistogram &Stage(LatencyStage stage) const {
+        return stages[stage];
+    }
+
+    nlohmann::json Summary() const {
+        nlohmann::json summary;
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            summary[Name((LatencyStage) s)] = stages[s].Summary();
+        }
+        return summary;
+    }
+
+    static const char * Name(LatencyStage stage) {
+        static const char * names[STAGE_COUNT] = {
+            "dequeue", "convert", "resize", "color", "encode", "hdf5_write", "metadata", "total"
+        };
+        return names[stage];
+    }
+
+private:
+    LatencyHistogram stages[STAGE_COUNT];
+};
+
+#endif /* LATENCYHISTOGRAM_H */
@@ -0,0 +1,179 @@
+/*
+ * File:   MemoryBudget.cpp
+ * Author: agridata
+ */
+
+#include "MemoryBudget.h"
+
+// Standard
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+    enum Policy {
+        POLICY_CHARGE,
+        POLICY_BLOCK,
+        POLICY_DROP
+    };
+
+    const char * POOL_NAMES[POOL_COUNT] = {"grab", "convert", "encode", "metadata", "jobs"};
+    const char * POLICY_NAMES[] = {"charge", "block", "drop"};
+
+    // Configuration (set before recording starts)
+    int64_t limit = 0;
+    int64_t block_ms = 50;
+    Policy policies[POOL_COUNT] = {POLICY_CHARGE, POLICY_CHARGE, POLICY_BLOCK, POLICY_CHARGE, POLICY_DROP};
+
+    atomic<int64_t> total(0);
+    atomic<int64_t> used[POOL_COUNT];
+    atomic<int64_t> high_water[POOL_COUNT];
+    atomic<uint64_t> refused[POOL_COUNT];
+    atomic<uint64_t> overruns[POOL_COUNT];
+
+    // Only for "block", and only while the budget is exhausted
+    mutex wait_mutex;
+    condition_variable released;
+    atomic<int> waiters(0);
+
+    // Charges unconditionally
+    void Charge(MemoryPool pool, size_t bytes) {
+        int64_t now = used[pool].fetch_add(bytes, memory_order_relaxed) + bytes;
+        int64_t high = high_water[pool].load(memory_order_relaxed);
+        while (now > high && !high_water[pool].compare_exchange_weak(high, now, memory_order_relaxed)) {
+        }
+    }
+
+    // Takes bytes from the budget if they fit
+    bool TryReserve(size_t bytes) {
+        int64_t current = total.load(memory_order_relaxed);
+        while (current + (int64_t) bytes <= limit) {
+            if (total.compare_exchange_weak(current, current + bytes, memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+namespace MemoryBudget {
+
+    void Configure(const json &config) {
+        limit = (int64_t) (config.value("limit_mb", 0.0) * 1024 * 1024);
+        block_ms = config.value("block_ms", block_ms);
+
+        json configured = config.value("policy", json::object());
+        for (int p = 0; p < POOL_COUNT; ++p) {
+            string name = configured.value(POOL_NAMES[p], string(POLICY_NAMES[policies[p]]));
+            for (int i = 0; i <= POLICY_DROP; ++i) {
+                if (name == POLICY_NAMES[i]) {
+                    policies[p] = (Policy) i;
+                }
+            }
+        }
+
+        if (limit > 0) {
+            LOG(INFO) << "Memory budget " << limit / (1024 * 1024) << " MB";
+        }
+    }
+
+    bool Acquire(MemoryPool pool, size_t bytes) {
+        if (limit <= 0 || policies[pool] == POLICY_CHARGE) {
+            total.fetch_add(bytes, memory_order_relaxed);
+            Charge(pool, bytes);
+            return true;
+        }
+        if (TryReserve(bytes)) {
+            Charge(pool, bytes);
+            return true;
+        }
+
+        if (policies[pool] == POLICY_DROP) {
+            refused[pool]++;
+            return false;
+        }
+
+        // Block until enough is released, or go over after block_ms
+        chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(block_ms);
+        bool reserved;
+        {
+            unique_lock<mutex> lock(wait_mutex);
+            waiters++;
+            reserved = released.wait_until(lock, deadline, [bytes]() {
+                return total.load() + (int64_t) bytes <= limit && TryReserve(bytes);
+            });
+            waiters--;
+        }
+        if (!reserved) {
+            overruns[pool]++;
+            total.fetch_add(bytes, memory_order_relaxed);
+        }
+        Charge(pool, bytes);
+        return true;
+    }
+
+    void Release(MemoryPool pool, size_t bytes) {
+        used[pool].fetch_sub(bytes, memory_order_relaxed);
+
+        // Ordered against the waiter's increment, so a waiter either sees the space or
+        // gets notified
+        total.fetch_sub(bytes);
+        if (waiters.load() > 0) {
+            lock_guard<mutex> lock(wait_mutex);
+            released.notify_all();
+        }
+    }
+
+    bool Fits(size_t bytes) {
+        return limit <= 0 || total.load(memory_order_relaxed) + (int64_t) bytes <= limit;
+    }
+
+    int64_t Limit() {
+        return limit;
+    }
+
+    int64_t Used(MemoryPool pool) {
+        return used[pool].load(memory_order_relaxed);
+    }
+
+    int64_t HighWater(MemoryPool pool) {
+        return high_water[pool].load(memory_order_relaxed);
+    }
+
+    uint64_t Refused(MemoryPool pool) {
+        return refused[pool].load(memory_order_relaxed);
+    }
+
+    uint64_t Overruns(MemoryPool pool) {
+        return overruns[pool].load(memory_order_relaxed);
+    }
+
+    const char * Name(MemoryPool pool) {
+        return POOL_NAMES[pool];
+    }
+
+    json Report() {
+        json report;
+        report["limit_mb"] = limit / (1024.0 * 1024);
+        report["used_mb"] = total.load() / (1024.0 * 1024);
+        for (int p = 0; p < POOL_COUNT; ++p) {
+            report["pools"][POOL_NAMES[p]] = {
+                {"policy", POLICY_NAMES[policies[p]]},
+                {"used_mb", used[p].load() / (1024.0 * 1024)},
+                {"high_water_mb", high_water[p].load() / (1024.0 * 1024)},
+                {"refused", refused[p].load()},
+                {"overruns", overruns[p].load()}
+            };
+        }
+        return report;
+    }
+}
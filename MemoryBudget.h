@@ -0,0 +1,67 @@
+/*
+ * File:   MemoryBudget.h
+ * Author: agridata
+ *
+ * One memory budget for the whole daemon, shared by every camera, so that recording
+ * cannot push a Jetson that also runs detection into the OOM killer. Everything the
+ * frame path holds on to is accounted against a pool:
+ *
+ *   grab       Pylon's grab buffers (MaxNumBuffer x PayloadSize per camera)
+ *   convert    the converted and resized frames of each camera
+ *   encode     a frame's JPEG buffer, from imencode until it is written
+ *   metadata   each camera's ring of frame records (see FrameRecords.h)
+ *   jobs       frame copies handed to scheduler workers (preview, luminance) and
+ *              flight recorder snapshots
+ *
+ * Each pool has a policy for when the budget is used up: "charge" (account only; for
+ * memory that is needed regardless), "block" (wait up to block_ms for other pools to
+ * release, then go over and count an overrun) or "drop" (refuse; the caller does
+ * without). Accounting is a pair of atomic adds; nothing takes a lock unless the
+ * budget is exhausted.
+ *
+ * A limit of 0 (the default) only accounts. Current use and high-water marks per
+ * pool are in the status reply and the metrics.
+ */
+
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+// Standard
+#include <stddef.h>
+#include <stdint.h>
+
+// Utilities
+#include "json.hpp"
+
+enum MemoryPool {
+    POOL_GRAB,
+    POOL_CONVERT,
+    POOL_ENCODE,
+    POOL_METADATA,
+    POOL_JOBS,
+    POOL_COUNT
+};
+
+namespace MemoryBudget {
+
+    // The "memory" block of config/daemon.json
+    void Configure(const nlohmann::json &config);
+
+    // False only under the "drop" policy; then nothing is charged
+    bool Acquire(MemoryPool pool, size_t bytes);
+    void Release(MemoryPool pool, size_t bytes);
+
+    // Whether bytes more would stay within the limit
+    bool Fits(size_t bytes);
+
+    int64_t Limit();
+    int64_t Used(MemoryPool pool);
+    int64_t HighWater(MemoryPool pool);
+    uint64_t Refused(MemoryPool pool);
+    uint64_t Overruns(MemoryPool pool);
+    const char * Name(MemoryPool pool);
+
+    nlohmann::json Report();
+}
+
+#endif /* MEMORYBUDGET_H */
@@ -0,0 +1,556 @@
+/*
+ * File:   MetadataJournal.cpp
+ * Author: agridata
+ */
+
+#include "MetadataJournal.h"
+
+// AgriData
+#include "AGDUtils.h"
+#include "AsyncLog.h"
+#include "Scheduler.h"
+#include "TaskRegistry.h"
+
+// Standard
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+// System
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// MongoDB
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/types.hpp>
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/model/replace_one.hpp>
+#include <mongocxx/model/update_one.hpp>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+
+namespace {
+
+    struct JournalHeader {
+        char magic[8];                  // "AGDJRN1"
+        char scanid[56];
+    };
+
+    struct EntryHeader {
+        uint32_t length;                // of the BSON document
+        uint32_t crc;                   // of kind and document
+        uint8_t kind;                   // JournalKind
+        uint8_t reserved[3];
+    };
+
+    const char * SUFFIX = ".journal";
+
+    // Configuration
+    string host = "mongodb://localhost:27017";
+    string directory = "/data/output/journal/";
+    int64_t sync_ms = 100;
+    int64_t replay_ms = 1000;
+    size_t batch = 1000;
+    bool keep = false;
+
+    // The journal being written. Appends take append_mutex; closing the file takes
+    // both, so that Sync can fdatasync without holding up appends.
+    mutex append_mutex;
+    mutex sync_mutex;
+    int fd = -1;
+    bool broken = false;                // a write failed; no more appends until Begin
+    string current;                     // path, empty between scans
+    atomic<bool> dirty(false);
+
+    // Replay and its connection
+    mutex replay_mutex;
+    unique_ptr<mongocxx::client> conn;
+    vector<Scheduler::JobId> jobs;
+
+    atomic<uint64_t> appended(0);
+    atomic<uint64_t> appended_bytes(0);
+    atomic<uint64_t> append_failures(0);
+    atomic<uint64_t> syncs(0);
+    atomic<uint64_t> replayed(0);
+    atomic<uint64_t> replay_failures(0);
+    atomic<uint64_t> corrupt(0);
+    atomic<uint64_t> backlog(0);
+
+    uint32_t crc_table[256];
+
+    bool BuildCrcTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crc_table[i] = c;
+        }
+        return true;
+    }
+
+    const bool crc_ready = BuildCrcTable();
+
+    // CRC-32 (as zlib), continued from crc
+    uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t length) {
+        crc = ~crc;
+        for (size_t i = 0; i < length; ++i) {
+            crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    uint32_t EntryCrc(uint8_t kind, const uint8_t *data, size_t length) {
+        return Crc32(Crc32(0, &kind, 1), data, length);
+    }
+
+    mongocxx::database Database() {
+        if (!conn) {
+            conn.reset(new mongocxx::client(mongocxx::uri{host}));
+        }
+        return (*conn)["agdb"];
+    }
+
+    string Path(const string &scanid) {
+        string name = scanid;
+        replace(name.begin(), name.end(), '/', '_');
+        return directory + name + SUFFIX;
+    }
+
+    // Closes the current journal; call with both mutexes held
+    void CloseLocked() {
+        if (fd >= 0) {
+            if (dirty.exchange(false)) {
+                fdatasync(fd);
+                syncs++;
+            }
+            close(fd);
+        }
+        fd = -1;
+        broken = false;
+        current.clear();
+    }
+
+    int64_t ReadOffset(const string &path) {
+        int64_t offset = 0;
+        ifstream in((path + ".offset").c_str());
+        if (!(in >> offset) || offset < (int64_t) sizeof (JournalHeader)) {
+            offset = sizeof (JournalHeader);
+        }
+        return offset;
+    }
+
+    // Written to a temporary file and renamed, so it is always whole
+    void WriteOffset(const string &path, int64_t offset) {
+        string temporary = path + ".offset.tmp";
+        {
+            ofstream out(temporary.c_str(), ios::trunc);
+            out << offset << endl;
+        }
+        rename(temporary.c_str(), (path + ".offset").c_str());
+    }
+
+    struct Entry {
+        uint8_t kind;
+        vector<uint8_t> document;
+
+        bsoncxx::document::view View() const {
+            return bsoncxx::document::view(document.data(), document.size());
+        }
+    };
+
+    /**
+     * ReadEntries
+     *
+     * Up to max whole, intact entries from offset. Sets end to the offset after the
+     * last one, and torn if reading stopped at a short or damaged entry rather than
+     * at the end of the file.
+     */
+    vector<Entry> ReadEntries(const string &path, int64_t offset, size_t max, int64_t &end, bool &torn) {
+        vector<Entry> entries;
+        end = offset;
+        torn = false;
+
+        ifstream in(path.c_str(), ios::binary);
+        JournalHeader header;
+        if (!in.read((char *) &header, sizeof (header)) || strncmp(header.magic, "AGDJRN1", sizeof (header.magic)) != 0) {
+            torn = true;
+            return entries;
+        }
+
+        in.seekg(offset);
+        while (entries.size() < max) {
+            EntryHeader entry_header;
+            in.read((char *) &entry_header, sizeof (entry_header));
+            if (in.gcount() == 0) {
+                break;
+            }
+            Entry entry;
+            entry.kind = entry_header.kind;
+            if (in.gcount() == sizeof (entry_header) && entry_header.length >= 5 && entry_header.length < (1u << 24)) {
+                entry.document.resize(entry_header.length);
+                in.read((char *) entry.document.data(), entry_header.length);
+            }
+            if (entry.document.empty() || (size_t) in.gcount() != entry_header.length
+                    || EntryCrc(entry.kind, entry.document.data(), entry.document.size()) != entry_header.crc) {
+                torn = true;
+                break;
+            }
+            end += sizeof (entry_header) + entry_header.length;
+            entries.push_back(entry);
+        }
+        return entries;
+    }
+
+    /**
+     * Apply
+     *
+     * Writes a run of entries to the database, idempotently. Throws if any write fails;
+     * then none of them count as replayed.
+     */
+    void Apply(const vector<Entry> &entries) {
+        mongocxx::database db = Database();
+        mongocxx::bulk_write scans{mongocxx::options::bulk_write{}.ordered(true)};
+        mongocxx::bulk_write frames{mongocxx::options::bulk_write{}.ordered(false)};
+        vector<TaskRecord> tasks;
+        bool any_scans = false;
+        bool any_frames = false;
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            bsoncxx::document::view doc = entries[i].View();
+            switch (entries[i].kind) {
+                case JOURNAL_SCAN_START:
+                {
+                    mongocxx::model::update_one start{
+                        make_document(kvp("scanid", doc["scanid"].get_utf8())),
+                        make_document(kvp("$setOnInsert", doc))
+                    };
+                    start.upsert(true);
+                    scans.append(start);
+                    any_scans = true;
+                    break;
+                }
+                case JOURNAL_SCAN_END:
+                {
+                    mongocxx::model::update_one end{
+                        make_document(kvp("scanid", doc["scanid"].get_utf8())),
+                        make_document(kvp("$set", make_document(kvp("end", doc["end"].get_int64()))))
+                    };
+                    end.upsert(true);
+                    scans.append(end);
+                    any_scans = true;
+                    break;
+                }
+                case JOURNAL_FRAME:
+                {
+                    mongocxx::model::replace_one frame{
+                        make_document(kvp("scanid", doc["scanid"].get_utf8()),
+                                kvp("serialnumber", doc["serialnumber"].get_utf8()),
+                                kvp("frame_number", doc["frame_number"].get_int64())),
+                        doc
+                    };
+                    frame.upsert(true);
+                    frames.append(frame);
+                    any_frames = true;
+                    break;
+                }
+                case JOURNAL_TASK:
+                    tasks.push_back(TaskRegistry::FromDocument(doc));
+                    break;
+                default:
+                    corrupt++;
+                    break;
+            }
+        }
+
+        // Scans first: a scan's document before its frames and tasks
+        if (any_scans) {
+            db["scan"].bulk_write(scans);
+        }
+        if (any_frames) {
+            db["frame"].bulk_write(frames);
+        }
+        if (!tasks.empty()) {
+            TaskRegistry::Register(tasks);
+        }
+    }
+
+    /**
+     * ReplayFile
+     *
+     * Drains one journal as far as it can. Returns the bytes still to replay.
+     */
+    int64_t ReplayFile(const string &path) {
+        bool writing;
+        {
+            lock_guard<mutex> lock(append_mutex);
+            writing = path == current;
+        }
+
+        int64_t offset = ReadOffset(path);
+        while (true) {
+            int64_t end;
+            bool torn;
+            vector<Entry> entries = ReadEntries(path, offset, batch, end, torn);
+
+            if (!entries.empty()) {
+                try {
+                    Apply(entries);
+                } catch (const exception &e) {
+                    replay_failures++;
+                    LOG(WARNING) << "Journal " << path << " waits for the database: " << e.what();
+                    break;
+                }
+                replayed += entries.size();
+                offset = end;
+                WriteOffset(path, offset);
+                continue;
+            }
+
+            // All of a finished journal is in the database (a damaged tail is what a
+            // crash left behind, and cannot be replayed)
+            if (!writing) {
+                if (torn) {
+                    corrupt++;
+                    LOG(WARNING) << "Journal " << path << " ends in a damaged entry at byte " << offset;
+                }
+                // Unless the scan was started again meanwhile
+                lock_guard<mutex> lock(append_mutex);
+                if (!keep && path != current) {
+                    unlink(path.c_str());
+                    unlink((path + ".offset").c_str());
+                }
+                return 0;
+            }
+            break;
+        }
+
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 ? max<int64_t>(0, info.st_size - offset) : 0;
+    }
+
+    vector<string> Journals() {
+        vector<string> paths;
+        DIR *dir = opendir(directory.c_str());
+        if (dir == NULL) {
+            return paths;
+        }
+        size_t suffix = strlen(SUFFIX);
+        while (struct dirent *entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name.size() > suffix && name.compare(name.size() - suffix, suffix, SUFFIX) == 0) {
+                paths.push_back(directory + name);
+            }
+        }
+        closedir(dir);
+        sort(paths.begin(), paths.end());
+        return paths;
+    }
+}
+
+namespace MetadataJournal {
+
+    void Start(const string &mongodb_host, const json &config) {
+        lock_guard<mutex> lock(replay_mutex);
+        if (!jobs.empty()) {
+            return;
+        }
+        host = mongodb_host;
+        directory = config.value("dir", directory);
+        if (directory.empty() || directory.back() != '/') {
+            directory += '/';
+        }
+        sync_ms = max<int64_t>(1, config.value("sync_ms", sync_ms));
+        replay_ms = max<int64_t>(10, config.value("replay_ms", replay_ms));
+        batch = max<size_t>(1, config.value("batch", batch));
+        keep = config.value("keep", keep);
+
+        AGDUtils::mkdirp(directory.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+
+        vector<string> leftover = Journals();
+        if (!leftover.empty()) {
+            LOG(INFO) << leftover.size() << " journals from an earlier run to replay";
+        }
+
+        jobs.push_back(Scheduler::Every(sync_ms, "journal sync", []() {
+            Sync();
+        }));
+        jobs.push_back(Scheduler::Every(replay_ms, "journal replay", []() {
+            Replay();
+        }, Scheduler::LANE_DATABASE));
+    }
+
+    void Stop() {
+        End();
+
+        vector<Scheduler::JobId> cancelled;
+        {
+            lock_guard<mutex> lock(replay_mutex);
+            cancelled.swap(jobs);
+        }
+        for (size_t i = 0; i < cancelled.size(); ++i) {
+            Scheduler::Cancel(cancelled[i]);
+        }
+
+        Replay();
+        if (backlog > 0) {
+            LOG(WARNING) << backlog.load() << " bytes of metadata left in " << directory << " for the next start";
+        }
+    }
+
+    bool Begin(const string &scanid) {
+        string path = Path(scanid);
+
+        lock_guard<mutex> syncing(sync_mutex);
+        lock_guard<mutex> lock(append_mutex);
+        CloseLocked();
+
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            LOG(ERROR) << "Could not open journal " << path << ": " << strerror(errno);
+            return false;
+        }
+
+        // A scan started again appends to its journal; whatever follows a torn entry
+        // (a crash, or a write that failed) would never be replayed, so the journal is
+        // cut back to its last whole entry first
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            info.st_size = -1;
+        } else if (info.st_size > 0) {
+            // A header cut short is written again
+            int64_t end = 0;
+            if (info.st_size >= (off_t) sizeof (JournalHeader)) {
+                end = sizeof (JournalHeader);
+                for (int64_t offset = end;; offset = end) {
+                    bool torn;
+                    if (ReadEntries(path, offset, batch, end, torn).empty()) {
+                        break;
+                    }
+                }
+            }
+            if (end < info.st_size) {
+                LOG(WARNING) << "Journal " << path << " cut back from " << info.st_size << " to " << end
+                        << " bytes, past its last whole entry";
+                if (ftruncate(fd, end) != 0) {
+                    LOG(ERROR) << "Could not truncate journal " << path << ": " << strerror(errno);
+                    close(fd);
+                    fd = -1;
+                    return false;
+                }
+                info.st_size = end;
+            }
+        }
+        if (info.st_size == 0) {
+            JournalHeader header;
+            memset(&header, 0, sizeof (header));
+            strncpy(header.magic, "AGDJRN1", sizeof (header.magic));
+            strncpy(header.scanid, scanid.c_str(), sizeof (header.scanid) - 1);
+            if (write(fd, &header, sizeof (header)) != (ssize_t) sizeof (header)) {
+                LOG(ERROR) << "Could not write journal " << path << ": " << strerror(errno);
+                close(fd);
+                fd = -1;
+                return false;
+            }
+        }
+        current = path;
+        return true;
+    }
+
+    void End() {
+        lock_guard<mutex> syncing(sync_mutex);
+        lock_guard<mutex> lock(append_mutex);
+        CloseLocked();
+    }
+
+    bool Append(JournalKind kind, bsoncxx::document::view document) {
+        EntryHeader header;
+        memset(&header, 0, sizeof (header));
+        header.length = document.length();
+        header.kind = kind;
+        header.crc = EntryCrc(header.kind, document.data(), document.length());
+
+        struct iovec parts[2];
+        parts[0].iov_base = &header;
+        parts[0].iov_len = sizeof (header);
+        parts[1].iov_base = (void *) document.data();
+        parts[1].iov_len = document.length();
+        ssize_t size = sizeof (header) + document.length();
+
+        lock_guard<mutex> lock(append_mutex);
+        if (fd < 0 || broken) {
+            return false;
+        }
+        ssize_t written = writev(fd, parts, 2);
+        if (written != size) {
+            append_failures++;
+            HOT_LOG(Error, "Could not append to journal %s: %s", current.c_str(), strerror(errno));
+
+            // Whatever part of the entry made it is a damaged tail; nothing goes after it
+            broken = true;
+            return false;
+        }
+        appended++;
+        appended_bytes += size;
+        dirty = true;
+        return true;
+    }
+
+    void Sync() {
+        lock_guard<mutex> syncing(sync_mutex);
+        if (fd >= 0 && dirty.exchange(false)) {
+            fdatasync(fd);
+            syncs++;
+        }
+    }
+
+    void Replay() {
+        lock_guard<mutex> lock(replay_mutex);
+
+        uint64_t remaining = 0;
+        vector<string> paths = Journals();
+        for (size_t i = 0; i < paths.size(); ++i) {
+            remaining += ReplayFile(paths[i]);
+        }
+        backlog = remaining;
+    }
+
+    json Report() {
+        string file;
+        {
+            lock_guard<mutex> lock(append_mutex);
+            file = current;
+        }
+        return {
+            {"journal", file},
+            {"appended", appended.load()},
+            {"appended_mb", appended_bytes.load() / 1e6},
+            {"append_failures", append_failures.load()},
+            {"syncs", syncs.load()},
+            {"replayed", replayed.load()},
+            {"replay_failures", replay_failures.load()},
+            {"damaged", corrupt.load()},
+            {"backlog_mb", backlog.load() / 1e6}
+        };
+    }
+
+    uint64_t Backlog() {
+        return backlog.load();
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * File:   MetadataJournal.h
+ * Author: agridata
+ *
+ * A local, append-only journal of everything a scan writes to MongoDB (the scan
+ * document, frame documents, tasks), so that recording never waits for the database
+ * and loses nothing when it is slow or down. Metadata is appended to
+ * <dir>/<scanid>.journal and fsync'ed in batches every sync_ms; a replayer job drains
+ * the journals into MongoDB in order and remembers how far it got in
+ * <scanid>.journal.offset. Journals left over from a previous run are replayed at
+ * startup. A journal is deleted once its scan has ended and all of it is in the
+ * database.
+ *
+ * Replay is idempotent, so entries replayed twice (after a crash between the database
+ * write and the offset update) change nothing:
+ *
+ *   scan start   upsert by scanid, fields set only on insert
+ *   scan end     $set end, by scanid
+ *   frame        replace by scanid + serialnumber + frame_number, upsert
+ *   task         TaskRegistry::Register (upsert by scan, camera and HDF5 file name)
+ *
+ * File layout: a 64-byte header ("AGDJRN1", scan id), then entries of a 12-byte header
+ * (payload length, CRC-32 of kind and payload, kind) followed by the BSON document.
+ * Replay stops at the first entry that is short or fails its CRC; in a journal still
+ * being written that is the tail, in a finished one it is what a crash left behind.
+ *
+ * If no journal is open (between scans) or it cannot be written, Append returns false
+ * and the caller writes to the database directly, as before.
+ */
+
+#ifndef METADATAJOURNAL_H
+#define METADATAJOURNAL_H
+
+// Standard
+#include <string>
+#include <stdint.h>
+
+// MongoDB
+#include <bsoncxx/document/view.hpp>
+
+// Utilities
+#include "json.hpp"
+
+enum JournalKind {
+    JOURNAL_SCAN_START = 1,
+    JOURNAL_SCAN_END,
+    JOURNAL_FRAME,
+    JOURNAL_TASK
+};
+
+namespace MetadataJournal {
+
+    // The "journal" block of config/daemon.json. Schedules the sync and replay jobs;
+    // call after TaskRegistry::Start.
+    void Start(const std::string &mongodb_host, const nlohmann::json &config);
+
+    // Ends the current journal and replays what it can
+    void Stop();
+
+    // Opens (or reopens) the journal of a scan; appends go there until End
+    bool Begin(const std::string &scanid);
+    void End();
+
+    bool Append(JournalKind kind, bsoncxx::document::view document);
+
+    // fdatasync if anything was appended since the last one
+    void Sync();
+
+    // Drains every journal as far as the database takes it
+    void Replay();
+
+    // Appended, synced, replayed, and what is still waiting for the database
+    nlohmann::json Report();
+    uint64_t Backlog();
+}
+
+#endif /* METADATAJOURNAL_H */
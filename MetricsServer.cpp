@@ -0,0 +1,309 @@
+/*
+ * File:   MetricsServer.cpp
+ * Author: agridata
+ */
+
+#include "MetricsServer.h"
+
+// AgriData
+#include "AsyncLog.h"
+#include "MemoryBudget.h"
+#include "MetadataJournal.h"
+#include "ThreadRoles.h"
+
+// Standard
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// System
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/statvfs.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ */
+MetricsServer::MetricsServer() :
+listener(-1),
+running(false),
+buffer(new char[BUFFER_SIZE]),
+length(0) {
+}
+
+/**
+ * Destructor
+ */
+MetricsServer::~MetricsServer() {
+    Stop();
+    delete[] buffer;
+}
+
+/**
+ * Start
+ *
+ * Binds to the port on all interfaces and starts serving. The camera list must not
+ * change afterwards; cameras that are NULL (not set up) are left out.
+ */
+bool MetricsServer::Start(int port, AgriDataCamera ** cameras, size_t count) {
+    // The stop action runs Initialize() again, which rewrites a camera's serial
+    // number while the server runs, so the server works from copies
+    this->cameras.clear();
+    serials.clear();
+    for (size_t i = 0; i < count; ++i) {
+        if (cameras[i] != NULL) {
+            this->cameras.push_back(cameras[i]);
+            serials.push_back(cameras[i]->serialnumber);
+        }
+    }
+    output_root = this->cameras.empty() ? string() : this->cameras[0]->output_root;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        LOG(ERROR) << "Metrics: socket failed: " << strerror(errno);
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof (reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof (address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(listener, (struct sockaddr *) &address, sizeof (address)) != 0 || listen(listener, 4) != 0) {
+        LOG(ERROR) << "Metrics: cannot listen on port " << port << ": " << strerror(errno);
+        close(listener);
+        listener = -1;
+        return false;
+    }
+
+    running = true;
+    server = thread(&MetricsServer::Serve, this);
+    LOG(INFO) << "Metrics on http://localhost:" << port << "/metrics";
+    return true;
+}
+
+/**
+ * Stop
+ */
+void MetricsServer::Stop() {
+    running = false;
+    if (server.joinable()) {
+        server.join();
+    }
+    if (listener >= 0) {
+        close(listener);
+        listener = -1;
+    }
+}
+
+/**
+ * Serve
+ *
+ * One connection at a time; the poll timeout lets Stop() get through
+ */
+void MetricsServer::Serve() {
+    ScopedThreadRole role(ROLE_CONTROL);
+
+    while (running) {
+        struct pollfd pfd = {listener, POLLIN, 0};
+        if (poll(&pfd, 1, 500) <= 0) {
+            continue;
+        }
+
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+
+        // Scrapers send the whole request at once; don't let a stuck one block us
+        struct timeval timeout = {1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+
+        char request[1024];
+        ssize_t received = recv(client, request, sizeof (request) - 1, 0);
+        if (received > 0) {
+            request[received] = '\0';
+
+            char header[256];
+            int header_length;
+            size_t body = 0;
+            if (strncmp(request, "GET /metrics", 12) == 0) {
+                body = Render();
+                header_length = snprintf(header, sizeof (header),
+                        "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: %zu\r\n"
+                        "Connection: close\r\n\r\n", body);
+            } else {
+                header_length = snprintf(header, sizeof (header),
+                        "HTTP/1.0 404 Not Found\r\n"
+                        "Content-Length: 0\r\n"
+                        "Connection: close\r\n\r\n");
+            }
+
+            send(client, header, header_length, MSG_NOSIGNAL);
+            for (size_t sent = 0; sent < body;) {
+                ssize_t n = send(client, buffer + sent, body - sent, MSG_NOSIGNAL);
+                if (n <= 0) break;
+                sent += n;
+            }
+        }
+        close(client);
+    }
+}
+
+/**
+ * Append
+ *
+ * printf into the response buffer; output past the end is dropped
+ */
+void MetricsServer::Append(const char * format, ...) {
+    if (length >= BUFFER_SIZE) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer + length, BUFFER_SIZE - length, format, args);
+    va_end(args);
+
+    if (n > 0) {
+        length = min(BUFFER_SIZE - 1, length + (size_t) n);
+    }
+}
+
+void MetricsServer::Header(const char * name, const char * type, const char * help) {
+    Append("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void MetricsServer::Summary(const char * name, const char * camera, const char * stage, const LatencyHistogram &histogram) {
+    const char * separator = stage[0] ? "\",stage=\"" : "";
+    Append("%s{camera=\"%s%s%s\",quantile=\"0.5\"} %.9f\n", name, camera, separator, stage, histogram.Percentile(0.50) / 1e9);
+    Append("%s{camera=\"%s%s%s\",quantile=\"0.99\"} %.9f\n", name, camera, separator, stage, histogram.Percentile(0.99) / 1e9);
+    Append("%s{camera=\"%s%s%s\",quantile=\"1\"} %.9f\n", name, camera, separator, stage, histogram.Max() / 1e9);
+    Append("%s_count{camera=\"%s%s%s\"} %llu\n", name, camera, separator, stage, (unsigned long long) histogram.Count());
+}
+
+/**
+ * Render
+ *
+ * Formats every metric into the buffer and returns its length
+ */
+size_t MetricsServer::Render() {
+    length = 0;
+
+#define PER_CAMERA(expression, format) \
+    for (size_t i = 0; i < cameras.size(); ++i) { \
+        AgriDataCamera * camera = cameras[i]; \
+        Append(format, serials[i].c_str(), expression); \
+    }
+
+    Header("agdc_recording", "gauge", "1 while the camera is recording");
+    PER_CAMERA((int) camera->isRecording.load(), "agdc_recording{camera=\"%s\"} %d\n");
+
+    Header("agdc_fps", "gauge", "Frames per second delivered over the last second");
+    PER_CAMERA((double) camera->fps, "agdc_fps{camera=\"%s\"} %.2f\n");
+
+    Header("agdc_frames_grabbed_total", "counter", "Frames delivered by the camera in this recording");
+    PER_CAMERA((unsigned long long) camera->frames_grabbed, "agdc_frames_grabbed_total{camera=\"%s\"} %llu\n");
+
+    Header("agdc_frames_dropped_total", "counter", "Frames lost in this recording, by reason");
+    PER_CAMERA((unsigned long long) camera->frames_failed, "agdc_frames_dropped_total{camera=\"%s\",reason=\"failed\"} %llu\n");
+    PER_CAMERA((unsigned long long) camera->frames_skipped, "agdc_frames_dropped_total{camera=\"%s\",reason=\"skipped\"} %llu\n");
+    PER_CAMERA((unsigned long long) camera->frames_slipped, "agdc_frames_dropped_total{camera=\"%s\",reason=\"slipped\"} %llu\n");
+    PER_CAMERA((unsigned long long) camera->frames_decimated, "agdc_frames_dropped_total{camera=\"%s\",reason=\"decimated\"} %llu\n");
+
+    Header("agdc_quality_level", "gauge", "Degradation level of the frame path, 0 (full) to 4 (decimating)");
+    PER_CAMERA((int) camera->Quality(), "agdc_quality_level{camera=\"%s\"} %d\n");
+
+    Header("agdc_bytes_written_total", "counter", "Image bytes written to HDF5");
+    PER_CAMERA((unsigned long long) camera->bytes_written, "agdc_bytes_written_total{camera=\"%s\"} %llu\n");
+
+    Header("agdc_documents_pending", "gauge", "Frame documents waiting for the next database flush");
+    PER_CAMERA((unsigned long long) camera->documents_pending, "agdc_documents_pending{camera=\"%s\"} %llu\n");
+
+    Header("agdc_documents_dropped_total", "counter", "Frames without a document because the metadata ring was full");
+    PER_CAMERA((unsigned long long) camera->documents_dropped, "agdc_documents_dropped_total{camera=\"%s\"} %llu\n");
+
+    Header("agdc_helper_threads", "gauge", "Luminance and preview jobs in flight");
+    PER_CAMERA((int) camera->helper_threads, "agdc_helper_threads{camera=\"%s\"} %d\n");
+
+#undef PER_CAMERA
+
+    Header("agdc_stage_latency_seconds", "summary", "Time spent per stage of the frame path");
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            Summary("agdc_stage_latency_seconds", serials[i].c_str(),
+                    StageLatency::Name((LatencyStage) s), cameras[i]->Latency().Stage((LatencyStage) s));
+        }
+    }
+
+    Header("agdc_mongo_flush_seconds", "summary", "Duration of frame document bulk inserts");
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        Summary("agdc_mongo_flush_seconds", serials[i].c_str(), "", cameras[i]->MongoFlushLatency());
+    }
+
+    Header("agdc_stream_statistic", "gauge", "Pylon stream grabber statistics, sampled once a second");
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        const char * const * names = cameras[i]->stream_statistic_names;
+        for (int s = 0; names != NULL && s < AgriDataCamera::MAX_STREAM_STATISTICS && names[s] != NULL; ++s) {
+            Append("agdc_stream_statistic{camera=\"%s\",name=\"%s\"} %lld\n", serials[i].c_str(),
+                    names[s], (long long) cameras[i]->stream_statistics[s]);
+        }
+    }
+
+    Header("agdc_memory_bytes", "gauge", "Memory charged to the budget, by pool");
+    for (int p = 0; p < POOL_COUNT; ++p) {
+        Append("agdc_memory_bytes{pool=\"%s\"} %lld\n", MemoryBudget::Name((MemoryPool) p),
+                (long long) MemoryBudget::Used((MemoryPool) p));
+    }
+
+    Header("agdc_memory_high_water_bytes", "gauge", "Most memory charged to a pool since start");
+    for (int p = 0; p < POOL_COUNT; ++p) {
+        Append("agdc_memory_high_water_bytes{pool=\"%s\"} %lld\n", MemoryBudget::Name((MemoryPool) p),
+                (long long) MemoryBudget::HighWater((MemoryPool) p));
+    }
+
+    Header("agdc_memory_refused_total", "counter", "Allocations refused (drop policy) or over budget after waiting (block policy)");
+    for (int p = 0; p < POOL_COUNT; ++p) {
+        Append("agdc_memory_refused_total{pool=\"%s\",outcome=\"dropped\"} %llu\n", MemoryBudget::Name((MemoryPool) p),
+                (unsigned long long) MemoryBudget::Refused((MemoryPool) p));
+        Append("agdc_memory_refused_total{pool=\"%s\",outcome=\"overrun\"} %llu\n", MemoryBudget::Name((MemoryPool) p),
+                (unsigned long long) MemoryBudget::Overruns((MemoryPool) p));
+    }
+
+    Header("agdc_memory_limit_bytes", "gauge", "Memory budget, 0 if unlimited");
+    Append("agdc_memory_limit_bytes %lld\n", (long long) MemoryBudget::Limit());
+
+    Header("agdc_journal_backlog_bytes", "gauge", "Metadata journaled but not yet in the database");
+    Append("agdc_journal_backlog_bytes %llu\n", (unsigned long long) MetadataJournal::Backlog());
+
+    Header("agdc_log_records_dropped_total", "counter", "HOT_LOG records lost to a full ring");
+    Append("agdc_log_records_dropped_total %llu\n", (unsigned long long) AsyncLog::Dropped());
+
+    // Free space where the recordings go
+    if (!cameras.empty()) {
+        struct statvfs disk;
+        if (statvfs(output_root.c_str(), &disk) == 0) {
+            Header("agdc_disk_free_bytes", "gauge", "Free space on the output file system");
+            Append("agdc_disk_free_bytes{path=\"%s\"} %llu\n", output_root.c_str(),
+                    (unsigned long long) disk.f_bavail * disk.f_frsize);
+        }
+    }
+
+    return length;
+}
@@ -0,0 +1,55 @@
+/*
+ * File:   MetricsServer.h
+ * Author: agridata
+ *
+ * A minimal HTTP endpoint serving the daemon's counters and gauges in the Prometheus
+ * text format (GET /metrics). It runs on its own thread, answers one request at a
+ * time and formats into a fixed buffer. Everything it reads is an atomic written by
+ * the recording threads (see the live metrics in AgriDataCamera.h), so a scrape never
+ * waits on, or holds up, the frame path.
+ */
+
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+// Standard
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// AgriData
+#include "AgriDataCamera.h"
+
+class MetricsServer {
+public:
+    MetricsServer();
+    virtual ~MetricsServer();
+
+    bool Start(int port, AgriDataCamera ** cameras, size_t count);
+    void Stop();
+
+private:
+    static const size_t BUFFER_SIZE = 256 * 1024;
+
+    void Serve();
+    size_t Render();
+    void Append(const char * format, ...) __attribute__((format(printf, 2, 3)));
+    void Header(const char * name, const char * type, const char * help);
+    void Summary(const char * name, const char * camera, const char * stage, const LatencyHistogram &histogram);
+
+    // Fixed after Start(), which copies the serial numbers and output root
+    std::vector<AgriDataCamera *> cameras;
+    std::vector<std::string> serials;
+    std::string output_root;
+    int listener;
+
+    std::thread server;
+    std::atomic<bool> running;
+
+    // Response buffer (only touched by the server thread)
+    char * buffer;
+    size_t length;
+};
+
+#endif /* METRICSSERVER_H */
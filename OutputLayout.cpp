@@ -0,0 +1,145 @@
+/*
+ * File:   OutputLayout.cpp
+ * Author: agridata
+ */
+
+#include "OutputLayout.h"
+
+// AgriData
+#include "AGDUtils.h"
+
+// Standard
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+    const char * DEFAULT_DIRECTORY = "{root}{client}/{scan}/{camera}/";
+    const char * DEFAULT_FILE = "{scan}_{camera}_{hour}_{minute}.hdf5";
+
+    const mode_t DIRECTORY_MODE = S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH;
+
+    void Replace(string &s, const string &placeholder, const string &value) {
+        for (size_t at = s.find(placeholder); at != string::npos; at = s.find(placeholder, at + value.size())) {
+            s.replace(at, placeholder.size(), value);
+        }
+    }
+}
+
+/**
+ * Constructor
+ *
+ * Defaults: a file per minute, named as they always have been
+ */
+OutputLayout::OutputLayout() :
+directory_template(DEFAULT_DIRECTORY),
+file_template(DEFAULT_FILE),
+rotation(ROTATE_MINUTE),
+period_ms(60000),
+deadline(0),
+sequence(0) {
+}
+
+void OutputLayout::Configure(const json &config) {
+    directory_template = config.value("directory", directory_template);
+    file_template = config.value("file", file_template);
+    period_ms = max<int64_t>(1000, (int64_t) (config.value("seconds", period_ms / 1000.0) * 1000));
+
+    string layout = config.value("layout", string(rotation == ROTATE_MINUTE ? "minute" : "sequence"));
+    if (layout == "minute") {
+        rotation = ROTATE_MINUTE;
+    } else if (layout == "sequence") {
+        rotation = ROTATE_SEQUENCE;
+    } else {
+        LOG(WARNING) << "Unknown output layout \"" << layout << "\", keeping "
+                << (rotation == ROTATE_MINUTE ? "minute" : "sequence");
+    }
+
+    // Files of a minute layout named without the minute would be overwritten
+    if (rotation == ROTATE_MINUTE && file_template.find("{minute}") == string::npos) {
+        LOG(WARNING) << "Output file template \"" << file_template << "\" has no {minute}";
+    }
+    if (rotation == ROTATE_SEQUENCE && file_template.find("{seq}") == string::npos) {
+        LOG(WARNING) << "Output file template \"" << file_template << "\" has no {seq}";
+    }
+}
+
+bool OutputLayout::Begin(const string &root, const string &clientid, const string &scanid,
+        const string &camera) {
+    this->root = root;
+    this->clientid = clientid;
+    this->scanid = scanid;
+    this->camera = camera;
+
+    directory = Expand(directory_template, AGDUtils::grabMilliseconds());
+    if (!directory.empty() && directory.back() != '/') {
+        directory += '/';
+    }
+    subdirectory.clear();
+
+    file.clear();
+    deadline = 0;
+    sequence = 0;
+
+    return AGDUtils::mkdirp(directory.c_str(), DIRECTORY_MODE);
+}
+
+const string &OutputLayout::Rotate(int64_t now) {
+    file = Expand(file_template, now);
+
+    if (rotation == ROTATE_MINUTE) {
+        // The next minute of the local clock (time zones are whole minutes off UTC)
+        time_t seconds = (time_t) (now / 1000);
+        struct tm local;
+        localtime_r(&seconds, &local);
+        deadline = now - (local.tm_sec * 1000 + now % 1000) + 60000;
+    } else {
+        deadline = now + period_ms;
+    }
+    sequence++;
+
+    // Subdirectories of the file template, created once each
+    size_t slash = file.rfind('/');
+    if (slash != string::npos && file.compare(0, slash, subdirectory) != 0) {
+        subdirectory = file.substr(0, slash);
+        if (!AGDUtils::mkdirp((directory + subdirectory).c_str(), DIRECTORY_MODE)) {
+            LOG(ERROR) << "Cannot create " << directory + subdirectory;
+        }
+    }
+
+    return file;
+}
+
+/**
+ * Expand
+ *
+ * Fills in a template; once per recording or file
+ */
+string OutputLayout::Expand(const string &pattern, int64_t now) const {
+    time_t seconds = (time_t) (now / 1000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+
+    char date[16], hour[4], minute[4], seq[16];
+    strftime(date, sizeof (date), "%Y-%m-%d", &local);
+    strftime(hour, sizeof (hour), "%H", &local);
+    strftime(minute, sizeof (minute), "%M", &local);
+    snprintf(seq, sizeof (seq), "%05u", sequence);
+
+    string s = pattern;
+    Replace(s, "{root}", root);
+    Replace(s, "{client}", clientid);
+    Replace(s, "{scan}", scanid);
+    Replace(s, "{camera}", camera);
+    Replace(s, "{date}", date);
+    Replace(s, "{hour}", hour);
+    Replace(s, "{minute}", minute);
+    Replace(s, "{seq}", seq);
+    return s;
+}
@@ -0,0 +1,112 @@
+/*
+ * File:   OutputLayout.h
+ * Author: agridata
+ *
+ * Where a camera's recording goes and when it moves on to the next HDF5 file. The
+ * directory and file names are templates, filled in once per recording (directory)
+ * and once per file (file name), never per frame:
+ *
+ *   {root}    output_root
+ *   {client}  clientid
+ *   {scan}    scanid
+ *   {camera}  serial number
+ *   {date}    YYYY-MM-DD    (local time, when the file is opened)
+ *   {hour}    HH
+ *   {minute}  MM
+ *   {seq}     00000, 00001, ... (files of this recording)
+ *
+ * Files are rotated either on every minute of the local clock ("minute", as always)
+ * or every "seconds" since the file was opened ("sequence"). Either way the deadline
+ * of the current file is worked out when it is opened, so a frame only compares its
+ * timestamp with it. The defaults are the layout recordings have always had:
+ *
+ *   {root}{client}/{scan}/{camera}/{scan}_{camera}_{hour}_{minute}.hdf5
+ *
+ * A file template with a '/' in it puts files in subdirectories of the recording's
+ * directory; those are created as needed. A task names its file relative to that
+ * directory, so a name like {seq}.hdf5 recurs across cameras and scans; tasks are
+ * told apart by scan, camera and file name (see TaskRegistry.h).
+ */
+
+#ifndef OUTPUTLAYOUT_H
+#define OUTPUTLAYOUT_H
+
+// Standard
+#include <string>
+#include <stdint.h>
+
+// Utilities
+#include "json.hpp"
+
+enum LayoutRotation {
+    ROTATE_MINUTE,
+    ROTATE_SEQUENCE
+};
+
+class OutputLayout {
+public:
+    OutputLayout();
+
+    // The "output" block of config/daemon.json
+    void Configure(const nlohmann::json &config);
+
+    /**
+     * Begin
+     *
+     * At the start of a recording: resolves (and creates) the directory and forgets
+     * the file of the last recording, so the first frame rotates. False if the
+     * directory cannot be created.
+     */
+    bool Begin(const std::string &root, const std::string &clientid, const std::string &scanid,
+            const std::string &camera);
+
+    // Whether the frame at now (ms since 1970) belongs in a new file
+    bool Due(int64_t now) const {
+        return now >= deadline;
+    }
+
+    /**
+     * Rotate
+     *
+     * Moves on to the file for now and works out when it is due in turn. Returns its
+     * name, relative to Directory().
+     */
+    const std::string &Rotate(int64_t now);
+
+    const std::string &Directory() const {
+        return directory;
+    }
+
+    // Relative to Directory(); empty before the first Rotate of a recording
+    const std::string &File() const {
+        return file;
+    }
+
+    std::string Path() const {
+        return directory + file;
+    }
+
+private:
+    // Configuration
+    std::string directory_template;
+    std::string file_template;
+    LayoutRotation rotation;
+    int64_t period_ms;          // sequence only
+
+    // The recording
+    std::string root;
+    std::string clientid;
+    std::string scanid;
+    std::string camera;
+    std::string directory;
+    std::string subdirectory;   // of the current file, relative to directory; already created
+
+    // The current file
+    std::string file;
+    int64_t deadline;
+    uint32_t sequence;
+
+    std::string Expand(const std::string &pattern, int64_t now) const;
+};
+
+#endif /* OUTPUTLAYOUT_H */
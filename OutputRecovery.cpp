@@ -0,0 +1,294 @@
+/*
+ * File:   OutputRecovery.cpp
+ * Author: agridata
+ */
+
+#include "OutputRecovery.h"
+
+// AgriData
+#include "AGDUtils.h"
+#include "BsonFields.h"
+#include "FrameFile.h"
+#include "TaskRegistry.h"
+#include "ThreadRoles.h"
+
+// Standard
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdio.h>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// MongoDB
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/exception/exception.hpp>
+#include <mongocxx/options/find.hpp>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+
+namespace {
+
+    struct Candidate {
+        string relative;            // to the output root
+        TaskRecord task;            // from its attributes, or its path
+        bool has_key;               // task names the file's scan, camera and name
+    };
+
+    struct Orphan {
+        string relative;
+        FrameFileCheck check;
+        bool repaired;
+        bool damaged;
+    };
+
+    typedef tuple<string, string, string> TaskKey;  // scanid, cameraid, hdf5filename
+
+    mutex report_mutex;
+    json last_report = json::object();
+
+    bool EndsWith(const string &s, const string &suffix) {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // *.hdf5 under root + relative, relative to root
+    void Walk(const string &root, const string &relative, int depth, vector<string> &files) {
+        DIR *dir = opendir((root + relative).c_str());
+        if (dir == NULL) {
+            return;
+        }
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            string path = relative + name;
+            struct stat st;
+            if (lstat((root + path).c_str(), &st) != 0) {
+                continue;
+            }
+            if (S_ISDIR(st.st_mode) && depth > 0) {
+                Walk(root, path + "/", depth - 1, files);
+            } else if (S_ISREG(st.st_mode) && EndsWith(name, ".hdf5")) {
+                files.push_back(path);
+            }
+        }
+        closedir(dir);
+    }
+
+    // Runs work(i) for i in [0, count) on up to threads threads
+    void Parallel(size_t threads, size_t count, const function<void(size_t)> &work) {
+        atomic<size_t> next(0);
+        vector<thread> workers;
+        for (size_t t = 0; t < min(threads, count); ++t) {
+            workers.push_back(thread([&]() {
+                ScopedThreadRole role(ROLE_WRITE);
+                for (size_t i = next++; i < count; i = next++) {
+                    work(i);
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); ++t) {
+            workers[t].join();
+        }
+    }
+
+    // Files from before they carried their task: <client>/<scan>/<camera>/<file>
+    bool TaskFromPath(const string &relative, TaskRecord &task) {
+        vector<string> parts = AGDUtils::split(relative, '/');
+        if (parts.size() != 4) {
+            return false;
+        }
+        task.clientid = parts[0];
+        task.scanid = parts[1];
+        task.cameraid = parts[2];
+        task.hdf5filename = parts[3];
+        task.session_name = "";
+        task.calibration = false;
+        return true;
+    }
+
+    void Inspect(const string &root, Orphan &orphan) {
+        string path = root + orphan.relative;
+        orphan.check = FrameFile::Check(path);
+        if (!orphan.check.opened) {
+            orphan.damaged = true;
+            if (rename(path.c_str(), (path + ".damaged").c_str()) != 0) {
+                LOG(ERROR) << "Cannot rename " << path;
+            }
+            return;
+        }
+        if (!orphan.check.complete) {
+            orphan.repaired = FrameFile::Repair(path, orphan.check);
+        }
+    }
+}
+
+namespace OutputRecovery {
+
+    json Run(const string &mongodb_host, const string &output_root, const json &config) {
+        json report = {{"state", "disabled"}};
+        if (!config.value("enabled", true)) {
+            lock_guard<mutex> lock(report_mutex);
+            last_report = report;
+            return report;
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        string root = output_root;
+        if (!root.empty() && root.back() != '/') {
+            root += '/';
+        }
+        size_t threads = config.value("threads", 0);
+        if (threads == 0) {
+            threads = max(1u, thread::hardware_concurrency());
+        }
+        size_t batch = max<size_t>(1, config.value("batch", 1000));
+
+        vector<string> files;
+        Walk(root, "", config.value("max_depth", 8), files);
+
+        // Whose file each one is: a file name alone is unique only within its
+        // recording's directory (see OutputLayout.h)
+        vector<Candidate> candidates(files.size());
+        Parallel(threads, files.size(), [&](size_t i) {
+            Candidate &candidate = candidates[i];
+            candidate.relative = files[i];
+            candidate.has_key = (FrameFile::ReadTask(root + files[i], candidate.task) || TaskFromPath(files[i], candidate.task))
+                    && !candidate.task.scanid.empty() && !candidate.task.cameraid.empty();
+        });
+
+        vector<Orphan> orphans;
+        try {
+            mongocxx::client conn{mongocxx::uri{mongodb_host}};
+            mongocxx::database db = conn["agdb"];
+
+            // Which of them have a task
+            set<TaskKey> registered;
+            mongocxx::options::find projection;
+            projection.projection(make_document(kvp("scanid", 1), kvp("cameraid", 1), kvp("hdf5filename", 1), kvp("_id", 0)));
+            for (size_t i = 0; i < candidates.size(); i += batch) {
+                bsoncxx::builder::basic::array keys;
+                bool any = false;
+                for (size_t j = i; j < min(candidates.size(), i + batch); ++j) {
+                    const TaskRecord &task = candidates[j].task;
+                    if (candidates[j].has_key) {
+                        keys.append(make_document(kvp("scanid", task.scanid), kvp("cameraid", task.cameraid),
+                                kvp("hdf5filename", task.hdf5filename)));
+                        any = true;
+                    }
+                }
+                if (!any) {
+                    continue;
+                }
+                mongocxx::cursor cursor = db["tasks"].find(make_document(kvp("$or", keys.extract())), projection);
+                for (const bsoncxx::document::view &task : cursor) {
+                    registered.insert(TaskKey(BsonFields::String(task, "scanid"), BsonFields::String(task, "cameraid"),
+                            BsonFields::String(task, "hdf5filename")));
+                }
+            }
+
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                const TaskRecord &task = candidates[i].task;
+                if (!candidates[i].has_key || registered.count(TaskKey(task.scanid, task.cameraid, task.hdf5filename)) == 0) {
+                    Orphan orphan = Orphan();
+                    orphan.relative = candidates[i].relative;
+                    orphans.push_back(orphan);
+                }
+            }
+
+            // Check and repair, a file per thread at a time
+            Parallel(threads, orphans.size(), [&](size_t i) {
+                Inspect(root, orphans[i]);
+            });
+
+            // Their tasks
+            vector<TaskRecord> tasks;
+            map<string, string> sessions;
+            uint64_t repaired = 0, truncated = 0, damaged = 0, unknown = 0;
+            for (size_t i = 0; i < orphans.size(); ++i) {
+                const Orphan &orphan = orphans[i];
+                if (orphan.damaged) {
+                    LOG(WARNING) << "Recovery: " << orphan.relative << " is not a readable HDF5 file, renamed to .damaged";
+                    damaged++;
+                    continue;
+                }
+
+                TaskRecord task = orphan.check.task;
+                if (!orphan.check.has_task) {
+                    if (!TaskFromPath(orphan.relative, task)) {
+                        LOG(WARNING) << "Recovery: no task for " << orphan.relative;
+                        unknown++;
+                        continue;
+                    }
+                    if (sessions.count(task.scanid) == 0) {
+                        bsoncxx::stdx::optional<bsoncxx::document::value> scan =
+                                db["scan"].find_one(make_document(kvp("scanid", task.scanid)));
+                        sessions[task.scanid] = scan ? BsonFields::String(scan->view(), "session_name") : string();
+                    }
+                    task.session_name = sessions[task.scanid];
+                }
+
+                if (orphan.repaired) {
+                    repaired++;
+                    truncated += orphan.check.indexed - orphan.check.frames;
+                }
+                LOG(INFO) << "Recovery: " << orphan.relative << ", " << orphan.check.frames << " frames"
+                        << (orphan.check.complete ? "" : orphan.repaired ? " (repaired)" : " (not repaired)");
+                tasks.push_back(task);
+            }
+
+            for (size_t i = 0; i < tasks.size(); i += batch) {
+                TaskRegistry::Register(vector<TaskRecord>(tasks.begin() + i, tasks.begin() + min(tasks.size(), i + batch)));
+            }
+
+            report = {
+                {"state", "done"},
+                {"files", files.size()},
+                {"orphans", orphans.size()},
+                {"repaired", repaired},
+                {"truncated_frames", truncated},
+                {"damaged", damaged},
+                {"unknown", unknown},
+                {"registered", tasks.size()}
+            };
+        } catch (const exception &e) {
+            LOG(ERROR) << "Recovery of " << root << " failed: " << e.what();
+            report = {
+                {"state", "error"},
+                {"error", e.what()},
+                {"files", files.size()},
+                {"orphans", orphans.size()}
+            };
+        }
+
+        report["ms"] = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        LOG(INFO) << "Recovery: " << report.dump();
+
+        lock_guard<mutex> lock(report_mutex);
+        last_report = report;
+        return report;
+    }
+
+    json Report() {
+        lock_guard<mutex> lock(report_mutex);
+        return last_report;
+    }
+}
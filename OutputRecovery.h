@@ -0,0 +1,39 @@
+/*
+ * File:   OutputRecovery.h
+ * Author: agridata
+ *
+ * Startup recovery of HDF5 files that never got a task: the file that was open when
+ * the daemon crashed or lost power, and files whose task was still queued in memory.
+ * Every *.hdf5 under the output root is looked up in agdb.tasks by the scan, camera
+ * and file name of its task (a file name alone recurs across recordings, see
+ * OutputLayout.h), in batches of $or queries on the tasks index. The ones without a
+ * task are checked by a pool of threads (see FrameFile::Check), repaired if they
+ * were not closed, and registered in batches through TaskRegistry::Register. Files
+ * that no longer open as HDF5 are renamed to <file>.damaged and left alone.
+ *
+ * The task comes from the file's attributes (FrameFile::ReadTask, read by the same
+ * pool); files written before they had them are taken to be
+ * <root>/<client>/<scan>/<camera>/<file>, with the session name of the scan document.
+ */
+
+#ifndef OUTPUTRECOVERY_H
+#define OUTPUTRECOVERY_H
+
+// Standard
+#include <string>
+
+// Utilities
+#include "json.hpp"
+
+namespace OutputRecovery {
+
+    // The "recovery" block of config/daemon.json. Call after TaskRegistry::Start and
+    // before anything records. Never throws; if the database cannot be reached
+    // nothing is registered and the next start tries again.
+    nlohmann::json Run(const std::string &mongodb_host, const std::string &root, const nlohmann::json &config);
+
+    // What the last Run did
+    nlohmann::json Report();
+}
+
+#endif /* OUTPUTRECOVERY_H */
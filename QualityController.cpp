@@ -0,0 +1,126 @@
+/*
+ * File:   QualityController.cpp
+ * Author: agridata
+ */
+
+#include "QualityController.h"
+
+// OpenCV
+#include "opencv2/highgui.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+    const char * LEVEL_NAMES[QUALITY_LEVELS] = {
+        "full", "no_preview", "low_jpeg", "reduced_sampling", "decimate"
+    };
+
+    // Smoothing of the frame interval and time per frame, in frames
+    const double EMA_WEIGHT = 1.0 / 16;
+}
+
+/**
+ * Constructor
+ *
+ * Defaults: pressure is frames taking 90% of the frame interval, or three grab
+ * results waiting, for half a second; quiet is under 60% with at most one waiting,
+ * for five seconds. JPEG quality 95 is what imencode uses by default.
+ */
+QualityController::QualityController() :
+high_load(0.9),
+low_load(0.6),
+ready_high(3),
+escalate_ns(500000000),
+recover_ns(5000000000LL),
+max_level(QUALITY_DECIMATE),
+full_quality(95),
+low_quality(80),
+sampling_divisor(4),
+decimate(2),
+level(QUALITY_FULL) {
+    Configure(json::object());
+}
+
+void QualityController::Configure(const json &config) {
+    high_load = config.value("high_load", high_load);
+    low_load = config.value("low_load", low_load);
+    ready_high = config.value("ready_buffers", ready_high);
+    escalate_ns = (int64_t) (config.value("escalate_ms", escalate_ns / 1e6) * 1e6);
+    recover_ns = (int64_t) (config.value("recover_ms", recover_ns / 1e6) * 1e6);
+    full_quality = config.value("jpeg_quality", full_quality);
+    low_quality = config.value("low_jpeg_quality", low_quality);
+    sampling_divisor = max(1u, config.value("sampling_divisor", sampling_divisor));
+    decimate = max<uint64_t>(1, config.value("decimate", decimate));
+
+    // The worst level allowed, by name
+    string worst = config.value("max_level", string(LEVEL_NAMES[max_level]));
+    for (int i = 0; i < QUALITY_LEVELS; ++i) {
+        if (worst == LEVEL_NAMES[i]) {
+            max_level = i;
+        }
+    }
+
+    full_params = {CV_IMWRITE_JPEG_QUALITY, full_quality};
+    low_params = {CV_IMWRITE_JPEG_QUALITY, low_quality};
+    Reset();
+}
+
+void QualityController::Reset() {
+    level = QUALITY_FULL;
+    interval_ema = 0;
+    busy_ema = 0;
+    last_frame = 0;
+    pressure_since = 0;
+    quiet_since = 0;
+    sample_count = 0;
+}
+
+bool QualityController::Update(int64_t now, int64_t busy_ns, int64_t ready_buffers) {
+    if (last_frame == 0) {
+        last_frame = now;
+        busy_ema = max<int64_t>(0, busy_ns);
+        return false;
+    }
+    int64_t interval = now - last_frame;
+    last_frame = now;
+    interval_ema = interval_ema > 0 ? interval_ema + EMA_WEIGHT * (interval - interval_ema) : interval;
+
+    // A decimated frame costs nothing; counting it as 0 would halve the load as soon
+    // as decimating starts, and the level would step back up into the overload
+    if (busy_ns >= 0) {
+        busy_ema += EMA_WEIGHT * (busy_ns - busy_ema);
+    }
+
+    double load = Load();
+    int current = level.load(memory_order_relaxed);
+
+    // One step per escalate_ns of continued pressure, one back per recover_ns of quiet
+    if (ready_buffers >= ready_high || load > high_load) {
+        quiet_since = 0;
+        if (pressure_since == 0) {
+            pressure_since = now;
+        } else if (now - pressure_since >= escalate_ns && current < max_level) {
+            level = current + 1;
+            pressure_since = now;
+            return true;
+        }
+    } else if (ready_buffers <= 1 && load < low_load) {
+        pressure_since = 0;
+        if (quiet_since == 0) {
+            quiet_since = now;
+        } else if (now - quiet_since >= recover_ns && current > QUALITY_FULL) {
+            level = current - 1;
+            quiet_since = now;
+            return true;
+        }
+    } else {
+        pressure_since = 0;
+        quiet_since = 0;
+    }
+    return false;
+}
+
+const char * QualityController::Name(QualityLevel level) {
+    return level >= 0 && level < QUALITY_LEVELS ? LEVEL_NAMES[level] : "unknown";
+}
@@ -0,0 +1,122 @@
+/*
+ * File:   QualityController.h
+ * Author: agridata
+ *
+ * Graceful degradation for a camera whose frame path cannot keep up. After every
+ * frame the grab thread reports how long the frame took and how many grab results are
+ * waiting in Pylon's output queue. Sustained pressure (results piling up, or frames
+ * taking most of the frame interval) raises the level one step at a time; a sustained
+ * quiet spell lowers it again. In order:
+ *
+ *   full              everything
+ *   no_preview        streaming preview skipped
+ *   low_jpeg          frames encoded at a lower JPEG quality
+ *   reduced_sampling  luminance sampled less often
+ *   decimate          only every Nth frame written
+ *
+ * Every frame document carries the level it was recorded at, so a degraded stretch of
+ * a scan can be found afterwards. Decimating is the last resort: lower quality frames
+ * are worth more than missing rows of trees.
+ */
+
+#ifndef QUALITYCONTROLLER_H
+#define QUALITYCONTROLLER_H
+
+// Standard
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+// Utilities
+#include "json.hpp"
+
+enum QualityLevel {
+    QUALITY_FULL,
+    QUALITY_NO_PREVIEW,
+    QUALITY_LOW_JPEG,
+    QUALITY_REDUCED_SAMPLING,
+    QUALITY_DECIMATE,
+    QUALITY_LEVELS
+};
+
+class QualityController {
+public:
+    QualityController();
+
+    // The "quality" block of config/daemon.json
+    void Configure(const nlohmann::json &config);
+
+    // Back to full quality, at the start of a recording
+    void Reset();
+
+    /**
+     * Update
+     *
+     * After each frame that went through HandleFrame (busy_ns) or was decimated (-1:
+     * counts toward the frame interval only). Returns true when the level changed.
+     */
+    bool Update(int64_t now, int64_t busy_ns, int64_t ready_buffers);
+
+    QualityLevel Level() const {
+        return (QualityLevel) level.load(std::memory_order_relaxed);
+    }
+
+    bool Preview() const {
+        return Level() < QUALITY_NO_PREVIEW;
+    }
+
+    // For imencode; changes only in Update
+    const std::vector<int> &EncodeParams() const {
+        return Level() < QUALITY_LOW_JPEG ? full_params : low_params;
+    }
+
+    int JpegQuality() const {
+        return Level() < QUALITY_LOW_JPEG ? full_quality : low_quality;
+    }
+
+    // Whether to take the luminance sample that is due
+    bool Sample() {
+        return Level() < QUALITY_REDUCED_SAMPLING || ++sample_count % sampling_divisor == 0;
+    }
+
+    // Whether to write frame number n
+    bool Keep(uint64_t n) const {
+        return Level() < QUALITY_DECIMATE || n % decimate == 0;
+    }
+
+    // Smoothed time per frame over the frame interval. Only frames written are timed,
+    // so while decimating this is the load of writing every frame, what stepping
+    // back up would bring.
+    double Load() const {
+        return interval_ema > 0 ? busy_ema / interval_ema : 0;
+    }
+
+    static const char * Name(QualityLevel level);
+
+private:
+    // Configuration
+    double high_load;           // above this share of the frame interval is pressure
+    double low_load;            // below this (and an empty queue) is quiet
+    int64_t ready_high;         // this many results waiting is pressure
+    int64_t escalate_ns;        // pressure this long raises the level
+    int64_t recover_ns;         // quiet this long lowers it
+    int max_level;
+    int full_quality;
+    int low_quality;
+    uint32_t sampling_divisor;
+    uint64_t decimate;
+
+    std::vector<int> full_params;
+    std::vector<int> low_params;
+
+    // State (grab thread only, except level)
+    std::atomic<int> level;
+    double interval_ema;
+    double busy_ema;
+    int64_t last_frame;
+    int64_t pressure_since;
+    int64_t quiet_since;
+    uint32_t sample_count;
+};
+
+#endif /* QUALITYCONTROLLER_H */
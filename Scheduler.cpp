@@ -0,0 +1,317 @@
+/*
+ * File:   Scheduler.cpp
+ * Author: agridata
+ */
+
+#include "Scheduler.h"
+
+// AgriData
+#include "LatencyHistogram.h"
+#include "ThreadRoles.h"
+
+// Standard
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+    const int64_t RESOLUTION_NS = 10000000;     // one slot
+    const size_t SLOTS = 512;                   // 5.12 s per turn
+    const size_t MAX_QUEUED = 256;
+
+    struct Job {
+        Scheduler::JobId id;
+        string name;
+        int64_t period_ticks;
+        Scheduler::Lane lane;
+        function<void()> work;
+
+        // Guarded by state_mutex
+        uint64_t rounds;        // turns of the wheel left before it is due
+        bool cancelled;
+        bool busy;              // queued or running
+        uint64_t runs;
+        uint64_t skipped;
+        int64_t last_ns;
+        int64_t max_ns;
+    };
+
+    // One lock for everything: a handful of jobs, each firing at most a few times a
+    // second, and Post from the frame path only holds it for a push_back
+    mutex state_mutex;
+    condition_variable work_ready[Scheduler::LANE_COUNT];
+    condition_variable job_done;
+
+    vector<list<shared_ptr<Job> > > wheel(SLOTS);
+    map<Scheduler::JobId, shared_ptr<Job> > jobs;
+    uint64_t current_tick = 0;
+    Scheduler::JobId next_id = 1;
+
+    deque<function<void()> > queues[Scheduler::LANE_COUNT];
+    uint64_t dropped = 0;
+
+    bool running = false;
+    bool stopped = false;   // by Stop(); Every and Post no longer start it
+    thread timer;
+    vector<thread> workers[Scheduler::LANE_COUNT];
+
+    // Caller holds state_mutex
+    void Place(const shared_ptr<Job> &job, int64_t delay) {
+        delay = max<int64_t>(1, delay);
+        job->rounds = (delay - 1) / SLOTS;
+        wheel[(current_tick + delay) % SLOTS].push_back(job);
+    }
+
+    // Caller holds state_mutex
+    void Dispatch(const shared_ptr<Job> &job) {
+        if (job->busy) {
+            job->skipped++;
+            return;
+        }
+        job->busy = true;
+        queues[job->lane].push_back([job]() {
+            int64_t start = LatencyHistogram::Now();
+            try {
+                job->work();
+            } catch (const exception &e) {
+                LOG(ERROR) << "Scheduled job " << job->name << " failed: " << e.what();
+            } catch (...) {
+                LOG(ERROR) << "Scheduled job " << job->name << " failed";
+            }
+            int64_t elapsed = LatencyHistogram::Now() - start;
+
+            lock_guard<mutex> lock(state_mutex);
+            job->busy = false;
+            job->runs++;
+            job->last_ns = elapsed;
+            job->max_ns = max(job->max_ns, elapsed);
+            job_done.notify_all();
+        });
+        work_ready[job->lane].notify_one();
+    }
+
+    /**
+     * Tick
+     *
+     * One slot per RESOLUTION_NS. If the thread wakes up late it turns through the
+     * missed slots at once rather than shifting every job.
+     */
+    void Tick() {
+        ScopedThreadRole role(ROLE_CONTROL);
+        int64_t next = LatencyHistogram::Now() + RESOLUTION_NS;
+
+        unique_lock<mutex> lock(state_mutex);
+        while (running) {
+            int64_t wait = next - LatencyHistogram::Now();
+            if (wait > 0) {
+                lock.unlock();
+                this_thread::sleep_for(chrono::nanoseconds(wait));
+                lock.lock();
+                continue;
+            }
+            next += RESOLUTION_NS;
+            current_tick++;
+
+            // Placed again only after the walk: a period of a whole number of turns
+            // lands in the slot being walked
+            list<shared_ptr<Job> > due;
+            list<shared_ptr<Job> > &slot = wheel[current_tick % SLOTS];
+            for (list<shared_ptr<Job> >::iterator it = slot.begin(); it != slot.end();) {
+                shared_ptr<Job> job = *it;
+                if (job->cancelled) {
+                    it = slot.erase(it);
+                } else if (job->rounds > 0) {
+                    job->rounds--;
+                    ++it;
+                } else {
+                    it = slot.erase(it);
+                    due.push_back(job);
+                }
+            }
+            for (list<shared_ptr<Job> >::iterator it = due.begin(); it != due.end(); ++it) {
+                Dispatch(*it);
+                Place(*it, (*it)->period_ticks);
+            }
+        }
+    }
+
+    /**
+     * Work
+     *
+     * Background priority (the "write" role); a lane's jobs run in the order they
+     * came due
+     */
+    void Work(Scheduler::Lane lane) {
+        ScopedThreadRole role(ROLE_WRITE);
+
+        deque<function<void()> > &queue = queues[lane];
+        unique_lock<mutex> lock(state_mutex);
+        while (true) {
+            work_ready[lane].wait(lock, [&queue]() {
+                return !queue.empty() || !running;
+            });
+            if (queue.empty()) {
+                return;
+            }
+
+            function<void()> job = move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+
+            try {
+                job();
+            } catch (const exception &e) {
+                LOG(ERROR) << "Scheduled job failed: " << e.what();
+            } catch (...) {
+                LOG(ERROR) << "Scheduled job failed";
+            }
+            lock.lock();
+        }
+    }
+
+    // Caller holds state_mutex
+    void StartLocked(int count, int database_count) {
+        if (running) {
+            return;
+        }
+        running = true;
+        timer = thread(Tick);
+        for (int i = 0; i < max(1, count); ++i) {
+            workers[Scheduler::LANE_FRAMES].push_back(thread(Work, Scheduler::LANE_FRAMES));
+        }
+        for (int i = 0; i < max(1, database_count); ++i) {
+            workers[Scheduler::LANE_DATABASE].push_back(thread(Work, Scheduler::LANE_DATABASE));
+        }
+    }
+}
+
+namespace Scheduler {
+
+    void Start(int count, int database_count) {
+        lock_guard<mutex> lock(state_mutex);
+        stopped = false;
+        StartLocked(count, database_count);
+    }
+
+    void Stop() {
+        {
+            lock_guard<mutex> lock(state_mutex);
+            if (!running) {
+                return;
+            }
+            running = false;
+            stopped = true;
+        }
+        for (int l = 0; l < LANE_COUNT; ++l) {
+            work_ready[l].notify_all();
+        }
+
+        timer.join();
+        for (int l = 0; l < LANE_COUNT; ++l) {
+            for (size_t i = 0; i < workers[l].size(); ++i) {
+                workers[l][i].join();
+            }
+            workers[l].clear();
+        }
+    }
+
+    JobId Every(int64_t period_ms, const string &name, const function<void()> &work, Lane lane) {
+        shared_ptr<Job> job = make_shared<Job>();
+        job->name = name;
+        job->period_ticks = max<int64_t>(1, period_ms * 1000000 / RESOLUTION_NS);
+        job->lane = lane;
+        job->work = work;
+        job->cancelled = false;
+        job->busy = false;
+        job->runs = 0;
+        job->skipped = 0;
+        job->last_ns = 0;
+        job->max_ns = 0;
+
+        lock_guard<mutex> lock(state_mutex);
+        if (!stopped) {
+            StartLocked(2, 1);
+        }
+        job->id = next_id++;
+        jobs[job->id] = job;
+        Place(job, job->period_ticks);
+        return job->id;
+    }
+
+    void Cancel(JobId id) {
+        unique_lock<mutex> lock(state_mutex);
+        map<JobId, shared_ptr<Job> >::iterator it = jobs.find(id);
+        if (it == jobs.end()) {
+            return;
+        }
+
+        // The wheel lets go of it on the next pass over its slot
+        shared_ptr<Job> job = it->second;
+        job->cancelled = true;
+        jobs.erase(it);
+
+        // A queued run still goes ahead (and may be what a Stop is waiting for)
+        job_done.wait(lock, [job]() {
+            return !job->busy;
+        });
+    }
+
+    bool Post(const function<void()> &job) {
+        {
+            lock_guard<mutex> lock(state_mutex);
+            if (!stopped) {
+                StartLocked(2, 1);
+                deque<function<void()> > &queue = queues[LANE_FRAMES];
+                if (queue.size() >= MAX_QUEUED) {
+                    dropped++;
+                    return false;
+                }
+                queue.push_back(job);
+                work_ready[LANE_FRAMES].notify_one();
+                return true;
+            }
+        }
+
+        // Stopped
+        job();
+        return true;
+    }
+
+    json Report() {
+        lock_guard<mutex> lock(state_mutex);
+
+        json report;
+        report["workers"] = workers[LANE_FRAMES].size();
+        report["queued"] = queues[LANE_FRAMES].size();
+        report["database_workers"] = workers[LANE_DATABASE].size();
+        report["database_queued"] = queues[LANE_DATABASE].size();
+        report["dropped"] = dropped;
+        report["jobs"] = json::object();
+        for (map<JobId, shared_ptr<Job> >::const_iterator it = jobs.begin(); it != jobs.end(); ++it) {
+            const Job &job = *it->second;
+            report["jobs"][job.name] = {
+                {"period_ms", job.period_ticks * RESOLUTION_NS / 1000000},
+                {"lane", job.lane == LANE_DATABASE ? "database" : "frames"},
+                {"runs", job.runs},
+                {"skipped", job.skipped},
+                {"last_ms", job.last_ns / 1e6},
+                {"max_ms", job.max_ns / 1e6}
+            };
+        }
+        return report;
+    }
+}
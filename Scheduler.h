@@ -0,0 +1,70 @@
+/*
+ * File:   Scheduler.h
+ * Author: agridata
+ *
+ * Background work that runs on wall-clock periods rather than every N frames
+ * (previews, luminance sampling, database flushes, status sampling), shared by all
+ * cameras. A timer thread turns a hashed timing wheel (10 ms slots, 512 per turn) and
+ * hands due jobs to a small pool of worker threads, so the frame path never runs them
+ * itself.
+ *
+ *   Scheduler::JobId id = Scheduler::Every(60000, "flush " + serial, [this]() { Flush(); });
+ *   Scheduler::Post([this, image]() { writeLatestImage(image, params); });
+ *   Scheduler::Cancel(id);
+ *
+ * Jobs that talk to the database (replaying the journal, registering tasks, status
+ * samples, broker bookkeeping) run in a lane of their own, LANE_DATABASE, on workers
+ * of their own. With mongod down a driver call can block for the whole server
+ * selection timeout; the frame lane (document and HDF5 flushes, previews) goes on
+ * meanwhile.
+ *
+ * A periodic job never runs twice at once: if it is still queued or running when it
+ * comes due again, that run is skipped and counted. One-shot jobs (Post) are dropped
+ * when too many are waiting; both show up in Report().
+ *
+ * Every and Post start the scheduler with the default number of workers if Start has
+ * not been called. After Stop, Post runs the job on the calling thread.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Standard
+#include <functional>
+#include <string>
+#include <stdint.h>
+
+// Utilities
+#include "json.hpp"
+
+namespace Scheduler {
+
+    typedef uint64_t JobId;
+
+    enum Lane {
+        LANE_FRAMES,
+        LANE_DATABASE,
+        LANE_COUNT
+    };
+
+    // Workers for the frame lane and for the database lane
+    void Start(int workers = 2, int database_workers = 1);
+
+    // Runs what is already queued, then joins the threads
+    void Stop();
+
+    // First run one period from now
+    JobId Every(int64_t period_ms, const std::string &name, const std::function<void()> &job,
+            Lane lane = LANE_FRAMES);
+
+    // Waits for a run in progress to finish, so must not be called from the job itself
+    void Cancel(JobId id);
+
+    // Run once, as soon as a frame lane worker is free. False if the job was dropped.
+    bool Post(const std::function<void()> &job);
+
+    // Workers, queue, and per-job runs, skips and durations
+    nlohmann::json Report();
+}
+
+#endif /* SCHEDULER_H */
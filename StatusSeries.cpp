@@ -0,0 +1,298 @@
+/*
+ * File:   StatusSeries.cpp
+ * Author: agridata
+ */
+
+#include "StatusSeries.h"
+
+// AgriData
+#include "AGDUtils.h"
+#include "BsonFields.h"
+#include "Scheduler.h"
+
+// Standard
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// MongoDB
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/builder/basic/sub_array.hpp>
+#include <bsoncxx/builder/basic/sub_document.hpp>
+#include <bsoncxx/json.hpp>
+#include <bsoncxx/types.hpp>
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/pipeline.hpp>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+using bsoncxx::builder::basic::sub_document;
+
+namespace {
+
+    const int64_t MINUTE_MS = 60000;
+
+    // Minutes each rollup does again, for samples that were inserted late
+    const int64_t REDO_MINUTES = 5;
+
+    // Raw fields that are rolled up, and their names in agdb.status_minute
+    const char * ROLLUP_FIELDS[][2] = {
+        {"Temperature", "temperature"},
+        {"Resulting Frame Rate", "fps"},
+        {"Current Gain", "gain"},
+        {"Exposure Time", "exposure"}
+    };
+
+    string host = "mongodb://localhost:27017";
+    int64_t flush_ms = 5000;
+    int64_t rollup_ms = 60000;
+    int64_t lookback_ms = 24 * 3600 * 1000LL;
+    size_t max_pending = 10000;
+
+    mutex pending_mutex;
+    vector<StatusSample> pending;
+
+    // Flush and Rollup share the connection
+    mutex db_mutex;
+    unique_ptr<mongocxx::client> conn;
+    vector<Scheduler::JobId> jobs;
+    int64_t rolled_until = 0;
+
+    atomic<uint64_t> inserted(0);
+    atomic<uint64_t> dropped(0);
+    atomic<int64_t> last_minute(0);
+
+    mongocxx::database Database() {
+        if (!conn) {
+            conn.reset(new mongocxx::client(mongocxx::uri{host}));
+        }
+        return (*conn)["agdb"];
+    }
+
+    bsoncxx::types::b_date Date(int64_t ms) {
+        return bsoncxx::types::b_date{chrono::milliseconds(ms)};
+    }
+
+    // Where the rollups stopped last time the daemon ran
+    void LoadWatermark() {
+        mongocxx::options::find opts{};
+        opts.sort(make_document(kvp("minute", -1)));
+        bsoncxx::stdx::optional<bsoncxx::document::value> latest = Database()["status_minute"].find_one({}, opts);
+        if (latest) {
+            int64_t minute = BsonFields::DateMs(latest->view(), "minute", -1);
+            if (minute >= 0) {
+                rolled_until = minute + MINUTE_MS;
+                last_minute = minute;
+            }
+        }
+    }
+
+    // Per camera and minute: the number of samples and min / mean / max of each field
+    mongocxx::pipeline Pipeline(int64_t start, int64_t end) {
+        mongocxx::pipeline pipeline{};
+        pipeline.match(make_document(kvp("time", make_document(kvp("$gte", Date(start)), kvp("$lt", Date(end))))));
+
+        bsoncxx::builder::basic::document group{};
+        group.append(kvp("_id", make_document(
+                kvp("serialnumber", "$Serial Number"),
+                kvp("minute", make_document(kvp("$subtract", [](bsoncxx::builder::basic::sub_array time) {
+                    time.append("$time");
+                    time.append(make_document(kvp("$mod", [](bsoncxx::builder::basic::sub_array mod) {
+                        mod.append(make_document(kvp("$subtract", [](bsoncxx::builder::basic::sub_array since) {
+                            since.append("$time");
+                            since.append(Date(0));
+                        })));
+                        mod.append(MINUTE_MS);
+                    })));
+                }))))));
+        group.append(kvp("samples", make_document(kvp("$sum", 1))));
+        for (const auto &field : ROLLUP_FIELDS) {
+            string source = string("$") + field[0];
+            string name = field[1];
+            group.append(kvp(name + "_min", make_document(kvp("$min", source))));
+            group.append(kvp(name + "_mean", make_document(kvp("$avg", source))));
+            group.append(kvp(name + "_max", make_document(kvp("$max", source))));
+        }
+        pipeline.group(group.extract());
+        return pipeline;
+    }
+}
+
+namespace StatusSeries {
+
+    void Start(const string &mongodb_host, const json &config) {
+        lock_guard<mutex> lock(db_mutex);
+        if (!jobs.empty()) {
+            return;
+        }
+        host = mongodb_host;
+        flush_ms = max<int64_t>(10, config.value("flush_ms", flush_ms));
+        rollup_ms = max<int64_t>(1000, config.value("rollup_ms", rollup_ms));
+        lookback_ms = (int64_t) (config.value("lookback_h", lookback_ms / 3600000.0) * 3600000);
+        max_pending = config.value("max_pending", max_pending);
+
+        try {
+            LoadWatermark();
+        } catch (const exception &e) {
+            LOG(ERROR) << "Could not read status rollups: " << e.what();
+        }
+
+        jobs.push_back(Scheduler::Every(flush_ms, "status samples", []() {
+            Flush();
+        }, Scheduler::LANE_DATABASE));
+        jobs.push_back(Scheduler::Every(rollup_ms, "status rollup", []() {
+            Rollup();
+        }, Scheduler::LANE_DATABASE));
+    }
+
+    void Stop() {
+        vector<Scheduler::JobId> cancelled;
+        {
+            lock_guard<mutex> lock(db_mutex);
+            cancelled.swap(jobs);
+        }
+        for (size_t i = 0; i < cancelled.size(); ++i) {
+            Scheduler::Cancel(cancelled[i]);
+        }
+        Flush();
+    }
+
+    bsoncxx::document::value ToDocument(const StatusSample &sample) {
+        bsoncxx::builder::basic::document doc{};
+        doc.append(kvp("time", Date(sample.time)));
+        doc.append(kvp("Serial Number", sample.serialnumber));
+        doc.append(kvp("Model Name", sample.modelname));
+        doc.append(kvp("Recording", sample.recording));
+        doc.append(kvp("Timestamp", sample.timestamp));
+        doc.append(kvp("scanid", sample.scanid));
+        doc.append(kvp("Exposure Time", sample.exposure_time));
+        doc.append(kvp("Resulting Frame Rate", sample.fps));
+        doc.append(kvp("Current Gain", sample.gain));
+        doc.append(kvp("Temperature", sample.temperature));
+        doc.append(kvp("Target Brightness", sample.target_brightness));
+        if (sample.has_luminance) {
+            doc.append(kvp("luminance", sample.luminance));
+        }
+        return doc.extract();
+    }
+
+    void Add(const StatusSample &sample) {
+        lock_guard<mutex> lock(pending_mutex);
+        if (pending.size() >= max_pending) {
+            dropped++;
+            return;
+        }
+        pending.push_back(sample);
+    }
+
+    void Flush() {
+        lock_guard<mutex> lock(db_mutex);
+
+        vector<StatusSample> samples;
+        {
+            lock_guard<mutex> queued(pending_mutex);
+            samples.swap(pending);
+        }
+        if (samples.empty()) {
+            return;
+        }
+
+        vector<bsoncxx::document::value> documents;
+        documents.reserve(samples.size());
+        for (size_t i = 0; i < samples.size(); ++i) {
+            documents.push_back(ToDocument(samples[i]));
+        }
+
+        try {
+            Database()["status"].insert_many(documents);
+            inserted += samples.size();
+        } catch (const exception &e) {
+            LOG(ERROR) << "Could not insert " << samples.size() << " status samples: " << e.what();
+
+            // Back in front of anything added since, as far as there is room
+            lock_guard<mutex> queued(pending_mutex);
+            size_t keep = min(samples.size(), max_pending - min(max_pending, pending.size()));
+            dropped += samples.size() - keep;
+            pending.insert(pending.begin(), samples.end() - keep, samples.end());
+        }
+    }
+
+    void Rollup() {
+        lock_guard<mutex> lock(db_mutex);
+
+        // The current minute and the one before may still be filling
+        int64_t now = AGDUtils::grabMilliseconds();
+        int64_t end = (now / MINUTE_MS - 1) * MINUTE_MS;
+        int64_t start = max(rolled_until - REDO_MINUTES * MINUTE_MS, (now - lookback_ms) / MINUTE_MS * MINUTE_MS);
+        if (start >= end) {
+            return;
+        }
+
+        try {
+            mongocxx::database db = Database();
+            mongocxx::bulk_write bulk{mongocxx::options::bulk_write{}.ordered(false)};
+            bool any = false;
+
+            for (const bsoncxx::document::view &minute : db["status"].aggregate(Pipeline(start, end))) {
+                bsoncxx::document::view id = minute["_id"].get_document().value;
+
+                bsoncxx::builder::basic::document rollup{};
+                rollup.append(kvp("samples", (int) BsonFields::Int64(minute, "samples")));
+                for (const auto &field : ROLLUP_FIELDS) {
+                    string name = field[1];
+                    double low = BsonFields::Double(minute, name + "_min");
+                    double mean = BsonFields::Double(minute, name + "_mean");
+                    double high = BsonFields::Double(minute, name + "_max");
+                    rollup.append(kvp(name, [low, mean, high](sub_document stats) {
+                        stats.append(kvp("min", low));
+                        stats.append(kvp("mean", mean));
+                        stats.append(kvp("max", high));
+                    }));
+                }
+
+                mongocxx::model::update_one upsert{
+                    make_document(kvp("serialnumber", id["serialnumber"].get_utf8().value),
+                            kvp("minute", id["minute"].get_date())),
+                    make_document(kvp("$set", rollup.extract()))
+                };
+                upsert.upsert(true);
+                bulk.append(upsert);
+                any = true;
+            }
+
+            if (any) {
+                db["status_minute"].bulk_write(bulk);
+            }
+            rolled_until = end;
+            last_minute = end - MINUTE_MS;
+        } catch (const exception &e) {
+            LOG(ERROR) << "Could not roll up status samples: " << e.what();
+        }
+    }
+
+    json Report() {
+        size_t waiting;
+        {
+            lock_guard<mutex> lock(pending_mutex);
+            waiting = pending.size();
+        }
+        return {
+            {"pending", waiting},
+            {"inserted", inserted.load()},
+            {"dropped", dropped.load()},
+            {"rolled_up_to_ms", last_minute.load()}
+        };
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * File:   StatusSeries.h
+ * Author: agridata
+ *
+ * Camera status samples (one per "status" request), kept out of agdb.frame. Samples
+ * are queued and inserted into agdb.status in batches by a scheduler job, like frame
+ * documents. Raw samples expire after a day (the TTL index on time, see
+ * DatabaseIndexes.h); before that, a rollup job folds every complete minute into
+ * agdb.status_minute:
+ *
+ *   {serialnumber, minute, samples,
+ *    temperature: {min, mean, max}, fps: {...}, gain: {...}, exposure: {...}}
+ *
+ * Rollups are upserts by camera and minute, and each run redoes the last few minutes,
+ * so samples that reached the database late are still counted.
+ */
+
+#ifndef STATUSSERIES_H
+#define STATUSSERIES_H
+
+// Standard
+#include <string>
+#include <stdint.h>
+
+// MongoDB
+#include <bsoncxx/document/value.hpp>
+
+// Utilities
+#include "json.hpp"
+
+struct StatusSample {
+    int64_t time;                   // ms since 1970
+    std::string serialnumber;
+    std::string modelname;
+    std::string scanid;
+    bool recording;
+    int64_t timestamp;              // of the last frame
+    int exposure_time;
+    int fps;
+    int gain;
+    int temperature;
+    int target_brightness;
+    bool has_luminance;
+    float luminance;
+};
+
+namespace StatusSeries {
+
+    // The "status" block of config/daemon.json
+    void Start(const std::string &mongodb_host, const nlohmann::json &config);
+
+    // Inserts what is left, synchronously
+    void Stop();
+
+    // Same fields as status documents have always had, plus time
+    bsoncxx::document::value ToDocument(const StatusSample &sample);
+
+    // Never blocks on the database
+    void Add(const StatusSample &sample);
+
+    void Flush();
+
+    // Folds complete minutes into agdb.status_minute
+    void Rollup();
+
+    // Pending, inserted, dropped samples and the last minute rolled up
+    nlohmann::json Report();
+}
+
+#endif /* STATUSSERIES_H */
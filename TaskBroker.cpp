@@ -0,0 +1,792 @@
+/*
+ * File:   TaskBroker.cpp
+ * Author: agridata
+ */
+
+#include "TaskBroker.h"
+
+// AgriData
+#include "AGDUtils.h"
+#include "BsonFields.h"
+#include "LatencyHistogram.h"
+#include "Scheduler.h"
+#include "ThreadRoles.h"
+
+// Standard
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string.h>
+#include <thread>
+#include <tuple>
+
+// System
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// MongoDB
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/model/update_one.hpp>
+
+// Messaging
+#include "zmq.hpp"
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+
+namespace {
+
+    const int TASK_STAGE_COUNT = 4;
+    const char * TASK_STAGES[TASK_STAGE_COUNT] = {"preprocess", "trunk_detection", "process", "shape_analysis_per_archive"};
+
+    // As in agdb.tasks, where 0 has always meant "to do"
+    enum StageResult {
+        RESULT_FAILED = -1,
+        RESULT_PENDING = 0,
+        RESULT_DONE = 1
+    };
+
+    struct BrokerTask {
+        TaskRecord record;
+        int64_t priority;
+        int result[TASK_STAGE_COUNT];
+        int attempts;               // of the stage it is at
+        bool leased;
+    };
+
+    // File names are unique only within a recording's directory (see OutputLayout.h)
+    struct TaskKey {
+        string scanid;
+        string cameraid;
+        string file;
+
+        bool operator<(const TaskKey &other) const {
+            return tie(scanid, cameraid, file) < tie(other.scanid, other.cameraid, other.file);
+        }
+
+        bool operator==(const TaskKey &other) const {
+            return scanid == other.scanid && cameraid == other.cameraid && file == other.file;
+        }
+
+        string Name() const {
+            return scanid + "/" + cameraid + "/" + file;
+        }
+    };
+
+    struct Lease {
+        TaskKey key;
+        int stage;
+        string worker;
+        int64_t expires;            // LatencyHistogram::Now()
+    };
+
+    typedef pair<int64_t, TaskKey> QueueKey;        // priority, task
+    typedef pair<TaskKey, int> ResultKey;           // task, stage
+
+    // Configuration
+    string host = "mongodb://localhost:27017";
+    string endpoint = "tcp://*:4995";
+    string journal_path = "/data/output/broker/broker.journal";
+    int64_t lease_ms = 300000;
+    int max_attempts = 3;
+    int64_t sync_ms = 100;
+    int64_t bookkeeping_ms = 1000;
+    size_t batch = 1000;
+    int64_t compact_bytes = 16 << 20;
+
+    // Tasks, queues, leases and the journal. Compaction takes sync_mutex first, so
+    // that Sync never fdatasyncs a descriptor being replaced.
+    mutex sync_mutex;
+    mutex state_mutex;
+    map<TaskKey, BrokerTask> tasks;
+    set<QueueKey> queues[TASK_STAGE_COUNT];         // tasks whose next stage it is
+    map<uint64_t, Lease> leases;
+    uint64_t next_lease = 1;
+    map<ResultKey, int> unbooked;                   // results not in agdb.tasks yet
+    int journal_fd = -1;
+    int64_t journal_bytes = 0;
+    bool journal_broken = false;
+    atomic<bool> dirty(false);
+
+    // Bookkeeping and its connection
+    mutex bookkeep_mutex;
+    unique_ptr<mongocxx::client> conn;
+    vector<Scheduler::JobId> jobs;
+
+    atomic<bool> running(false);
+    thread server;
+
+    atomic<uint64_t> offered(0);
+    atomic<uint64_t> granted(0);
+    atomic<uint64_t> renewed(0);
+    atomic<uint64_t> expired(0);
+    atomic<uint64_t> done(0);
+    atomic<uint64_t> retried(0);
+    atomic<uint64_t> failed(0);
+    atomic<uint64_t> refused(0);
+    atomic<uint64_t> booked(0);
+    atomic<uint64_t> bookkeep_failures(0);
+    atomic<uint64_t> compactions(0);
+
+    mongocxx::database Database() {
+        if (!conn) {
+            conn.reset(new mongocxx::client(mongocxx::uri{host}));
+        }
+        return (*conn)["agdb"];
+    }
+
+    TaskKey KeyOf(const TaskRecord &record) {
+        TaskKey key;
+        key.scanid = record.scanid;
+        key.cameraid = record.cameraid;
+        key.file = record.hdf5filename;
+        return key;
+    }
+
+    int StageIndex(const string &name) {
+        for (int s = 0; s < TASK_STAGE_COUNT; ++s) {
+            if (name == TASK_STAGES[s]) {
+                return s;
+            }
+        }
+        return -1;
+    }
+
+    json TaskLine(const BrokerTask &task) {
+        return {
+            {"op", "add"},
+            {"clientid", task.record.clientid},
+            {"scanid", task.record.scanid},
+            {"hdf5filename", task.record.hdf5filename},
+            {"cameraid", task.record.cameraid},
+            {"session_name", task.record.session_name},
+            {"priority", task.priority},
+            {"results", vector<int>(task.result, task.result + TASK_STAGE_COUNT)}
+        };
+    }
+
+    json ResultLine(const TaskKey &key, int stage, int result) {
+        return {
+            {"op", "result"},
+            {"scanid", key.scanid},
+            {"cameraid", key.cameraid},
+            {"hdf5filename", key.file},
+            {"stage", stage},
+            {"result", result}
+        };
+    }
+
+    // Call with state_mutex held; the next Sync makes it durable
+    void Append(const json &line) {
+        if (journal_fd < 0 || journal_broken) {
+            return;
+        }
+        string text = line.dump() + "\n";
+        if (write(journal_fd, text.data(), text.size()) != (ssize_t) text.size()) {
+            LOG(ERROR) << "Could not append to " << journal_path << ": " << strerror(errno)
+                    << "; the broker journal is rewritten at the next compaction";
+            journal_broken = true;
+            return;
+        }
+        journal_bytes += text.size();
+        dirty = true;
+    }
+
+    // Queues a task at its next stage; false if it has none left. Call with
+    // state_mutex held.
+    bool Enqueue(const BrokerTask &task) {
+        for (int s = 0; s < TASK_STAGE_COUNT; ++s) {
+            if (task.result[s] == RESULT_DONE) {
+                continue;
+            }
+            if (task.result[s] == RESULT_FAILED) {
+                return false;
+            }
+            queues[s].insert(QueueKey(task.priority, KeyOf(task.record)));
+            return true;
+        }
+        return false;
+    }
+
+    // Records a stage's result and moves the task on (or forgets it)
+    void Finish(const TaskKey &key, int stage, int result) {
+        map<TaskKey, BrokerTask>::iterator it = tasks.find(key);
+        if (it == tasks.end()) {
+            return;
+        }
+        BrokerTask &task = it->second;
+        task.result[stage] = result;
+        task.attempts = 0;
+        task.leased = false;
+        Append(ResultLine(key, stage, result));
+        unbooked[ResultKey(key, stage)] = result;
+        if (!Enqueue(task)) {
+            tasks.erase(it);
+        }
+    }
+
+    // False for calibration tasks and tasks already known
+    bool Insert(const TaskRecord &record, int64_t priority, const int *result) {
+        if (record.calibration || record.hdf5filename.empty() || tasks.count(KeyOf(record)) > 0) {
+            return false;
+        }
+        BrokerTask task;
+        task.record = record;
+        task.priority = priority;
+        copy(result, result + TASK_STAGE_COUNT, task.result);
+        task.attempts = 0;
+        task.leased = false;
+        tasks[KeyOf(record)] = task;
+        return true;
+    }
+
+    /**
+     * Compact
+     *
+     * Rewrites the journal as it stands: every task, and the results not yet in the
+     * database. Call with sync_mutex and state_mutex held.
+     */
+    bool Compact() {
+        string temporary = journal_path + ".tmp";
+        int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            LOG(ERROR) << "Could not write " << temporary << ": " << strerror(errno);
+            return false;
+        }
+
+        string text;
+        for (map<TaskKey, BrokerTask>::const_iterator it = tasks.begin(); it != tasks.end(); ++it) {
+            text += TaskLine(it->second).dump() + "\n";
+        }
+        for (map<ResultKey, int>::const_iterator it = unbooked.begin(); it != unbooked.end(); ++it) {
+            text += ResultLine(it->first.first, it->first.second, it->second).dump() + "\n";
+        }
+        bool ok = write(fd, text.data(), text.size()) == (ssize_t) text.size() && fdatasync(fd) == 0;
+        close(fd);
+        if (!ok || rename(temporary.c_str(), journal_path.c_str()) != 0) {
+            LOG(ERROR) << "Could not write " << temporary << ": " << strerror(errno);
+            unlink(temporary.c_str());
+            return false;
+        }
+
+        if (journal_fd >= 0) {
+            close(journal_fd);
+        }
+        journal_fd = open(journal_path.c_str(), O_WRONLY | O_APPEND);
+        journal_bytes = text.size();
+        journal_broken = journal_fd < 0;
+        dirty = false;
+        compactions++;
+        return journal_fd >= 0;
+    }
+
+    /**
+     * Replay
+     *
+     * Loads the journal, up to the first line that does not parse (what a crash left
+     * half written). Call with state_mutex held, before anything is queued.
+     */
+    void Replay() {
+        ifstream in(journal_path.c_str());
+        string text;
+        uint64_t lines = 0;
+        while (getline(in, text)) {
+            json line;
+            try {
+                line = json::parse(text);
+            } catch (const exception &e) {
+                LOG(WARNING) << "Broker journal " << journal_path << " ends in a damaged line " << lines + 1;
+                break;
+            }
+            lines++;
+
+            TaskKey key;
+            key.scanid = line.value("scanid", string());
+            key.cameraid = line.value("cameraid", string());
+            key.file = line.value("hdf5filename", string());
+            if (line.value("op", string()) == "add") {
+                TaskRecord record;
+                record.clientid = line.value("clientid", string());
+                record.scanid = key.scanid;
+                record.hdf5filename = key.file;
+                record.cameraid = key.cameraid;
+                record.session_name = line.value("session_name", string());
+                record.calibration = false;
+                int result[TASK_STAGE_COUNT] = {RESULT_PENDING, RESULT_PENDING, RESULT_PENDING, RESULT_PENDING};
+                vector<int> results = line.value("results", vector<int>());
+                for (size_t s = 0; s < results.size() && s < (size_t) TASK_STAGE_COUNT; ++s) {
+                    result[s] = results[s];
+                }
+                Insert(record, line.value("priority", (int64_t) 0), result);
+            } else if (line.value("op", string()) == "result") {
+                int stage = line.value("stage", -1);
+                if (stage < 0 || stage >= TASK_STAGE_COUNT) {
+                    continue;
+                }
+                int result = line.value("result", (int) RESULT_PENDING);
+                map<TaskKey, BrokerTask>::iterator it = tasks.find(key);
+                if (it != tasks.end()) {
+                    it->second.result[stage] = result;
+                }
+                // Possibly in the database already; setting it again changes nothing
+                unbooked[ResultKey(key, stage)] = result;
+            }
+        }
+
+        for (map<TaskKey, BrokerTask>::iterator it = tasks.begin(); it != tasks.end();) {
+            if (Enqueue(it->second)) {
+                ++it;
+            } else {
+                it = tasks.erase(it);
+            }
+        }
+        LOG(INFO) << "Broker journal: " << lines << " lines, " << tasks.size() << " tasks to do, "
+                << unbooked.size() << " results for the database";
+    }
+
+    /**
+     * Seed
+     *
+     * The tasks in agdb.tasks with a stage to do, for a broker without a journal
+     */
+    void Seed() {
+        bsoncxx::builder::basic::array to_do;
+        for (int s = 0; s < TASK_STAGE_COUNT; ++s) {
+            to_do.append(make_document(kvp(TASK_STAGES[s], 0)));
+        }
+        mongocxx::cursor cursor = Database()["tasks"].find(make_document(kvp("$or", to_do.extract())));
+
+        lock_guard<mutex> lock(state_mutex);
+        size_t loaded = 0;
+        for (const bsoncxx::document::view &doc : cursor) {
+            TaskRecord record;
+            record.clientid = BsonFields::String(doc, "clientid");
+            record.scanid = BsonFields::String(doc, "scanid");
+            record.hdf5filename = BsonFields::String(doc, "hdf5filename");
+            record.cameraid = BsonFields::String(doc, "cameraid");
+            record.session_name = BsonFields::String(doc, "session_name");
+            record.calibration = false;
+            int result[TASK_STAGE_COUNT];
+            for (int s = 0; s < TASK_STAGE_COUNT; ++s) {
+                int64_t value = BsonFields::Int64(doc, TASK_STAGES[s], 0);
+                result[s] = value == 0 ? RESULT_PENDING : value > 0 ? RESULT_DONE : RESULT_FAILED;
+            }
+            if (Insert(record, BsonFields::Int64(doc, "priority", 0), result)) {
+                if (Enqueue(tasks[KeyOf(record)])) {
+                    loaded++;
+                } else {
+                    tasks.erase(KeyOf(record));
+                }
+            }
+        }
+        LOG(INFO) << "Broker: " << loaded << " tasks to do loaded from agdb.tasks";
+    }
+
+    void ExpireLocked(int64_t now) {
+        for (map<uint64_t, Lease>::iterator it = leases.begin(); it != leases.end();) {
+            if (it->second.expires > now) {
+                ++it;
+                continue;
+            }
+            // An expiry is an attempt: a stage that takes its worker down every time
+            // must not be handed out for ever
+            Lease lease = it->second;
+            LOG(WARNING) << "Broker: lease " << it->first << " (" << TASK_STAGES[lease.stage] << " of "
+                    << lease.key.Name() << ", " << lease.worker << ") expired";
+            expired++;
+            it = leases.erase(it);
+
+            map<TaskKey, BrokerTask>::iterator task = tasks.find(lease.key);
+            if (task == tasks.end()) {
+                continue;
+            }
+            if (++task->second.attempts < max_attempts) {
+                task->second.leased = false;
+                queues[lease.stage].insert(QueueKey(task->second.priority, task->first));
+            } else {
+                LOG(WARNING) << "Broker: " << TASK_STAGES[lease.stage] << " of " << lease.key.Name() << " failed after "
+                        << task->second.attempts << " attempts (lease expired)";
+                Finish(lease.key, lease.stage, RESULT_FAILED);
+                failed++;
+            }
+        }
+    }
+
+    json Refuse(const string &message) {
+        refused++;
+        return {{"status", "0"}, {"message", message}};
+    }
+
+    json Grant(const json &request, int64_t now) {
+        vector<int> wanted;
+        if (request.count("stages") && request["stages"].is_array()) {
+            for (size_t i = 0; i < request["stages"].size(); ++i) {
+                int s = request["stages"][i].is_string() ? StageIndex(request["stages"][i].get<string>()) : -1;
+                if (s < 0) {
+                    return Refuse("Unknown stage");
+                }
+                wanted.push_back(s);
+            }
+        } else {
+            for (int s = 0; s < TASK_STAGE_COUNT; ++s) {
+                wanted.push_back(s);
+            }
+        }
+
+        // The lowest priority at the head of any stage asked for
+        int best = -1;
+        for (size_t i = 0; i < wanted.size(); ++i) {
+            int s = wanted[i];
+            if (!queues[s].empty() && (best < 0 || *queues[s].begin() < *queues[best].begin())) {
+                best = s;
+            }
+        }
+        if (best < 0) {
+            return {{"status", "0"}, {"message", "No task"}};
+        }
+
+        TaskKey key = queues[best].begin()->second;
+        queues[best].erase(queues[best].begin());
+        BrokerTask &task = tasks[key];
+        task.leased = true;
+
+        uint64_t id = next_lease++;
+        Lease lease;
+        lease.key = key;
+        lease.stage = best;
+        lease.worker = request.value("worker", string());
+        lease.expires = now + lease_ms * 1000000;
+        leases[id] = lease;
+        granted++;
+
+        return {
+            {"status", "1"},
+            {"lease", id},
+            {"stage", TASK_STAGES[best]},
+            {"lease_ms", lease_ms},
+            {"attempt", task.attempts + 1},
+            {"task", {
+                {"clientid", task.record.clientid},
+                {"scanid", task.record.scanid},
+                {"hdf5filename", task.record.hdf5filename},
+                {"cameraid", task.record.cameraid},
+                {"session_name", task.record.session_name},
+                {"priority", task.priority}
+            }}
+        };
+    }
+
+    json Handle(const json &request) {
+        string action = request.value("action", string());
+        if (action == "status") {
+            return {{"status", "1"}, {"message", TaskBroker::Report()}};
+        }
+
+        int64_t now = LatencyHistogram::Now();
+        lock_guard<mutex> lock(state_mutex);
+        ExpireLocked(now);
+
+        if (action == "lease") {
+            return Grant(request, now);
+        }
+
+        uint64_t id = request.count("lease") && request["lease"].is_number_unsigned() ? request["lease"].get<uint64_t>() : 0;
+        map<uint64_t, Lease>::iterator lease = leases.find(id);
+        if (action != "renew" && action != "done" && action != "fail") {
+            return Refuse("Unknown action");
+        }
+        if (lease == leases.end()) {
+            return Refuse("Unknown or expired lease");
+        }
+
+        if (action == "renew") {
+            lease->second.expires = now + lease_ms * 1000000;
+            renewed++;
+            return {{"status", "1"}, {"lease", id}, {"lease_ms", lease_ms}};
+        }
+
+        Lease finished = lease->second;
+        leases.erase(lease);
+        if (action == "done") {
+            Finish(finished.key, finished.stage, RESULT_DONE);
+            done++;
+            return {{"status", "1"}};
+        }
+
+        BrokerTask &task = tasks[finished.key];
+        task.attempts++;
+        if (request.value("retry", true) && task.attempts < max_attempts) {
+            task.leased = false;
+            queues[finished.stage].insert(QueueKey(task.priority, finished.key));
+            retried++;
+        } else {
+            LOG(WARNING) << "Broker: " << TASK_STAGES[finished.stage] << " of " << finished.key.Name() << " failed after "
+                    << task.attempts << " attempts (" << request.value("message", string("no reason given")) << ")";
+            Finish(finished.key, finished.stage, RESULT_FAILED);
+            failed++;
+        }
+        return {{"status", "1"}};
+    }
+
+    void Serve(zmq::socket_t *socket) {
+        ScopedThreadRole role(ROLE_CONTROL);
+
+        while (running) {
+            zmq::message_t message;
+            bool received = false;
+            try {
+                received = socket->recv(&message);
+            } catch (const zmq::error_t &e) {
+                continue;
+            }
+            if (!received) {
+                // Leases run out even when nobody asks
+                lock_guard<mutex> lock(state_mutex);
+                ExpireLocked(LatencyHistogram::Now());
+                continue;
+            }
+
+            json reply;
+            try {
+                reply = Handle(json::parse(string(static_cast<const char *> (message.data()), message.size())));
+            } catch (const exception &e) {
+                reply = Refuse(string("Bad request: ") + e.what());
+            }
+
+            // A REP socket must answer before it can receive again
+            string text = reply.dump();
+            try {
+                socket->send(text.data(), text.size());
+            } catch (const zmq::error_t &e) {
+                LOG(WARNING) << "Broker: could not reply: " << e.what();
+            }
+        }
+
+        socket->close();
+        delete socket;
+    }
+
+    // One context for the process, alive until exit
+    zmq::context_t &Context() {
+        static zmq::context_t context(1);
+        return context;
+    }
+
+    void Sync() {
+        lock_guard<mutex> syncing(sync_mutex);
+        if (journal_fd >= 0 && dirty.exchange(false)) {
+            fdatasync(journal_fd);
+        }
+    }
+}
+
+namespace TaskBroker {
+
+    bool Start(const string &mongodb_host, const json &config) {
+        if (running || !config.value("enabled", true)) {
+            return false;
+        }
+        host = mongodb_host;
+        endpoint = config.value("endpoint", endpoint);
+        string directory = config.value("dir", string("/data/output/broker/"));
+        if (directory.empty() || directory.back() != '/') {
+            directory += '/';
+        }
+        journal_path = directory + "broker.journal";
+        lease_ms = max<int64_t>(1000, config.value("lease_ms", lease_ms));
+        max_attempts = max(1, config.value("max_attempts", max_attempts));
+        sync_ms = max<int64_t>(1, config.value("sync_ms", sync_ms));
+        bookkeeping_ms = max<int64_t>(10, config.value("bookkeeping_ms", bookkeeping_ms));
+        batch = max<size_t>(1, config.value("batch", batch));
+        compact_bytes = max<int64_t>(1, config.value("compact_mb", compact_bytes >> 20)) << 20;
+
+        AGDUtils::mkdirp(directory.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+
+        struct stat info;
+        if (stat(journal_path.c_str(), &info) == 0) {
+            lock_guard<mutex> lock(state_mutex);
+            Replay();
+        } else if (config.value("seed", true)) {
+            try {
+                Seed();
+            } catch (const exception &e) {
+                LOG(ERROR) << "Broker: could not load tasks from agdb.tasks: " << e.what();
+            }
+        }
+        {
+            lock_guard<mutex> syncing(sync_mutex);
+            lock_guard<mutex> lock(state_mutex);
+            if (!Compact()) {
+                LOG(ERROR) << "Broker: no journal, tasks will not survive a restart";
+            }
+        }
+
+        zmq::socket_t *socket = new zmq::socket_t(Context(), ZMQ_REP);
+        try {
+            int linger = 0, timeout = 100;
+            socket->setsockopt(ZMQ_LINGER, &linger, sizeof (linger));
+            socket->setsockopt(ZMQ_RCVTIMEO, &timeout, sizeof (timeout));
+            socket->bind(endpoint.c_str());
+        } catch (const zmq::error_t &e) {
+            LOG(ERROR) << "Broker: cannot bind " << endpoint << ": " << e.what();
+            delete socket;
+            lock_guard<mutex> syncing(sync_mutex);
+            if (journal_fd >= 0) {
+                close(journal_fd);
+                journal_fd = -1;
+            }
+            return false;
+        }
+
+        running = true;
+        server = thread(Serve, socket);
+        jobs.push_back(Scheduler::Every(sync_ms, "broker sync", []() {
+            Sync();
+        }));
+        jobs.push_back(Scheduler::Every(bookkeeping_ms, "broker bookkeeping", []() {
+            Bookkeep();
+        }, Scheduler::LANE_DATABASE));
+        LOG(INFO) << "Task broker on " << endpoint;
+        return true;
+    }
+
+    void Stop() {
+        if (!running.exchange(false)) {
+            return;
+        }
+        server.join();
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            Scheduler::Cancel(jobs[i]);
+        }
+        jobs.clear();
+
+        Bookkeep();
+        Sync();
+
+        lock_guard<mutex> syncing(sync_mutex);
+        lock_guard<mutex> lock(state_mutex);
+        if (!unbooked.empty()) {
+            LOG(WARNING) << "Broker: " << unbooked.size() << " stage results left in " << journal_path << " for the next start";
+        }
+        if (journal_fd >= 0) {
+            close(journal_fd);
+            journal_fd = -1;
+        }
+    }
+
+    void Offer(const vector<TaskRecord> &records, const vector<int64_t> &priorities) {
+        if (!running.load(memory_order_relaxed)) {
+            return;
+        }
+        const int pending[TASK_STAGE_COUNT] = {RESULT_PENDING, RESULT_PENDING, RESULT_PENDING, RESULT_PENDING};
+
+        lock_guard<mutex> lock(state_mutex);
+        for (size_t i = 0; i < records.size() && i < priorities.size(); ++i) {
+            // Finished here, its results still on the way to the database
+            TaskKey key = KeyOf(records[i]);
+            map<ResultKey, int>::const_iterator result = unbooked.lower_bound(ResultKey(key, 0));
+            if (result != unbooked.end() && result->first.first == key) {
+                continue;
+            }
+            if (Insert(records[i], priorities[i], pending)) {
+                const BrokerTask &task = tasks[key];
+                Append(TaskLine(task));
+                Enqueue(task);
+                offered++;
+            }
+        }
+    }
+
+    void Bookkeep() {
+        lock_guard<mutex> bookkeeping(bookkeep_mutex);
+
+        while (true) {
+            map<ResultKey, int> results;
+            {
+                lock_guard<mutex> lock(state_mutex);
+                for (map<ResultKey, int>::const_iterator it = unbooked.begin(); it != unbooked.end() && results.size() < batch; ++it) {
+                    results.insert(*it);
+                }
+            }
+            if (results.empty()) {
+                break;
+            }
+
+            try {
+                mongocxx::bulk_write bulk{mongocxx::options::bulk_write{}.ordered(false)};
+                for (map<ResultKey, int>::const_iterator it = results.begin(); it != results.end(); ++it) {
+                    bulk.append(mongocxx::model::update_one{
+                        make_document(kvp("scanid", it->first.first.scanid),
+                                kvp("cameraid", it->first.first.cameraid),
+                                kvp("hdf5filename", it->first.first.file)),
+                        make_document(kvp("$set", make_document(kvp(TASK_STAGES[it->first.second], it->second))))
+                    });
+                }
+                Database()["tasks"].bulk_write(bulk);
+            } catch (const exception &e) {
+                bookkeep_failures++;
+                LOG(WARNING) << "Broker: " << results.size() << " stage results wait for the database: " << e.what();
+                return;
+            }
+
+            // Unless a newer result came in meanwhile
+            lock_guard<mutex> lock(state_mutex);
+            for (map<ResultKey, int>::const_iterator it = results.begin(); it != results.end(); ++it) {
+                map<ResultKey, int>::iterator entry = unbooked.find(it->first);
+                if (entry != unbooked.end() && entry->second == it->second) {
+                    unbooked.erase(entry);
+                    booked++;
+                }
+            }
+        }
+
+        // Finished tasks and booked results leave the journal
+        lock_guard<mutex> syncing(sync_mutex);
+        lock_guard<mutex> lock(state_mutex);
+        if (journal_bytes > compact_bytes || journal_broken) {
+            Compact();
+        }
+    }
+
+    json Report() {
+        lock_guard<mutex> lock(state_mutex);
+        json queued = json::object();
+        for (int s = 0; s < TASK_STAGE_COUNT; ++s) {
+            queued[TASK_STAGES[s]] = queues[s].size();
+        }
+        return {
+            {"enabled", running.load()},
+            {"endpoint", endpoint},
+            {"tasks", tasks.size()},
+            {"queued", queued},
+            {"leased", leases.size()},
+            {"offered", offered.load()},
+            {"granted", granted.load()},
+            {"renewed", renewed.load()},
+            {"expired", expired.load()},
+            {"done", done.load()},
+            {"retried", retried.load()},
+            {"failed", failed.load()},
+            {"refused", refused.load()},
+            {"unbooked", unbooked.size()},
+            {"booked", booked.load()},
+            {"bookkeeping_failures", bookkeep_failures.load()},
+            {"journal_mb", journal_bytes / 1e6},
+            {"compactions", compactions.load()}
+        };
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * File:   TaskBroker.h
+ * Author: agridata
+ *
+ * Hands processing work to workers from memory instead of from agdb.tasks sort
+ * queries. Every task TaskRegistry registers (see TaskRegistry.h) is offered here
+ * with its priority; the broker keeps, per stage, the tasks whose next stage it is,
+ * lowest priority first (the order workers have always taken them in). Stages run in
+ * order for each task:
+ *
+ *   preprocess, trunk_detection, process, shape_analysis_per_archive
+ *
+ * Workers lease a stage of a task on a ZMQ REP socket ("broker" in
+ * config/daemon.json, port 4995 by default), one JSON request per message:
+ *
+ *   {"action": "lease", "worker": "gpu-1", "stages": ["preprocess", ...]}
+ *       -> {"status": "1", "lease": 17, "stage": "preprocess", "lease_ms": 300000,
+ *           "task": {"clientid", "scanid", "hdf5filename", "cameraid",
+ *                    "session_name", "priority"}}
+ *       or {"status": "0", "message": "No task"}      (stages: all if left out)
+ *   {"action": "renew", "lease": 17}                  -> {"status": "1", ...}
+ *   {"action": "done", "lease": 17}                   -> {"status": "1"}
+ *   {"action": "fail", "lease": 17, "retry": true}    -> {"status": "1"}
+ *   {"action": "status"}                              -> Report()
+ *
+ * A lease not renewed or finished within lease_ms expires and its stage goes back to
+ * the queue; that counts as an attempt. A stage that fails or expires max_attempts
+ * times, or fails with "retry": false, is failed and the task gets no further
+ * stages. Leases do not survive a restart; their stages are handed out again and
+ * done or fail for them is refused.
+ *
+ * Stage results go to agdb.tasks in the background (1 done, -1 failed, $set on the
+ * task by scanid, cameraid and hdf5filename, every bookkeeping_ms), so tools that
+ * read the collection still see them. The broker's own state is journaled to
+ * <dir>/broker.journal, one JSON line per task added and per stage result, and
+ * rewritten (compacted) when it grows past compact_mb or at startup, when it is
+ * replayed. Results not yet in the database are kept in the journal until they are.
+ * On the very first start (no journal) the tasks in agdb.tasks with a stage still to
+ * do are loaded.
+ */
+
+#ifndef TASKBROKER_H
+#define TASKBROKER_H
+
+// Standard
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// AgriData
+#include "TaskRegistry.h"
+
+// Utilities
+#include "json.hpp"
+
+namespace TaskBroker {
+
+    // The "broker" block of config/daemon.json. Replays the journal, binds the socket
+    // and schedules the bookkeeping; call after TaskRegistry::Start.
+    bool Start(const std::string &mongodb_host, const nlohmann::json &config);
+
+    // Closes the socket, writes what results it can to the database and syncs the
+    // journal; call after TaskRegistry::Stop, which may still offer tasks
+    void Stop();
+
+    // Newly registered tasks and their priorities (TaskRegistry); tasks already known,
+    // tasks whose results are not in the database yet and calibration tasks are
+    // ignored. Does nothing unless started.
+    void Offer(const std::vector<TaskRecord> &tasks, const std::vector<int64_t> &priorities);
+
+    // Stage results to agdb.tasks; results that fail stay for the next try
+    void Bookkeep();
+
+    // Tasks, queued and leased stages, leases granted, expired and finished
+    nlohmann::json Report();
+}
+
+#endif /* TASKBROKER_H */
@@ -0,0 +1,387 @@
+/*
+ * File:   TaskRegistry.cpp
+ * Author: agridata
+ */
+
+#include "TaskRegistry.h"
+
+// AgriData
+#include "BsonFields.h"
+#include "MetadataJournal.h"
+#include "TaskBroker.h"
+#include "Scheduler.h"
+
+// Standard
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// MongoDB
+#include <bsoncxx/builder/basic/array.hpp>
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/types.hpp>
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/client.hpp>
+#include <mongocxx/model/update_one.hpp>
+#include <mongocxx/options/bulk_write.hpp>
+#include <mongocxx/options/find.hpp>
+#include <mongocxx/options/find_one_and_update.hpp>
+#include <mongocxx/options/update.hpp>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+using bsoncxx::builder::basic::kvp;
+using bsoncxx::builder::basic::make_document;
+
+namespace {
+
+    const char * COUNTER_ID = "task_priority";
+
+    struct PendingTask {
+        TaskRecord task;
+        int64_t priority;           // -1 until taken from the counter
+    };
+
+    string host = "mongodb://localhost:27017";
+    int64_t flush_ms = 1000;
+    size_t batch = 100;
+
+    mutex pending_mutex;
+    vector<PendingTask> pending;
+
+    // Only Flush uses the connection
+    mutex flush_mutex;
+    unique_ptr<mongocxx::client> conn;
+    Scheduler::JobId job = 0;
+    bool started = false;
+
+    atomic<uint64_t> registered(0);
+    atomic<uint64_t> failed(0);
+    atomic<int64_t> last_priority(-1);
+
+    mongocxx::database Database() {
+        if (!conn) {
+            conn.reset(new mongocxx::client(mongocxx::uri{host}));
+        }
+        return (*conn)["agdb"];
+    }
+
+    /**
+     * Seed
+     *
+     * Raises the counter to the highest priority in the collection ($max, so a
+     * counter already ahead is left alone). The index on priority keeps this cheap
+     * (see DatabaseIndexes.h).
+     */
+    void Seed() {
+        mongocxx::database db = Database();
+        mongocxx::collection tasks = db["tasks"];
+
+        mongocxx::options::find opts{};
+        opts.sort(make_document(kvp("priority", -1)));
+        opts.projection(make_document(kvp("priority", 1)));
+        bsoncxx::stdx::optional<bsoncxx::document::value> highest = tasks.find_one({}, opts);
+
+        int64_t current = 0;
+        if (highest) {
+            current = BsonFields::Int64(highest->view(), "priority");
+        }
+
+        mongocxx::options::update upsert{};
+        upsert.upsert(true);
+        db["counters"].update_one(make_document(kvp("_id", COUNTER_ID)),
+                make_document(kvp("$max", make_document(kvp("value", bsoncxx::types::b_int64{current})))),
+                upsert);
+    }
+
+    /**
+     * Allocate
+     *
+     * Takes count priorities from the counter in one round trip; returns the first
+     */
+    int64_t Allocate(int64_t count) {
+        mongocxx::options::find_one_and_update opts{};
+        opts.upsert(true);
+        opts.return_document(mongocxx::options::return_document::k_after);
+
+        bsoncxx::stdx::optional<bsoncxx::document::value> counter = Database()["counters"].find_one_and_update(
+                make_document(kvp("_id", COUNTER_ID)),
+                make_document(kvp("$inc", make_document(kvp("value", bsoncxx::types::b_int64{count})))),
+                opts);
+        if (!counter) {
+            throw runtime_error("task priority counter missing");
+        }
+        int64_t value = BsonFields::Int64(counter->view(), "value");
+        last_priority = value;
+        return value - count + 1;
+    }
+
+    // Same fields, in the same order, as tasks have always had
+    bsoncxx::document::value Document(const PendingTask &pending) {
+        const TaskRecord &task = pending.task;
+        bsoncxx::builder::basic::document builder{};
+
+        builder.append(kvp("clientid", task.clientid));
+        builder.append(kvp("scanid", task.scanid));
+        builder.append(kvp("hdf5filename", task.hdf5filename));
+        builder.append(kvp("cameraid", task.cameraid));
+        builder.append(kvp("session_name", task.session_name));
+        builder.append(kvp("cluster_detection", 0));
+
+        if (!task.calibration) {
+            builder.append(kvp("preprocess", 0));
+            builder.append(kvp("trunk_detection", 0));
+            builder.append(kvp("process", 0));
+            builder.append(kvp("shape_analysis_per_archive", 0));
+        }
+
+        builder.append(kvp("priority", (int) pending.priority));
+        return builder.extract();
+    }
+
+    // File names are unique only within a recording's directory (see OutputLayout.h)
+    bsoncxx::document::value Key(const TaskRecord &task) {
+        return make_document(kvp("scanid", task.scanid), kvp("cameraid", task.cameraid),
+                kvp("hdf5filename", task.hdf5filename));
+    }
+
+    /**
+     * Claim
+     *
+     * Tasks that matched an existing document were registered before: a journal entry
+     * replayed twice, a file recovered again, or a batch whose failed attempt had
+     * inserted them. Only those with no stage started yet are still work, at the
+     * priority they were given then; the broker refuses any it has seen finish.
+     */
+    void Claim(vector<PendingTask> &tasks, vector<bool> &inserted) {
+        bsoncxx::builder::basic::array keys;
+        bool any = false;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            if (!inserted[i] && !tasks[i].task.calibration) {
+                keys.append(Key(tasks[i].task));
+                any = true;
+            }
+        }
+        if (!any) {
+            return;
+        }
+
+        mongocxx::cursor cursor = Database()["tasks"].find(make_document(kvp("$or", keys.extract())));
+        for (const bsoncxx::document::view &doc : cursor) {
+            bool untouched = true;
+            for (const char * stage : {"preprocess", "trunk_detection", "process", "shape_analysis_per_archive"}) {
+                untouched = untouched && doc[stage] && BsonFields::Int64(doc, stage, -1) == 0;
+            }
+            if (!untouched) {
+                continue;
+            }
+            string scanid = BsonFields::String(doc, "scanid");
+            string cameraid = BsonFields::String(doc, "cameraid");
+            string file = BsonFields::String(doc, "hdf5filename");
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                const TaskRecord &task = tasks[i].task;
+                if (!inserted[i] && !task.calibration && task.hdf5filename == file
+                        && task.scanid == scanid && task.cameraid == cameraid) {
+                    tasks[i].priority = BsonFields::Int64(doc, "priority", tasks[i].priority);
+                    inserted[i] = true;
+                }
+            }
+        }
+    }
+
+    /**
+     * Insert
+     *
+     * Takes priorities for the tasks that have none yet, then upserts them all by scan,
+     * camera and file name, so a batch retried after a partial failure does not
+     * register a file twice.
+     * Call with flush_mutex held.
+     */
+    void Insert(vector<PendingTask> &tasks) {
+        int64_t unassigned = 0;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            unassigned += tasks[i].priority < 0;
+        }
+        if (unassigned > 0) {
+            int64_t next = Allocate(unassigned);
+            for (size_t i = 0; i < tasks.size(); ++i) {
+                if (tasks[i].priority < 0) {
+                    tasks[i].priority = next++;
+                }
+            }
+        }
+
+        mongocxx::bulk_write bulk{mongocxx::options::bulk_write{}.ordered(false)};
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            mongocxx::model::update_one upsert{
+                Key(tasks[i].task),
+                make_document(kvp("$setOnInsert", Document(tasks[i])))
+            };
+            upsert.upsert(true);
+            bulk.append(upsert);
+        }
+        bsoncxx::stdx::optional<mongocxx::result::bulk_write> result = Database()["tasks"].bulk_write(bulk);
+        registered += tasks.size();
+
+        // Tasks that matched an existing one may long be done; see Claim
+        vector<bool> inserted(tasks.size(), false);
+        if (result) {
+            mongocxx::result::bulk_write::id_map upserted = result->upserted_ids();
+            for (mongocxx::result::bulk_write::id_map::const_iterator it = upserted.begin(); it != upserted.end(); ++it) {
+                if ((size_t) it->first < tasks.size()) {
+                    inserted[it->first] = true;
+                }
+            }
+        }
+        Claim(tasks, inserted);
+
+        vector<TaskRecord> records;
+        vector<int64_t> priorities;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            if (inserted[i]) {
+                records.push_back(tasks[i].task);
+                priorities.push_back(tasks[i].priority);
+            }
+        }
+        TaskBroker::Offer(records, priorities);
+    }
+
+    PendingTask Unassigned(const TaskRecord &task) {
+        PendingTask entry;
+        entry.task = task;
+        entry.priority = task.calibration ? 0 : -1;
+        return entry;
+    }
+}
+
+namespace TaskRegistry {
+
+    void Start(const string &mongodb_host, const json &config) {
+        lock_guard<mutex> flushing(flush_mutex);
+        if (started) {
+            return;
+        }
+        host = mongodb_host;
+        flush_ms = max<int64_t>(10, config.value("flush_ms", flush_ms));
+        batch = max<size_t>(1, config.value("batch", batch));
+
+        try {
+            Seed();
+        } catch (const exception &e) {
+            LOG(ERROR) << "Could not prepare task priorities: " << e.what();
+        }
+
+        job = Scheduler::Every(flush_ms, "tasks", []() {
+            Flush();
+        }, Scheduler::LANE_DATABASE);
+        started = true;
+    }
+
+    void Stop() {
+        Scheduler::JobId id;
+        {
+            lock_guard<mutex> flushing(flush_mutex);
+            id = job;
+            job = 0;
+            started = false;
+        }
+        if (id != 0) {
+            Scheduler::Cancel(id);
+        }
+        Flush();
+
+        lock_guard<mutex> lock(pending_mutex);
+        if (!pending.empty()) {
+            LOG(ERROR) << pending.size() << " tasks could not be registered";
+        }
+    }
+
+    void Add(const TaskRecord &task) {
+        if (MetadataJournal::Append(JOURNAL_TASK, ToDocument(task))) {
+            return;
+        }
+
+        lock_guard<mutex> lock(pending_mutex);
+        pending.push_back(Unassigned(task));
+    }
+
+    void Register(const vector<TaskRecord> &tasks) {
+        vector<PendingTask> entries;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            entries.push_back(Unassigned(tasks[i]));
+        }
+
+        lock_guard<mutex> flushing(flush_mutex);
+        Insert(entries);
+    }
+
+    bsoncxx::document::value ToDocument(const TaskRecord &task) {
+        bsoncxx::builder::basic::document doc{};
+        doc.append(kvp("clientid", task.clientid));
+        doc.append(kvp("scanid", task.scanid));
+        doc.append(kvp("hdf5filename", task.hdf5filename));
+        doc.append(kvp("cameraid", task.cameraid));
+        doc.append(kvp("session_name", task.session_name));
+        doc.append(kvp("calibration", task.calibration));
+        return doc.extract();
+    }
+
+    TaskRecord FromDocument(bsoncxx::document::view doc) {
+        TaskRecord task;
+        task.clientid = BsonFields::String(doc, "clientid");
+        task.scanid = BsonFields::String(doc, "scanid");
+        task.hdf5filename = BsonFields::String(doc, "hdf5filename");
+        task.cameraid = BsonFields::String(doc, "cameraid");
+        task.session_name = BsonFields::String(doc, "session_name");
+        task.calibration = BsonFields::Bool(doc, "calibration");
+        return task;
+    }
+
+    void Flush() {
+        lock_guard<mutex> flushing(flush_mutex);
+
+        while (true) {
+            vector<PendingTask> tasks;
+            {
+                lock_guard<mutex> lock(pending_mutex);
+                size_t n = min(batch, pending.size());
+                tasks.assign(pending.begin(), pending.begin() + n);
+                pending.erase(pending.begin(), pending.begin() + n);
+            }
+            if (tasks.empty()) {
+                return;
+            }
+
+            try {
+                Insert(tasks);
+            } catch (const exception &e) {
+                LOG(ERROR) << "Could not register " << tasks.size() << " tasks: " << e.what();
+                failed++;
+
+                // Back to the front, keeping any priorities already taken
+                lock_guard<mutex> lock(pending_mutex);
+                pending.insert(pending.begin(), tasks.begin(), tasks.end());
+                return;
+            }
+        }
+    }
+
+    json Report() {
+        size_t waiting;
+        {
+            lock_guard<mutex> lock(pending_mutex);
+            waiting = pending.size();
+        }
+        return {
+            {"pending", waiting},
+            {"registered", registered.load()},
+            {"failed_batches", failed.load()},
+            {"last_priority", last_priority.load()}
+        };
+    }
+}
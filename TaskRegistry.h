@@ -0,0 +1,74 @@
+/*
+ * File:   TaskRegistry.h
+ * Author: agridata
+ *
+ * Registers the processing task of every closed HDF5 file, for all cameras. Cameras
+ * hand their tasks over and return. While a scan is journaled the tasks go through
+ * the journal (see MetadataJournal.h); otherwise a scheduler job inserts them in
+ * batches.
+ *
+ * Priorities come from one counter document in agdb.counters
+ * ({_id: "task_priority", value: n}), taken a batch at a time with a single
+ * findAndModify $inc, so that cameras closing files at the same moment (or several
+ * daemons on one database) never hand out the same priority. Start seeds the counter
+ * from the highest priority already in agdb.tasks. Calibration tasks keep priority 0
+ * and take nothing from the counter.
+ *
+ * Anything else that creates tasks must take its priorities from the counter too;
+ * reading the highest priority and adding one would race with it.
+ *
+ * Once in the database, tasks are offered to the broker (see TaskBroker.h), which
+ * hands their stages to workers.
+ */
+
+#ifndef TASKREGISTRY_H
+#define TASKREGISTRY_H
+
+// Standard
+#include <string>
+#include <vector>
+
+// MongoDB
+#include <bsoncxx/document/value.hpp>
+#include <bsoncxx/document/view.hpp>
+
+// Utilities
+#include "json.hpp"
+
+struct TaskRecord {
+    std::string clientid;
+    std::string scanid;
+    std::string hdf5filename;
+    std::string cameraid;
+    std::string session_name;
+    bool calibration;
+};
+
+namespace TaskRegistry {
+
+    // The "tasks" block of config/daemon.json
+    void Start(const std::string &mongodb_host, const nlohmann::json &config);
+
+    // Inserts what is left, synchronously
+    void Stop();
+
+    // Never blocks on the database. Goes to the scan's journal if one is open (see
+    // MetadataJournal.h), else is kept here until the next flush.
+    void Add(const TaskRecord &task);
+
+    // Registers tasks now (the journal replayer); throws if the database fails
+    void Register(const std::vector<TaskRecord> &tasks);
+
+    // How a task is journaled
+    bsoncxx::document::value ToDocument(const TaskRecord &task);
+    TaskRecord FromDocument(bsoncxx::document::view document);
+
+    // Takes priorities and inserts everything pending; tasks that fail stay pending
+    // with their priority for the next try
+    void Flush();
+
+    // Pending, registered, failed batches and the last priority handed out
+    nlohmann::json Report();
+}
+
+#endif /* TASKREGISTRY_H */
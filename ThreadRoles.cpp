@@ -0,0 +1,249 @@
+/*
+ * File:   ThreadRoles.cpp
+ * Author: agridata
+ */
+
+#include "ThreadRoles.h"
+
+// Standard
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// System
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+    const char * ROLE_NAMES[ROLE_COUNT] = {"grab", "write", "control"};
+
+    struct Counters {
+        Counters() : threads(0), voluntary(0), involuntary(0) {}
+        long threads;
+        long voluntary;
+        long involuntary;
+    };
+
+    // A thread inside a role, with its switch counts when it entered it
+    struct LiveThread {
+        ThreadRole role;
+        Counters entered;
+    };
+
+    // Configuration, and the threads currently inside a role
+    mutex registry_mutex;
+    json settings = json::object();
+    map<pid_t, LiveThread> live;
+    Counters exited[ROLE_COUNT];
+
+    // The role of the calling thread
+    thread_local bool has_role = false;
+    thread_local ThreadRole current_role;
+
+    // Affinity of the process at startup; roles without "cpus" get this back rather
+    // than whatever they inherited from the thread that started them
+    cpu_set_t process_cpus;
+
+    pid_t thread_id() {
+        return (pid_t) syscall(SYS_gettid);
+    }
+
+    /**
+     * Resolve
+     *
+     * Camera-specific settings for a role win over the role's defaults
+     */
+    json Resolve(ThreadRole role, const string &serialnumber) {
+        const char * name = ROLE_NAMES[role];
+        json resolved = settings.value(name, json::object());
+
+        if (!serialnumber.empty() && settings.count("cameras")
+                && settings["cameras"].count(serialnumber)
+                && settings["cameras"][serialnumber].count(name)) {
+            json overrides = settings["cameras"][serialnumber][name];
+            for (json::iterator it = overrides.begin(); it != overrides.end(); ++it) {
+                resolved[it.key()] = it.value();
+            }
+        }
+        return resolved;
+    }
+
+    /**
+     * ReadSwitches
+     *
+     * Context switch counts of a live thread from /proc
+     */
+    void ReadSwitches(pid_t tid, Counters &counters) {
+        ifstream status("/proc/self/task/" + to_string(tid) + "/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, 24, "voluntary_ctxt_switches:") == 0) {
+                counters.voluntary += stol(line.substr(24));
+            } else if (line.compare(0, 27, "nonvoluntary_ctxt_switches:") == 0) {
+                counters.involuntary += stol(line.substr(27));
+            }
+        }
+    }
+}
+
+namespace ThreadRoles {
+
+    /**
+     * Configure
+     *
+     * Takes the "threads" block of the daemon configuration, e.g.
+     *   "grab": {"cpus": [1, 2], "policy": "fifo", "priority": 50},
+     *   "write": {"cpus": [0, 3], "nice": 10},
+     *   "cameras": {"22386484": {"grab": {"cpus": [2]}}}
+     * Roles without an entry keep the default scheduling.
+     */
+    void Configure(const json &config) {
+        lock_guard<mutex> lock(registry_mutex);
+        settings = config.is_object() ? config : json::object();
+        sched_getaffinity(0, sizeof (process_cpus), &process_cpus);
+    }
+
+    /**
+     * Enter
+     *
+     * Applies the role's affinity and scheduling to the calling thread and starts
+     * counting it under the role. Threads inherit all of this from their creator, so
+     * anything the role does not configure is reset to the default. Failures (e.g.
+     * SCHED_FIFO without CAP_SYS_NICE) are logged and the thread runs with default
+     * scheduling.
+     */
+    void Enter(ThreadRole role, const string &serialnumber) {
+        if (has_role) {
+            Leave();
+        }
+
+        // Switches from before are not the role's
+        struct rusage usage;
+        getrusage(RUSAGE_THREAD, &usage);
+        LiveThread thread;
+        thread.role = role;
+        thread.entered.voluntary = usage.ru_nvcsw;
+        thread.entered.involuntary = usage.ru_nivcsw;
+
+        json resolved;
+        pid_t tid = thread_id();
+        {
+            lock_guard<mutex> lock(registry_mutex);
+            resolved = Resolve(role, serialnumber);
+            live[tid] = thread;
+        }
+        has_role = true;
+        current_role = role;
+
+        // Affinity
+        if (CPU_COUNT(&process_cpus) == 0) {
+            sched_getaffinity(0, sizeof (process_cpus), &process_cpus);
+        }
+        cpu_set_t cpus = process_cpus;
+        if (resolved.count("cpus") && resolved["cpus"].is_array() && !resolved["cpus"].empty()) {
+            CPU_ZERO(&cpus);
+            for (size_t i = 0; i < resolved["cpus"].size(); ++i) {
+                CPU_SET(resolved["cpus"][i].get<int>(), &cpus);
+            }
+        }
+        int err = pthread_setaffinity_np(pthread_self(), sizeof (cpus), &cpus);
+        if (err != 0) {
+            LOG(WARNING) << "Could not pin " << ROLE_NAMES[role] << " thread: " << strerror(err);
+        }
+
+        // Scheduling policy
+        struct sched_param param;
+        param.sched_priority = 0;
+        if (resolved.value("policy", string("other")) == "fifo") {
+            param.sched_priority = resolved.value("priority", 1);
+            err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (err == 0) {
+                return;
+            }
+            LOG(WARNING) << "SCHED_FIFO not permitted for " << ROLE_NAMES[role]
+                    << " thread (" << strerror(err) << "), using default scheduling";
+            param.sched_priority = 0;
+        }
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+
+        // On Linux, nice applies to the thread id
+        if (setpriority(PRIO_PROCESS, tid, resolved.value("nice", 0)) != 0) {
+            LOG(WARNING) << "Could not set nice for " << ROLE_NAMES[role] << " thread: " << strerror(errno);
+        }
+    }
+
+    /**
+     * Leave
+     *
+     * Stops counting the calling thread; what it accumulated in the role is kept
+     */
+    void Leave() {
+        if (!has_role) {
+            return;
+        }
+
+        struct rusage usage;
+        getrusage(RUSAGE_THREAD, &usage);
+
+        lock_guard<mutex> lock(registry_mutex);
+        map<pid_t, LiveThread>::iterator it = live.find(thread_id());
+        if (it != live.end()) {
+            exited[current_role].voluntary += usage.ru_nvcsw - it->second.entered.voluntary;
+            exited[current_role].involuntary += usage.ru_nivcsw - it->second.entered.involuntary;
+            live.erase(it);
+        }
+        has_role = false;
+    }
+
+    /**
+     * Report
+     *
+     * Per role: live threads and context switches (including exited threads)
+     */
+    json Report() {
+        Counters totals[ROLE_COUNT];
+        {
+            lock_guard<mutex> lock(registry_mutex);
+            for (int r = 0; r < ROLE_COUNT; ++r) {
+                totals[r] = exited[r];
+            }
+            for (map<pid_t, LiveThread>::const_iterator it = live.begin(); it != live.end(); ++it) {
+                Counters &total = totals[it->second.role];
+                Counters now;
+                ReadSwitches(it->first, now);
+                total.threads++;
+                total.voluntary += now.voluntary - it->second.entered.voluntary;
+                total.involuntary += now.involuntary - it->second.entered.involuntary;
+            }
+        }
+
+        json report;
+        for (int r = 0; r < ROLE_COUNT; ++r) {
+            report[ROLE_NAMES[r]] = {
+                {"threads", totals[r].threads},
+                {"voluntary_switches", totals[r].voluntary},
+                {"involuntary_switches", totals[r].involuntary}
+            };
+        }
+        return report;
+    }
+
+    const char * Name(ThreadRole role) {
+        return ROLE_NAMES[role];
+    }
+}
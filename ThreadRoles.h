@@ -0,0 +1,58 @@
+/*
+ * File:   ThreadRoles.h
+ * Author: agridata
+ *
+ * Every thread the daemon starts declares what it is for (grabbing, writing and
+ * other background work, control). Each role can be pinned to a set of CPUs and given a
+ * scheduling policy / priority from the "threads" block of config/daemon.json, with
+ * per-camera overrides for the grab threads. On the Jetson this keeps the grab
+ * threads on their own cores instead of wherever the scheduler puts them.
+ *
+ * Context switches are counted per role so that the status shows whether a role is
+ * being pre-empted (involuntary) or is just waiting (voluntary). A thread counts
+ * toward a role only for the switches it made while in it.
+ */
+
+#ifndef THREADROLES_H
+#define THREADROLES_H
+
+#include <string>
+
+#include "json.hpp"
+
+enum ThreadRole {
+    ROLE_GRAB,
+    ROLE_WRITE,
+    ROLE_CONTROL,
+    ROLE_COUNT
+};
+
+namespace ThreadRoles {
+    void Configure(const nlohmann::json &config);
+    void Enter(ThreadRole role, const std::string &serialnumber = "");
+    void Leave();
+    nlohmann::json Report();
+    const char * Name(ThreadRole role);
+}
+
+/**
+ * ScopedThreadRole
+ *
+ * Enter() for the lifetime of a thread function, Leave() however it exits
+ */
+class ScopedThreadRole {
+public:
+    explicit ScopedThreadRole(ThreadRole role, const std::string &serialnumber = "") {
+        ThreadRoles::Enter(role, serialnumber);
+    }
+
+    ~ScopedThreadRole() {
+        ThreadRoles::Leave();
+    }
+
+private:
+    ScopedThreadRole(const ScopedThreadRole &);
+    ScopedThreadRole &operator=(const ScopedThreadRole &);
+};
+
+#endif /* THREADROLES_H */
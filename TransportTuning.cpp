@@ -0,0 +1,67 @@
+/*
+ * File:   TransportTuning.cpp
+ * Author: agridata
+ */
+
+#include "TransportTuning.h"
+
+// Pylon
+#include <pylon/PylonIncludes.h>
+
+// GenApi
+#include <GenApi/GenApi.h>
+
+// Logging
+#include "easylogging++.h"
+
+using namespace Pylon;
+using namespace GenApi;
+
+/**
+ * SetInteger
+ *
+ * Writes an integer node if it exists and is writable, clamped and aligned to what
+ * the node accepts. Missing nodes are not an error; not every model has every node.
+ */
+void SetInteger(INodeMap &nodeMap, const char * name, int64_t value) {
+    CIntegerPtr node(nodeMap.GetNode(name));
+    if (!IsWritable(node)) {
+        LOG(WARNING) << "Skipping " << name << " parameter";
+        return;
+    }
+
+    int64_t inc = node->GetInc();
+    if (value < node->GetMin()) value = node->GetMin();
+    if (value > node->GetMax()) value = node->GetMax();
+    if (inc > 1) value -= (value - node->GetMin()) % inc;
+
+    node->SetValue(value);
+    LOG(INFO) << name << " : " << node->GetValue();
+}
+
+/**
+ * TuneTransport (USB3)
+ */
+void TuneTransport(CInstantCamera &camera, const UsbTransport &settings) {
+    INodeMap &streamMap = camera.GetStreamGrabberNodeMap();
+
+    camera.MaxNumBuffer.SetValue(settings.max_num_buffer);
+    LOG(INFO) << "MaxNumBuffer : " << settings.max_num_buffer;
+
+    SetInteger(streamMap, "MaxTransferSize", settings.max_transfer_size);
+    SetInteger(streamMap, "NumMaxQueuedUrbs", settings.num_max_queued_urbs);
+}
+
+/**
+ * TuneTransport (GigE)
+ */
+void TuneTransport(CInstantCamera &camera, const GigETransport &settings) {
+    INodeMap &nodeMap = camera.GetNodeMap();
+    INodeMap &streamMap = camera.GetStreamGrabberNodeMap();
+
+    camera.MaxNumBuffer.SetValue(settings.max_num_buffer);
+    LOG(INFO) << "MaxNumBuffer : " << settings.max_num_buffer;
+
+    SetInteger(nodeMap, "GevSCPSPacketSize", settings.packet_size);
+    SetInteger(streamMap, "SocketBufferSize", settings.socket_buffer_kb);
+}
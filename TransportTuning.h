@@ -0,0 +1,94 @@
+/*
+ * File:   TransportTuning.h
+ * Author: agridata
+ *
+ * Transport-specific settings applied once the .pfs has been loaded and before
+ * grabbing starts (stream grabber parameters are locked while grabbing). The GigE
+ * settings used to be applied to every camera, USB included; now each transport only
+ * gets its own.
+ */
+
+#ifndef TRANSPORTTUNING_H
+#define TRANSPORTTUNING_H
+
+// Standard
+#include <stdint.h>
+
+// Pylon
+#include <pylon/PylonIncludes.h>
+
+// GenApi
+#include <GenApi/GenApi.h>
+
+/**
+ * UsbTransport
+ *
+ * USB3 Vision: large transfers and enough buffers to ride out a slow frame at
+ * 155 fps. The total must fit in usbfs_memory_mb.
+ */
+struct UsbTransport {
+    UsbTransport() :
+    max_transfer_size(1048576),
+    max_num_buffer(20),
+    num_max_queued_urbs(64) {
+    }
+
+    int64_t max_transfer_size;      // bytes per USB transfer
+    int64_t max_num_buffer;         // frame buffers owned by the instant camera
+    int64_t num_max_queued_urbs;    // transfers in flight
+};
+
+/**
+ * GigETransport
+ *
+ * GigE Vision: jumbo packets (as in acA1920-40gc.pfs) and a socket buffer large
+ * enough to hold a whole frame. The inter-packet delay depends on the other cameras
+ * on the link and is set by the BandwidthPlanner once every camera is initialized.
+ */
+struct GigETransport {
+    GigETransport() :
+    packet_size(9000),
+    max_num_buffer(16),
+    socket_buffer_kb(2048) {
+    }
+
+    int64_t packet_size;                // bytes, GevSCPSPacketSize (the planner's upper bound)
+    int64_t max_num_buffer;
+    int64_t socket_buffer_kb;
+};
+
+void SetInteger(GenApi::INodeMap &nodeMap, const char * name, int64_t value);
+void TuneTransport(Pylon::CInstantCamera &camera, const UsbTransport &settings);
+void TuneTransport(Pylon::CInstantCamera &camera, const GigETransport &settings);
+
+/**
+ * Stream grabber statistics
+ *
+ * The names differ per transport; these are the ones worth logging with the status
+ */
+inline const char * const * UsbStreamStatistics() {
+    static const char * const names[] = {
+        "Statistic_Total_Buffer_Count",
+        "Statistic_Failed_Buffer_Count",
+        "Statistic_Buffer_Underrun_Count",
+        "Statistic_Missed_Frame_Count",
+        "Statistic_Resynchronization_Count",
+        NULL
+    };
+    return names;
+}
+
+inline const char * const * GigEStreamStatistics() {
+    static const char * const names[] = {
+        "Statistic_Total_Buffer_Count",
+        "Statistic_Failed_Buffer_Count",
+        "Statistic_Buffer_Underrun_Count",
+        "Statistic_Failed_Packet_Count",
+        "Statistic_Resend_Request_Count",
+        "Statistic_Resend_Packet_Count",
+        NULL
+    };
+    return names;
+}
+
+#endif /* TRANSPORTTUNING_H */
@@ -8,6 +8,19 @@
 #include <pylon/gige/BaslerGigEInstantCameraArray.h>
 #include <pylon/gige/_BaslerGigECameraParams.h>
 #include "AgriDataCamera.h"
+#include "AsyncLog.h"
+#include "BandwidthPlanner.h"
+#include "DatabaseIndexes.h"
+#include "FrameNotifier.h"
+#include "MetricsServer.h"
+#include "Scheduler.h"
+#include "StatusSeries.h"
+#include "MemoryBudget.h"
+#include "MetadataJournal.h"
+#include "OutputRecovery.h"
+#include "TaskBroker.h"
+#include "TaskRegistry.h"
+#include "ThreadRoles.h"
 
 // Include files to use openCV.
 #include "opencv2/core.hpp"
@@ -36,6 +49,7 @@
 #include "easylogging++.h"
 
 // Additional include files.
+#include <algorithm>
 #include <atomic>
 #include <ctime>
 #include <exception>
@@ -130,6 +144,31 @@ static void printIntro() {
     LOG(INFO);
 }
 
+/**
+ * planBandwidth
+ *
+ * Shares each network interface between the GigE cameras on it (see
+ * BandwidthPlanner.h). Has to run after every camera is initialized and before any
+ * of them starts grabbing.
+ */
+static void planBandwidth(AgriDataCamera ** cameras, size_t count) {
+    vector<StreamDemand> demands;
+    vector<AgriDataCamera *> gige;
+
+    for (size_t i = 0; i < count; ++i) {
+        StreamDemand demand;
+        if (cameras[i]->BandwidthDemand(demand)) {
+            demands.push_back(demand);
+            gige.push_back(cameras[i]);
+        }
+    }
+
+    vector<StreamPlan> plans = BandwidthPlanner().Plan(demands);
+    for (size_t i = 0; i < plans.size(); ++i) {
+        gige[i]->ApplyBandwidthPlan(plans[i]);
+    }
+}
+
 /*
  * main
  *
@@ -139,11 +178,36 @@ int main() {
     el::Configurations conf("config/easylogging.conf");
     el::Loggers::addFlag(el::LoggingFlag::ColoredTerminalOutput);
 
+    // Frame-path messages (HOT_LOG) are written by a background thread
+    AsyncLog::Start();
+
     // Register signals
     signal(SIGINT, sigint_function);
 
     LOG(INFO) << "Camera Deamon has been started";
 
+    // Daemon configuration (optional, every setting has a default)
+    json daemon_config = json::object();
+    ifstream daemon_config_file("config/daemon.json");
+    if (daemon_config_file) {
+        try {
+            daemon_config_file >> daemon_config;
+        } catch (const exception &e) {
+            LOG(ERROR) << "Ignoring config/daemon.json: " << e.what();
+        }
+    }
+
+    // Thread placement (this thread is the control thread)
+    ThreadRoles::Configure(daemon_config.value("threads", json::object()));
+    ScopedThreadRole role(ROLE_CONTROL);
+
+    // One memory budget for all cameras (see MemoryBudget.h)
+    MemoryBudget::Configure(daemon_config.value("memory", json::object()));
+
+    // Periodic background work of the cameras (see Scheduler.h)
+    json schedule_config = daemon_config.value("scheduler", json::object());
+    Scheduler::Start(schedule_config.value("workers", 2), schedule_config.value("database_workers", 1));
+
     // Subscribe on port 4999
     zmq::context_t context(1);
     zmq::socket_t client(context, ZMQ_SUB);
@@ -165,6 +229,7 @@ int main() {
         {"mongodb://localhost:27017"}};
     mongocxx::database db = conn["agdb"];
     mongocxx::collection scans = db["scan"];
+    DatabaseIndexes::Provision("mongodb://localhost:27017", daemon_config.value("indexes", json::object()));
 
     // Initialize Pylon (required for any future Pylon fuctions)
     PylonInitialize();
@@ -180,19 +245,45 @@ int main() {
     }
 
     // Camera Initialization
+    json output_config = daemon_config.value("output", json::object());
     AgriDataCamera * cameras[devices.size()];
+    fill(cameras, cameras + devices.size(), (AgriDataCamera *) NULL);
+    size_t initialized = 0;     // cameras[0 .. initialized) are set up
     try {
         for (size_t i = 0; i < devices.size(); ++i) {
             cameras[i] = new AgriDataCamera();
             cameras[i]->Attach(tlFactory.CreateDevice(devices[i]));
             cameras[i]->Initialize();
+            cameras[i]->ConfigureFlightRecorder(daemon_config.value("flight_recorder", json::object()));
+            cameras[i]->ConfigureSchedule(schedule_config);
+            cameras[i]->ConfigureQuality(daemon_config.value("quality", json::object()));
+            cameras[i]->ConfigureMetadata(daemon_config.value("metadata", json::object()));
+            cameras[i]->ConfigureOutput(output_config);
+            initialized = i + 1;
         }
+        planBandwidth(cameras, devices.size());
     } catch (const GenericException &e) {
         LOG(ERROR) << "Camera Initialization Failed";
         LOG(ERROR) << "Exception caught: " << e.what();
     } catch (...) {
     }
 
+    // Background services, whatever became of the cameras
+    TaskRegistry::Start("mongodb://localhost:27017", daemon_config.value("tasks", json::object()));
+    TaskBroker::Start("mongodb://localhost:27017", daemon_config.value("broker", json::object()));
+    StatusSeries::Start("mongodb://localhost:27017", daemon_config.value("status", json::object()));
+    MetadataJournal::Start("mongodb://localhost:27017", daemon_config.value("journal", json::object()));
+    FrameNotifier::Start(daemon_config.value("notify", json::object()));
+    OutputRecovery::Run("mongodb://localhost:27017", output_config.value("root", string("/data/output/")),
+            daemon_config.value("recovery", json::object()));
+
+    // Prometheus endpoint (reads only atomics, see MetricsServer.h)
+    MetricsServer metrics;
+    json metrics_config = daemon_config.value("metrics", json::object());
+    if (metrics_config.value("enabled", true)) {
+        metrics.Start(metrics_config.value("port", 4996), cameras, initialized);
+    }
+
     // Initialize variables
     int rec;
     string receivedstring;
@@ -214,6 +305,8 @@ int main() {
                 client.close();
                 publisher.close();
 
+                metrics.Stop();
+
                 LOG(INFO) << "Arresting Cameras";
                 for (size_t i = 0; i < devices.size(); ++i) {
                     cameras[i]->Close();
@@ -221,6 +314,13 @@ int main() {
 
                 // Take a break! (0.15 seconds)
                 usleep(150000);
+                FrameNotifier::Stop();
+                MetadataJournal::Stop();
+                TaskRegistry::Stop();
+                TaskBroker::Stop();
+                StatusSeries::Stop();
+                Scheduler::Stop();
+                AsyncLog::Stop();
                 break;
             }
 
@@ -263,8 +363,11 @@ int main() {
                             doc.append(bsoncxx::builder::basic::kvp("session_name", session_name));
                             doc.append(bsoncxx::builder::basic::kvp("start", bsoncxx::types::b_int64{AGDUtils::grabMilliseconds()}));
 
-                            // Create document *before* running the cameras
-                            scans.insert_one(doc.view());
+                            // Create document *before* running the cameras (in the scan's
+                            // journal, see MetadataJournal.h)
+                            if (!MetadataJournal::Begin(scanid) || !MetadataJournal::Append(JOURNAL_SCAN_START, doc.view())) {
+                                scans.insert_one(doc.view());
+                            }
 
                             for (size_t i = 0; i < devices.size(); ++i) {
                                 // Set Scan ID
@@ -289,10 +392,10 @@ int main() {
                             for (size_t i = 0; i < devices.size(); ++i) {
                                 sn = cameras[i]->GetDeviceInfo().GetSerialNumber();
                                 if (!cameras[i]->isPaused) {
-                                    cameras[i]->isPaused = true;
+                                    cameras[i]->Pause(true);
                                     reply["message"][sn] = "Camera paused";
                                 } else {
-                                    cameras[i]->isPaused = false;
+                                    cameras[i]->Pause(false);
                                     reply["message"][sn] = "Camera unpaused";
                                 }
                             }
@@ -311,19 +414,25 @@ int main() {
                             json status = cameras[0]->GetStatus();
                             string id = status["scanid"];
 
-                            // Using the stream here since it's so popular
-                            scans.update_one(bsoncxx::builder::stream::document{}
-                            << "scanid" << id << bsoncxx::builder::stream::finalize,
-                                    bsoncxx::builder::stream::document{}
-                            << "$set" <<
-                            bsoncxx::builder::stream::open_document << "end" << bsoncxx::types::b_int64{AGDUtils::grabMilliseconds()}
-                            <<
-                            bsoncxx::builder::stream::close_document << bsoncxx::builder::stream::finalize);
+                            auto end = bsoncxx::builder::basic::document{};
+                            end.append(bsoncxx::builder::basic::kvp("scanid", id));
+                            end.append(bsoncxx::builder::basic::kvp("end", bsoncxx::types::b_int64{AGDUtils::grabMilliseconds()}));
+                            if (!MetadataJournal::Append(JOURNAL_SCAN_END, end.view())) {
+                                // Using the stream here since it's so popular
+                                scans.update_one(bsoncxx::builder::stream::document{}
+                                << "scanid" << id << bsoncxx::builder::stream::finalize,
+                                        bsoncxx::builder::stream::document{}
+                                << "$set" <<
+                                bsoncxx::builder::stream::open_document << "end" << bsoncxx::types::b_int64{AGDUtils::grabMilliseconds()}
+                                <<
+                                bsoncxx::builder::stream::close_document << bsoncxx::builder::stream::finalize);
+                            }
 
-                            // Stop cameras
+                            // Stop cameras (their last frames and tasks still go to the journal)
                             for (size_t i = 0; i < devices.size(); ++i) {
                                 cameras[i]->Stop();
                             }
+                            MetadataJournal::End();
 
                             // This sleep (is / may be) necessary to allow the threads to finish
                             // and resources to be released
@@ -332,6 +441,7 @@ int main() {
                             for (size_t i = 0; i < devices.size(); ++i) {
                                 cameras[i]->Initialize();
                             }
+                            planBandwidth(cameras, devices.size());
                             isRecording = false;
                             reply["message"] = "Recording Stopped, Cameras Reinitialized";
                             reply["status"] = "1";
@@ -345,6 +455,32 @@ int main() {
                             sn = status["Serial Number"];
                             reply["message"][sn] = status;
                         }
+                        reply["threads"] = ThreadRoles::Report();
+                        reply["scheduler"] = Scheduler::Report();
+                        reply["memory"] = MemoryBudget::Report();
+                        reply["tasks"] = TaskRegistry::Report();
+                        reply["status_samples"] = StatusSeries::Report();
+                        reply["journal"] = MetadataJournal::Report();
+                        reply["indexes"] = DatabaseIndexes::Report();
+                        reply["recovery"] = OutputRecovery::Report();
+                        reply["notify"] = FrameNotifier::Report();
+                        reply["broker"] = TaskBroker::Report();
+                        reply["status"] = "1";
+                    }
+                        // Metrics (latency only, safe to poll while recording)
+                    else if (received["action"] == "metrics") {
+                        for (size_t i = 0; i < devices.size(); ++i) {
+                            status = cameras[i]->GetMetrics();
+                            sn = status["Serial Number"];
+                            reply["message"][sn] = status;
+                        }
+                        reply["status"] = "1";
+                    }
+                        // Flight recorder dump (see FlightRecorder.h), replies with the file names
+                    else if (received["action"] == "flightdump") {
+                        for (size_t i = 0; i < devices.size(); ++i) {
+                            reply["message"][cameras[i]->serialnumber] = cameras[i]->DumpFlightRecorder("operator");
+                        }
                         reply["status"] = "1";
                     }
                         // Snap
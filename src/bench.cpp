@@ -0,0 +1,464 @@
+/*
+ * File:   bench.cpp
+ * Author: agridata
+ *
+ * Microbenchmarks for the kernels of the frame path (HandleFrame), run on synthetic
+ * frames so that Jetson and x86 builds can be compared without a camera:
+ *
+ *   convert      Pylon CImageFormatConverter to BGR8packed, per source pixel format
+ *   resize       full frame to 960x600
+ *   color        BGR -> RGB swap on the resized frame
+ *   encode_qNN   imencode to JPEG at several qualities (q95 is what HandleFrame uses)
+ *   luminance    AGDUtils::luminance on the resized frame
+ *   hdf5_write   H5LTmake_dataset of the encoded frame, one dataset per frame
+ *
+ * and for the metadata paths, the old way (through JSON) against BsonFields.h:
+ *
+ *   status_json / status_bson        a status document (GetStatus)
+ *   clientid_json / clientid_bson    clientid out of the box document (Initialize)
+ *   priority_json / priority_bson    priority out of a task document (priority seeding)
+ *
+ * Usage: bench [-n iterations] [-d hdf5 directory] [-o output.json]
+ *
+ * Results are JSON: ns per frame (mean and best), MB/s of input, and heap
+ * allocations per frame (per document for the metadata paths). Allocations are
+ * counted by interposing malloc, so they include OpenCV, HDF5 and Pylon as well as
+ * operator new.
+ */
+
+// Standard
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// System
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+// Pylon
+#include <pylon/PylonIncludes.h>
+
+// OpenCV
+#include "opencv2/core.hpp"
+#include "opencv2/highgui.hpp"
+#include "opencv2/imgproc.hpp"
+
+// AgriData (luminance, HDF5, status documents)
+#include "../AGDUtils.h"
+#include "../BsonFields.h"
+#include "../StatusSeries.h"
+
+// MongoDB
+#include <bsoncxx/builder/basic/document.hpp>
+#include <bsoncxx/builder/basic/kvp.hpp>
+#include <bsoncxx/builder/stream/document.hpp>
+#include <bsoncxx/json.hpp>
+
+// Utilities
+#include "json.hpp"
+
+// Logging (for StatusSeries)
+#include "easylogging++.h"
+
+INITIALIZE_EASYLOGGINGPP
+
+using namespace std;
+using namespace cv;
+using namespace Pylon;
+using json = nlohmann::json;
+
+/**
+ * Allocation counting
+ *
+ * glibc's own entry points do the work; these only count
+ */
+namespace {
+    atomic<uint64_t> allocations(0);
+    atomic<uint64_t> allocated_bytes(0);
+
+    inline void count_allocation(size_t size) {
+        allocations.fetch_add(1, memory_order_relaxed);
+        allocated_bytes.fetch_add(size, memory_order_relaxed);
+    }
+}
+
+extern "C" {
+    void * __libc_malloc(size_t size);
+    void * __libc_calloc(size_t n, size_t size);
+    void * __libc_realloc(void * ptr, size_t size);
+    void * __libc_memalign(size_t alignment, size_t size);
+
+    void * malloc(size_t size) {
+        count_allocation(size);
+        return __libc_malloc(size);
+    }
+
+    void * calloc(size_t n, size_t size) {
+        count_allocation(n * size);
+        return __libc_calloc(n, size);
+    }
+
+    void * realloc(void * ptr, size_t size) {
+        count_allocation(size);
+        return __libc_realloc(ptr, size);
+    }
+
+    int posix_memalign(void ** ptr, size_t alignment, size_t size) {
+        count_allocation(size);
+        *ptr = __libc_memalign(alignment, size);
+        return *ptr ? 0 : ENOMEM;
+    }
+
+    void * aligned_alloc(size_t alignment, size_t size) {
+        count_allocation(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void * memalign(size_t alignment, size_t size) {
+        count_allocation(size);
+        return __libc_memalign(alignment, size);
+    }
+}
+
+namespace {
+
+    struct Resolution {
+        int width;
+        int height;
+    };
+
+    const Resolution RESOLUTIONS[] = {
+        {1920, 1200},   // acA1920-40gc, acA1920-155uc
+        {1280, 1024}    // acA1300-200uc
+    };
+
+    // HandleFrame resizes to this (Size(TARGET_HEIGHT, TARGET_WIDTH))
+    const Size TARGET(960, 600);
+
+    const int QUALITIES[] = {30, 50, 75, 95};
+
+    string Name(const Resolution &r) {
+        return to_string(r.width) + "x" + to_string(r.height);
+    }
+
+    /**
+     * Measure
+     *
+     * Runs f a few times to warm up, then `iterations` times; bytes is the input size
+     * of one call (for MB/s)
+     */
+    json Measure(const string &kernel, const string &resolution, const string &format,
+            size_t bytes, int iterations, const function<void()> &f) {
+        for (int i = 0; i < 3; ++i) {
+            f();
+        }
+
+        uint64_t allocations_before = allocations.load();
+        uint64_t bytes_before = allocated_bytes.load();
+        int64_t best = INT64_MAX;
+        int64_t total = 0;
+
+        for (int i = 0; i < iterations; ++i) {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            f();
+            int64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+            total += ns;
+            best = min(best, ns);
+        }
+
+        double mean = (double) total / iterations;
+        json result = {
+            {"kernel", kernel},
+            {"resolution", resolution},
+            {"format", format},
+            {"iterations", iterations},
+            {"ns_per_frame", (int64_t) mean},
+            {"best_ns", best},
+            {"mb_per_s", bytes / mean * 1e3},
+            {"allocations_per_frame", (double) (allocations.load() - allocations_before) / iterations},
+            {"allocated_bytes_per_frame", (double) (allocated_bytes.load() - bytes_before) / iterations}
+        };
+        cerr << kernel << " " << resolution << " " << format << ": " << (int64_t) mean / 1000 << " us" << endl;
+        return result;
+    }
+
+    /**
+     * Scene
+     *
+     * Something JPEG has to work at: gradients, edges and sensor-like noise
+     */
+    Mat Scene(const Resolution &r) {
+        Mat bgr(r.height, r.width, CV_8UC3);
+        for (int y = 0; y < r.height; ++y) {
+            Vec3b * row = bgr.ptr<Vec3b>(y);
+            for (int x = 0; x < r.width; ++x) {
+                row[x] = Vec3b((uchar) (x * 255 / r.width), (uchar) (y * 255 / r.height),
+                        (uchar) (((x / 64) + (y / 64)) % 2 ? 200 : 40));
+            }
+        }
+        for (int i = 0; i < 40; ++i) {
+            Point center((i * 7919) % r.width, (i * 104729) % r.height);
+            circle(bgr, center, 20 + (i * 13) % 120, Scalar((i * 37) % 255, (i * 91) % 255, (i * 53) % 255), -1);
+        }
+        Mat noise(bgr.size(), bgr.type());
+        randn(noise, Scalar::all(0), Scalar::all(8));
+        bgr += noise;
+        return bgr;
+    }
+
+    // RGGB mosaic, one byte per pixel
+    vector<uint8_t> BayerRG8(const Mat &bgr) {
+        vector<uint8_t> raw(bgr.rows * bgr.cols);
+        for (int y = 0; y < bgr.rows; ++y) {
+            const Vec3b * row = bgr.ptr<Vec3b>(y);
+            for (int x = 0; x < bgr.cols; ++x) {
+                int channel = (y % 2 == 0) ? (x % 2 == 0 ? 2 : 1) : (x % 2 == 0 ? 1 : 0);
+                raw[y * bgr.cols + x] = row[x][channel];
+            }
+        }
+        return raw;
+    }
+
+    // YCbCr 4:2:2, Y0 U Y1 V, two bytes per pixel
+    vector<uint8_t> YUV422(const Mat &bgr) {
+        Mat yuv;
+        cvtColor(bgr, yuv, CV_BGR2YUV);
+        vector<uint8_t> raw(bgr.rows * bgr.cols * 2);
+        for (int y = 0; y < yuv.rows; ++y) {
+            const Vec3b * row = yuv.ptr<Vec3b>(y);
+            uint8_t * out = &raw[y * yuv.cols * 2];
+            for (int x = 0; x + 1 < yuv.cols; x += 2) {
+                out[2 * x] = row[x][0];
+                out[2 * x + 1] = (uint8_t) ((row[x][1] + row[x + 1][1]) / 2);
+                out[2 * x + 2] = row[x + 1][0];
+                out[2 * x + 3] = (uint8_t) ((row[x][2] + row[x + 1][2]) / 2);
+            }
+        }
+        return raw;
+    }
+
+    vector<uint8_t> BGR8(const Mat &bgr) {
+        return vector<uint8_t>(bgr.data, bgr.data + bgr.total() * bgr.elemSize());
+    }
+
+    /**
+     * Metadata
+     *
+     * The metadata paths that used to go through JSON, both ways. The JSON versions are
+     * what GetStatus, Initialize and AddTask did before BsonFields.h.
+     */
+    void Metadata(json &results, int iterations) {
+        using bsoncxx::builder::basic::kvp;
+
+        StatusSample sample;
+        sample.time = 1500000000000LL;
+        sample.serialnumber = "21789427";
+        sample.modelname = "acA1920-40gc";
+        sample.recording = true;
+        sample.timestamp = 1500000000000LL;
+        sample.scanid = "2017-07-14_02-40-00";
+        sample.exposure_time = 5000;
+        sample.fps = 40;
+        sample.gain = 12;
+        sample.temperature = 52;
+        sample.target_brightness = 100;
+        sample.has_luminance = false;
+        sample.luminance = 0;
+
+        size_t status_bytes = StatusSeries::ToDocument(sample).view().length();
+
+        results.push_back(Measure("status_json", "-", "JSON", status_bytes, iterations, [&]() {
+            json status;
+            status["Serial Number"] = sample.serialnumber;
+            status["Model Name"] = sample.modelname;
+            status["Recording"] = sample.recording;
+            status["Timestamp"] = sample.timestamp;
+            status["scanid"] = sample.scanid;
+            status["Current Gain"] = (float) sample.gain;
+            status["Exposure Time"] = (float) sample.exposure_time;
+            status["Resulting Frame Rate"] = (float) sample.fps;
+            status["Temperature"] = (float) sample.temperature;
+            status["Target Brightness"] = sample.target_brightness;
+
+            bsoncxx::document::value document = bsoncxx::builder::stream::document{}  << "Serial Number" << (string) status["Serial Number"].get<string>()
+                    << "Model Name" << (string) status["Model Name"].get<string>()
+                    << "Recording" << (bool) status["Recording"].get<bool>()
+                    << "Timestamp" << (int64_t) status["Timestamp"].get<int64_t>()
+                    << "scanid" << (string) status["scanid"].get<string>()
+                    << "Exposure Time" << (int) status["Exposure Time"].get<int>()
+                    << "Resulting Frame Rate" << (int) status["Resulting Frame Rate"].get<int>()
+                    << "Current Gain" << (int) status["Current Gain"].get<int>()
+                    << "Temperature" << (int) status["Temperature"].get<int>()
+                    << "Target Brightness" << (int) status["Target Brightness"].get<int>()
+                    << bsoncxx::builder::stream::finalize;
+        }));
+
+        results.push_back(Measure("status_bson", "-", "BSON", status_bytes, iterations, [&]() {
+            bsoncxx::document::value document = StatusSeries::ToDocument(sample);
+        }));
+
+        // A box document and a task document, as they come back from find_one
+        bsoncxx::builder::basic::document box_builder{};
+        box_builder.append(kvp("_id", bsoncxx::oid()));
+        box_builder.append(kvp("clientid", "agridata"));
+        box_builder.append(kvp("boxid", "box-0042"));
+        box_builder.append(kvp("cameras", 4));
+        bsoncxx::document::value box = box_builder.extract();
+
+        results.push_back(Measure("clientid_json", "-", "JSON", box.view().length(), iterations, [&]() {
+            string resultstring = bsoncxx::to_json(box.view());
+            auto thisbox = json::parse(resultstring);
+            volatile bool found = !thisbox["clientid"].get<string>().empty();
+            (void) found;
+        }));
+
+        results.push_back(Measure("clientid_bson", "-", "BSON", box.view().length(), iterations, [&]() {
+            volatile bool found = !BsonFields::String(box.view(), "clientid").empty();
+            (void) found;
+        }));
+
+        bsoncxx::builder::basic::document task_builder{};
+        task_builder.append(kvp("_id", bsoncxx::oid()));
+        task_builder.append(kvp("clientid", "agridata"));
+        task_builder.append(kvp("scanid", sample.scanid));
+        task_builder.append(kvp("hdf5filename", "/data/output/agridata/2017-07-14_02-40-00/21789427/2017-07-14_02-41-00.hdf5"));
+        task_builder.append(kvp("cameraid", sample.serialnumber));
+        task_builder.append(kvp("session_name", "block 7"));
+        task_builder.append(kvp("cluster_detection", 0));
+        task_builder.append(kvp("preprocess", 0));
+        task_builder.append(kvp("trunk_detection", 0));
+        task_builder.append(kvp("process", 0));
+        task_builder.append(kvp("shape_analysis_per_archive", 0));
+        task_builder.append(kvp("priority", 1234));
+        bsoncxx::document::value task = task_builder.extract();
+
+        results.push_back(Measure("priority_json", "-", "JSON", task.view().length(), iterations, [&]() {
+            volatile int priority = json::parse(bsoncxx::to_json(task.view()))["priority"];
+            (void) priority;
+        }));
+
+        results.push_back(Measure("priority_bson", "-", "BSON", task.view().length(), iterations, [&]() {
+            volatile int64_t priority = BsonFields::Int64(task.view(), "priority");
+            (void) priority;
+        }));
+    }
+}
+
+int main(int argc, char **argv) {
+    int iterations = 50;
+    string hdf5_dir = "/tmp";
+    string output;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:o:")) != -1) {
+        switch (opt) {
+            case 'n': iterations = max(1, atoi(optarg)); break;
+            case 'd': hdf5_dir = optarg; break;
+            case 'o': output = optarg; break;
+            default:
+                cerr << "Usage: " << argv[0] << " [-n iterations] [-d hdf5 directory] [-o output.json]" << endl;
+                return 1;
+        }
+    }
+
+    PylonAutoInitTerm autoInitTerm;
+    struct utsname host;
+    uname(&host);
+
+    json report;
+    report["host"] = {
+        {"hostname", host.nodename},
+        {"machine", host.machine},
+        {"kernel", host.release},
+        {"cpus", sysconf(_SC_NPROCESSORS_ONLN)},
+        {"opencv", CV_VERSION}
+    };
+    report["results"] = json::array();
+
+    for (const Resolution &r : RESOLUTIONS) {
+        const string resolution = Name(r);
+        Mat scene = Scene(r);
+
+        // Pylon conversion from each source format
+        struct Source {
+            const char * name;
+            EPixelType type;
+            vector<uint8_t> data;
+        };
+        vector<Source> sources;
+        sources.push_back({"BayerRG8", PixelType_BayerRG8, BayerRG8(scene)});
+        sources.push_back({"YCbCr422", PixelType_YUV422_YUYV_Packed, YUV422(scene)});
+        sources.push_back({"BGR8", PixelType_BGR8packed, BGR8(scene)});
+
+        CImageFormatConverter fc;
+        fc.OutputPixelFormat = PixelType_BGR8packed;
+        CPylonImage image;
+
+        for (const Source &source : sources) {
+            report["results"].push_back(Measure("convert", resolution, source.name, source.data.size(), iterations, [&]() {
+                fc.Convert(image, &source.data[0], source.data.size(), source.type,
+                        r.width, r.height, 0, ImageOrientation_TopDown);
+            }));
+        }
+
+        // Everything downstream of the converter sees BGR8
+        Mat full(r.height, r.width, CV_8UC3, (uint8_t *) image.GetBuffer());
+        Mat small;
+        report["results"].push_back(Measure("resize", resolution, "BGR8", full.total() * full.elemSize(), iterations, [&]() {
+            resize(full, small, TARGET);
+        }));
+
+        const string target = to_string(TARGET.width) + "x" + to_string(TARGET.height);
+        const size_t small_bytes = TARGET.area() * 3;
+        report["results"].push_back(Measure("color", target, "BGR8", small_bytes, iterations, [&]() {
+            cvtColor(small, small, CV_BGR2RGB);
+        }));
+
+        vector<uint8_t> encoded;
+        for (int quality : QUALITIES) {
+            vector<int> params = {CV_IMWRITE_JPEG_QUALITY, quality};
+            report["results"].push_back(Measure("encode_q" + to_string(quality), target, "BGR8", small_bytes, iterations, [&]() {
+                imencode(".jpg", small, encoded, params);
+            }));
+        }
+
+        report["results"].push_back(Measure("luminance", target, "BGR8", small_bytes, iterations, [&]() {
+            volatile float lum = AGDUtils::luminance(small);
+            (void) lum;
+        }));
+
+        // HDF5, the way HandleFrame writes: one dataset per frame, default quality
+        imencode(".jpg", small, encoded, vector<int>());
+        string filename = hdf5_dir + "/bench_" + to_string(getpid()) + "_" + resolution + ".hdf5";
+        hid_t file = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        if (file < 0) {
+            cerr << "Could not create " << filename << endl;
+            return 1;
+        }
+        int frame = 0;
+        hsize_t buffersize = encoded.size();
+        report["results"].push_back(Measure("hdf5_write", target, "JPEG", encoded.size(), iterations, [&]() {
+            H5LTmake_dataset(file, to_string(frame++).c_str(), 1, &buffersize, H5T_NATIVE_UCHAR, &encoded[0]);
+        }));
+        H5Fclose(file);
+        unlink(filename.c_str());
+    }
+
+    // Metadata is per document, so many more of them
+    Metadata(report["results"], iterations * 100);
+
+    if (output.empty()) {
+        cout << report.dump(4) << endl;
+    } else {
+        ofstream(output) << report.dump(4) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * File:   flighttrace.cpp
+ * Author: agridata
+ *
+ * Converts flight recorder dumps (see FlightRecorder.h) into one Chrome trace, to open
+ * in chrome://tracing or https://ui.perfetto.dev. Each dump becomes a process named
+ * after the camera, with three threads:
+ *
+ *   frames     one slice per stage of every frame, end to end (dequeue is the wait in
+ *              RetrieveResult before the frame arrived)
+ *   latency    sensor to disk, ending where hdf5_write ends
+ *   events     file rotations and database flushes as slices, drops and quality
+ *              level changes (see QualityController.h) as instants
+ *
+ * Times are microseconds from the oldest event across all dumps given, so dumps of
+ * cameras on the same box line up.
+ *
+ * Usage: flighttrace dump.bin [dump.bin ...] > trace.json
+ */
+
+// Standard
+#include <iostream>
+#include <string>
+#include <vector>
+
+// AgriData
+#include "../FlightRecorder.h"
+#include "../QualityController.h"
+
+// Utilities
+#include "json.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+    enum TraceThread {
+        TID_FRAMES = 1,
+        TID_LATENCY,
+        TID_EVENTS
+    };
+
+    json Slice(const string &name, int pid, int tid, int64_t start_ns, int64_t duration_ns, const json &args) {
+        return {
+            {"name", name},
+            {"ph", "X"},
+            {"pid", pid},
+            {"tid", tid},
+            {"ts", start_ns / 1e3},
+            {"dur", duration_ns / 1e3},
+            {"args", args}
+        };
+    }
+
+    json Name(const char * what, int pid, int tid, const string &name) {
+        return {
+            {"name", what},
+            {"ph", "M"},
+            {"pid", pid},
+            {"tid", tid},
+            {"args", {{"name", name}}}
+        };
+    }
+
+    // Stages of HandleFrame in the order they run
+    const LatencyStage SEQUENCE[] = {STAGE_CONVERT, STAGE_RESIZE, STAGE_COLOR, STAGE_ENCODE, STAGE_WRITE, STAGE_METADATA};
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " dump.bin [dump.bin ...] > trace.json" << endl;
+        return 1;
+    }
+
+    vector<FlightHeader> headers(argc - 1);
+    vector<vector<FlightEvent> > dumps(argc - 1);
+    int64_t origin = INT64_MAX;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!FlightRecorder::Read(argv[i], headers[i - 1], dumps[i - 1])) {
+            cerr << argv[i] << ": not a flight recorder dump (or from another build)" << endl;
+            return 1;
+        }
+        for (const FlightEvent &event : dumps[i - 1]) {
+            origin = min(origin, event.start - (int64_t) event.stage_ns[STAGE_DEQUEUE]);
+        }
+    }
+
+    json trace;
+    trace["traceEvents"] = json::array();
+    trace["displayTimeUnit"] = "ms";
+    json &out = trace["traceEvents"];
+
+    for (size_t d = 0; d < dumps.size(); ++d) {
+        const FlightHeader &header = headers[d];
+        int pid = d + 1;
+
+        out.push_back(Name("process_name", pid, 0, string(header.serialnumber) + " (" + header.reason + ")"));
+        out.push_back(Name("thread_name", pid, TID_FRAMES, "frames"));
+        out.push_back(Name("thread_name", pid, TID_LATENCY, "latency"));
+        out.push_back(Name("thread_name", pid, TID_EVENTS, "events"));
+
+        trace["otherData"][to_string(pid)] = {
+            {"file", argv[d + 1]},
+            {"serialnumber", header.serialnumber},
+            {"reason", header.reason},
+            {"dumped_ms", header.wall_ms},
+            {"events", header.count}
+        };
+
+        for (const FlightEvent &event : dumps[d]) {
+            int64_t t = event.start - origin;
+
+            switch (event.type) {
+                case EVENT_FRAME:
+                {
+                    json args = {
+                        {"frame", event.frame},
+                        {"documents_pending", event.queue_depth}
+                    };
+
+                    int64_t dequeue = event.stage_ns[STAGE_DEQUEUE];
+                    out.push_back(Slice(StageLatency::Name(STAGE_DEQUEUE), pid, TID_FRAMES, t - dequeue, dequeue, args));
+
+                    int64_t written = t;
+                    for (LatencyStage stage : SEQUENCE) {
+                        out.push_back(Slice(StageLatency::Name(stage), pid, TID_FRAMES, t, event.stage_ns[stage], args));
+                        t += event.stage_ns[stage];
+                        if (stage == STAGE_WRITE) {
+                            written = t;
+                        }
+                    }
+
+                    int64_t total = event.stage_ns[STAGE_TOTAL];
+                    if (total > 0) {
+                        out.push_back(Slice(StageLatency::Name(STAGE_TOTAL), pid, TID_LATENCY, written - total, total, args));
+                    }
+                    break;
+                }
+                case EVENT_ROTATION:
+                    out.push_back(Slice("rotation", pid, TID_EVENTS, t, event.stage_ns[0],{
+                        {"frame", event.frame}
+                    }));
+                    break;
+                case EVENT_FLUSH:
+                    out.push_back(Slice("flush", pid, TID_EVENTS, t, event.stage_ns[0],{
+                        {"frame", event.frame},
+                        {"documents", event.value}
+                    }));
+                    break;
+                case EVENT_DROP:
+                    out.push_back({
+                        {"name", "drop"},
+                        {"ph", "i"},
+                        {"s", "p"},
+                        {"pid", pid},
+                        {"tid", TID_EVENTS},
+                        {"ts", t / 1e3},
+                        {"args",
+                            {
+                                {"frame", event.frame},
+                                {"frames", event.value},
+                                {"documents_pending", event.queue_depth}
+                            }}
+                    });
+                    break;
+                case EVENT_QUALITY:
+                    out.push_back({
+                        {"name", string("quality ") + QualityController::Name((QualityLevel) event.value)},
+                        {"ph", "i"},
+                        {"s", "p"},
+                        {"pid", pid},
+                        {"tid", TID_EVENTS},
+                        {"ts", t / 1e3},
+                        {"args", {{"level", event.value}}}
+                    });
+                    break;
+            }
+        }
+    }
+
+    cout << trace.dump() << endl;
+    return 0;
+}
@@ -0,0 +1,357 @@
+/*
+ * File:   soak.cpp
+ * Author: agridata
+ *
+ * Soak test: runs the recording pipeline (AgriDataCamera::Run, HDF5, MongoDB) on N
+ * emulated cameras at a given frame rate and resolution for a given time, and reports
+ * what the box sustained:
+ *
+ *   - frames per second per camera, and frames dropped (failed, skipped, slipped)
+ *   - per-stage latency percentiles (see LatencyHistogram.h)
+ *   - resident memory (current and peak), and the memory budget's pools
+ *   - disk write rate of the output directory
+ *
+ * The cameras are pylon's camera emulators (PYLON_CAMEMU), so no hardware is needed.
+ * Point it at a throwaway mongod, since it writes scan, frame and task documents:
+ *
+ *   mongod --dbpath /tmp/soakdb --port 27018 &
+ *   soak -n 4 -f 30 -w 1920 -h 1200 -t 600 -m mongodb://localhost:27018
+ *
+ * Usage: soak [-n cameras] [-f fps] [-w width] [-h height] [-t seconds]
+ *             [-i report interval] [-o output directory] [-m mongodb uri] [-j report.json]
+ *             [-F datasets|chunked]
+ */
+
+// Standard
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// System
+#include <ftw.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Pylon
+#include <pylon/PylonIncludes.h>
+
+// GenApi
+#include <GenApi/GenApi.h>
+
+// MongoDB
+#include <mongocxx/instance.hpp>
+
+// AgriData
+#include "../AgriDataCamera.h"
+#include "../AGDUtils.h"
+#include "../AsyncLog.h"
+#include "../DatabaseIndexes.h"
+#include "../Scheduler.h"
+#include "../MemoryBudget.h"
+#include "../MetadataJournal.h"
+#include "../TaskRegistry.h"
+#include "../TransportTuning.h"
+
+// Utilities
+#include "json.hpp"
+
+// Logging
+#include "easylogging++.h"
+
+INITIALIZE_EASYLOGGINGPP
+
+using namespace std;
+using namespace Pylon;
+using namespace GenApi;
+using json = nlohmann::json;
+
+namespace {
+
+    volatile sig_atomic_t sigint_flag = 0;
+
+    void sigint_function(int sig) {
+        sigint_flag = 1;
+    }
+
+    // Bytes under the output directory (nftw has no user pointer)
+    int64_t tree_bytes;
+
+    int AddFile(const char *, const struct stat * sb, int type, struct FTW *) {
+        if (type == FTW_F) {
+            tree_bytes += sb->st_size;
+        }
+        return 0;
+    }
+
+    int64_t DiskUsage(const string &root) {
+        tree_bytes = 0;
+        nftw(root.c_str(), AddFile, 16, FTW_PHYS);
+        return tree_bytes;
+    }
+
+    // Resident set size in kB (current from /proc, peak from getrusage)
+    int64_t ResidentKb() {
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, 6, "VmRSS:") == 0) {
+                return stol(line.substr(6));
+            }
+        }
+        return 0;
+    }
+
+    int64_t PeakResidentKb() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    /**
+     * Emulate
+     *
+     * Sets the emulated camera's frame size and rate before Initialize() reads them.
+     * The emulator has the GigE (SFNC 1.x) node names.
+     */
+    void Emulate(AgriDataCamera &camera, int width, int height, double fps) {
+        INodeMap &nodeMap = camera.GetNodeMap();
+
+        SetInteger(nodeMap, "OffsetX", 0);
+        SetInteger(nodeMap, "OffsetY", 0);
+        SetInteger(nodeMap, "Width", width);
+        SetInteger(nodeMap, "Height", height);
+
+        CBooleanPtr enable(nodeMap.GetNode("AcquisitionFrameRateEnable"));
+        CFloatPtr rate(nodeMap.GetNode("AcquisitionFrameRateAbs"));
+        if (IsWritable(enable) && IsWritable(rate)) {
+            enable->SetValue(true);
+            rate->SetValue(fps);
+        } else {
+            LOG(WARNING) << "Emulator frame rate is not settable, running free";
+        }
+
+        // Exposure bounds the frame rate of the emulator too
+        CFloatPtr exposure(nodeMap.GetNode("ExposureTimeAbs"));
+        if (IsWritable(exposure)) {
+            exposure->SetValue(min(exposure->GetMax(), 0.5e6 / fps));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int count = 2;
+    double fps = 15;
+    int width = 1920;
+    int height = 1200;
+    int duration = 60;
+    int interval = 10;
+    string output;
+    string mongodb = "mongodb://localhost:27017";
+    string report_file;
+    string format = "datasets";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:w:h:t:i:o:m:j:F:")) != -1) {
+        switch (opt) {
+            case 'n': count = atoi(optarg); break;
+            case 'f': fps = atof(optarg); break;
+            case 'w': width = atoi(optarg); break;
+            case 'h': height = atoi(optarg); break;
+            case 't': duration = atoi(optarg); break;
+            case 'i': interval = max(1, atoi(optarg)); break;
+            case 'o': output = optarg; break;
+            case 'm': mongodb = optarg; break;
+            case 'j': report_file = optarg; break;
+            case 'F': format = optarg; break;
+            default:
+                cerr << "Usage: " << argv[0] << " [-n cameras] [-f fps] [-w width] [-h height] [-t seconds]"
+                        << " [-i report interval] [-o output directory] [-m mongodb uri] [-j report.json]"
+                        << " [-F datasets|chunked]" << endl;
+                return 1;
+        }
+    }
+
+    // Logging (same configuration as the daemon)
+    el::Configurations conf("config/easylogging.conf");
+    el::Loggers::reconfigureAllLoggers(conf);
+    AsyncLog::Start();
+    signal(SIGINT, sigint_function);
+
+    // Output directory
+    if (output.empty()) {
+        char tmpl[] = "/tmp/soak.XXXXXX";
+        if (mkdtemp(tmpl) == NULL) {
+            LOG(FATAL) << "Could not create a temporary output directory";
+        }
+        output = tmpl;
+    }
+    if (output.back() != '/') {
+        output += '/';
+    }
+    AGDUtils::mkdirp(output.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+
+    // The emulator is enumerated alongside (or instead of) real cameras
+    setenv("PYLON_CAMEMU", to_string(count).c_str(), 1);
+
+    mongocxx::instance inst{};
+    DatabaseIndexes::Provision(mongodb, json::object());
+    PylonInitialize();
+
+    vector<AgriDataCamera *> cameras;
+    vector<thread> threads;
+    json report;
+
+    try {
+        CTlFactory& tlFactory = CTlFactory::GetInstance();
+        DeviceInfoList_t devices;
+        tlFactory.EnumerateDevices(devices);
+
+        for (size_t i = 0; i < devices.size() && (int) cameras.size() < count; ++i) {
+            if (devices[i].GetDeviceClass() != "BaslerCamEmu") {
+                continue;
+            }
+
+            AgriDataCamera * camera = new AgriDataCamera(mongodb);
+            camera->Attach(tlFactory.CreateDevice(devices[i]));
+            camera->output_root = output;
+            camera->Open();
+            Emulate(*camera, width, height, fps);
+            camera->Initialize();
+            camera->ConfigureOutput({{"format", format}});
+            cameras.push_back(camera);
+        }
+
+        if ((int) cameras.size() < count) {
+            LOG(FATAL) << "Only " << cameras.size() << " of " << count << " emulated cameras available";
+        }
+        TaskRegistry::Start(mongodb, json::object());
+        MetadataJournal::Start(mongodb, {{"dir", output + "journal/"}});
+
+        // Start recording, as the "start" action does
+        string scanid = "soak_" + AGDUtils::grabTime("%Y-%m-%d_%H-%M-%S");
+        LOG(INFO) << "Soak " << scanid << ": " << count << " x " << width << 'x' << height
+                << " @ " << fps << " fps for " << duration << " s into " << output;
+
+        MetadataJournal::Begin(scanid);
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            cameras[i]->scanid = scanid;
+            cameras[i]->session_name = "soak";
+            threads.push_back(thread(&AgriDataCamera::Run, cameras[i]));
+        }
+
+        // Sample every interval
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        chrono::steady_clock::time_point last = start;
+        vector<uint64_t> last_frames(cameras.size(), 0);
+        int64_t start_bytes = DiskUsage(output);
+        int64_t last_bytes = start_bytes;
+        double elapsed = 0;
+
+        while (elapsed < duration && !sigint_flag) {
+            this_thread::sleep_for(chrono::seconds(min(interval, duration - (int) elapsed)));
+
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            double period = chrono::duration<double>(now - last).count();
+            elapsed = chrono::duration<double>(now - start).count();
+            last = now;
+
+            int64_t bytes = DiskUsage(output);
+            LOG(INFO) << "[" << (int) elapsed << " s] RSS " << ResidentKb() / 1024 << " MB, disk "
+                    << (bytes - last_bytes) / period / 1e6 << " MB/s";
+            last_bytes = bytes;
+
+            for (size_t i = 0; i < cameras.size(); ++i) {
+                uint64_t frames = cameras[i]->frames_grabbed;
+                json metrics = cameras[i]->GetMetrics();
+                LOG(INFO) << "  " << cameras[i]->serialnumber << ": "
+                        << (frames - last_frames[i]) / period << " fps, "
+                        << cameras[i]->frames_failed + cameras[i]->frames_skipped + cameras[i]->frames_slipped
+                        << " dropped, total p99 " << metrics["Latency"]["total"]["p99_us"] << " us";
+                last_frames[i] = frames;
+            }
+        }
+
+        // Stop: let each Run() loop finish its frame before closing its file
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            cameras[i]->isRecording = false;
+        }
+        for (size_t i = 0; i < threads.size(); ++i) {
+            threads[i].join();
+        }
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            cameras[i]->Stop();
+        }
+        MetadataJournal::End();
+
+        // Report
+        report["config"] = {
+            {"cameras", count},
+            {"fps", fps},
+            {"width", width},
+            {"height", height},
+            {"duration_s", elapsed},
+            {"output", output},
+            {"format", format},
+            {"mongodb", mongodb}
+        };
+        report["rss_kb"] = ResidentKb();
+        report["peak_rss_kb"] = PeakResidentKb();
+        report["disk_mb_per_s"] = (DiskUsage(output) - start_bytes) / elapsed / 1e6;
+        report["memory"] = MemoryBudget::Report();
+        report["journal"] = MetadataJournal::Report();
+
+        double total_fps = 0;
+        for (size_t i = 0; i < cameras.size(); ++i) {
+            json metrics = cameras[i]->GetMetrics();
+            // grabbed counts every result delivered, failed and slipped ones too;
+            // skipped frames never arrived, so the camera sent grabbed + skipped
+            uint64_t grabbed = metrics["Frames"]["grabbed"];
+            uint64_t skipped = metrics["Frames"]["skipped"];
+            uint64_t dropped = metrics["Frames"]["failed"].get<uint64_t>() + skipped
+                    + metrics["Frames"]["slipped"].get<uint64_t>();
+            uint64_t sent = grabbed + skipped;
+
+            json camera;
+            camera["fps"] = grabbed / elapsed;
+            camera["frames"] = metrics["Frames"];
+            camera["dropped"] = dropped;
+            camera["drop_rate"] = sent > 0 ? (double) dropped / sent : 0;
+            camera["latency"] = metrics["Latency"];
+            report["cameras"][cameras[i]->serialnumber] = camera;
+            total_fps += grabbed / elapsed;
+        }
+        report["sustained_fps"] = total_fps;
+
+    } catch (const GenericException &e) {
+        LOG(ERROR) << "Soak failed: " << e.GetDescription();
+        MetadataJournal::Stop();
+        TaskRegistry::Stop();
+        Scheduler::Stop();
+        AsyncLog::Stop();
+        PylonTerminate();
+        return 1;
+    }
+
+    Scheduler::Stop();
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        cameras[i]->Close();
+        delete cameras[i];
+    }
+    MetadataJournal::Stop();
+    TaskRegistry::Stop();
+    PylonTerminate();
+    AsyncLog::Stop();
+
+    if (report_file.empty()) {
+        cout << report.dump(4) << endl;
+    } else {
+        ofstream(report_file) << report.dump(4) << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * File:   workunits.cpp
+ * Author: agridata
+ *
+ * A processor stand-in for the daemon's work units (see FrameNotifier.h): pulls them
+ * from the daemon's PUSH socket and reports how long frames took to become work:
+ *
+ *   capture_to_commit   grab of a unit's first frame to the flush that made it readable
+ *   commit_to_pickup    that flush to this process receiving the unit
+ *   capture_to_pickup   the two together, what a processor waits for a frame
+ *   capture_to_read     with -r, to having read the unit's frames out of the file
+ *
+ * plus units, frames and files seen, and rows missing between consecutive units of a
+ * file (none, unless another processor took some). Several can run at once; each unit
+ * goes to one of them. Times are the daemon's and this process's wall clocks, so run
+ * it on the same box.
+ *
+ * Usage: workunits [-e endpoint] [-n units] [-t seconds] [-r] [-j report.json]
+ */
+
+// Standard
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// System
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// AgriData
+#include "../AGDUtils.h"
+#include "../LatencyHistogram.h"
+
+// Messaging
+#include "zmq.hpp"
+
+// Utilities
+#include "json.hpp"
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace {
+
+    volatile sig_atomic_t sigint_flag = 0;
+
+    void sigint_function(int sig) {
+        sigint_flag = 1;
+    }
+
+    struct Seen {
+        uint64_t next_row;          // where the file's last unit ended
+        ImageReader *reader;        // with -r
+    };
+
+    const int64_t NS_PER_MS = 1000000;
+}
+
+int main(int argc, char **argv) {
+    string endpoint = "tcp://127.0.0.1:4994";
+    uint64_t limit = 0;
+    int duration = 0;
+    bool read_frames = false;
+    string report_file;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:n:t:rj:")) != -1) {
+        switch (opt) {
+            case 'e': endpoint = optarg; break;
+            case 'n': limit = strtoull(optarg, NULL, 10); break;
+            case 't': duration = atoi(optarg); break;
+            case 'r': read_frames = true; break;
+            case 'j': report_file = optarg; break;
+            default:
+                cerr << "Usage: " << argv[0] << " [-e endpoint] [-n units] [-t seconds] [-r] [-j report.json]" << endl;
+                return 1;
+        }
+    }
+    signal(SIGINT, sigint_function);
+
+    zmq::context_t context(1);
+    zmq::socket_t units(context, ZMQ_PULL);
+    int timeout = 100;
+    units.setsockopt(ZMQ_RCVTIMEO, &timeout, sizeof (timeout));
+    units.connect(endpoint.c_str());
+
+    LatencyHistogram capture_to_commit, commit_to_pickup, capture_to_pickup, capture_to_read;
+    map<string, Seen> files;
+    uint64_t received = 0, frames = 0, closed = 0, missing = 0, unreadable = 0, bad = 0;
+    int64_t start = AGDUtils::grabMilliseconds();
+
+    while (!sigint_flag && (limit == 0 || received < limit)
+            && (duration == 0 || AGDUtils::grabMilliseconds() - start < duration * 1000LL)) {
+        zmq::message_t message;
+        try {
+            if (!units.recv(&message)) {
+                continue;
+            }
+        } catch (const zmq::error_t &e) {
+            continue;
+        }
+        int64_t pickup = AGDUtils::grabMilliseconds();
+
+        json unit;
+        try {
+            unit = json::parse(string(static_cast<const char *> (message.data()), message.size()));
+        } catch (const exception &e) {
+            bad++;
+            continue;
+        }
+        if (!unit.count("rows") || unit["rows"].size() != 2) {
+            bad++;
+            continue;
+        }
+        received++;
+
+        string file = unit.value("file", string());
+        uint64_t from = unit["rows"][0], to = unit["rows"][1];
+        int64_t captured = unit.value("captured", (int64_t) 0);
+        int64_t committed = unit.value("committed", (int64_t) 0);
+
+        map<string, Seen>::iterator seen = files.find(file);
+        if (seen == files.end()) {
+            Seen first = {0, NULL};
+            seen = files.insert(make_pair(file, first)).first;
+        }
+        if (from > seen->second.next_row) {
+            missing += from - seen->second.next_row;
+        }
+        seen->second.next_row = max(seen->second.next_row, to);
+
+        if (to > from && captured > 0) {
+            frames += to - from;
+            capture_to_commit.Record((committed - captured) * NS_PER_MS);
+            commit_to_pickup.Record((pickup - committed) * NS_PER_MS);
+            capture_to_pickup.Record((pickup - captured) * NS_PER_MS);
+
+            if (read_frames) {
+                ImageReader *&reader = seen->second.reader;
+                if (reader == NULL) {
+                    reader = new ImageReader();
+                    if (!reader->tail(file)) {
+                        delete reader;
+                        reader = NULL;
+                    }
+                }
+                uint64_t read = 0;
+                if (reader != NULL) {
+                    reader->refresh();
+                    reader->seek(from);
+                    vector<uint8_t> jpeg;
+                    int64_t frame;
+                    while (from + read < to && reader->nextJpeg(jpeg, frame)) {
+                        read++;
+                    }
+                }
+                if (read == to - from) {
+                    capture_to_read.Record((AGDUtils::grabMilliseconds() - captured) * NS_PER_MS);
+                } else {
+                    unreadable += to - from - read;
+                }
+            }
+        }
+
+        if (unit.value("closed", false)) {
+            closed++;
+            delete seen->second.reader;
+            files.erase(seen);
+        }
+    }
+
+    for (map<string, Seen>::iterator it = files.begin(); it != files.end(); ++it) {
+        delete it->second.reader;
+    }
+
+    json report = {
+        {"endpoint", endpoint},
+        {"seconds", (AGDUtils::grabMilliseconds() - start) / 1000.},
+        {"units", received},
+        {"frames", frames},
+        {"files_closed", closed},
+        {"files_open", files.size()},
+        {"missing_rows", missing},
+        {"malformed", bad},
+        {"capture_to_commit", capture_to_commit.Summary()},
+        {"commit_to_pickup", commit_to_pickup.Summary()},
+        {"capture_to_pickup", capture_to_pickup.Summary()}
+    };
+    if (read_frames) {
+        report["capture_to_read"] = capture_to_read.Summary();
+        report["unreadable_frames"] = unreadable;
+    }
+
+    if (report_file.empty()) {
+        cout << report.dump(4) << endl;
+    } else {
+        ofstream(report_file) << report.dump(4) << endl;
+    }
+    return 0;
+}